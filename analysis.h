@@ -0,0 +1,836 @@
+/*
+    Program: Computer Simulator
+    File:    analysis.h
+    Author:  Stanton Brown
+
+    Desription:
+    Static analysis of a loaded memory image, before anything runs.
+    Control flow is followed from every place the CPU can start executing: address 0 in user
+    mode, and the timer handler (1000), the system call handler (1500) and the fault vector in
+    kernel mode. The result is:
+
+    - the control-flow graph: basic blocks joined by fallthrough, jump, call and return edges
+    - which words are code (instructions and their operands), data (words the code loads or
+      stores), or dead (nonzero words that are neither)
+    - how deep each stack can grow, and the words that may be written: Store targets and the
+      stack words within that depth, as far as the access map permits them
+    - self-modifying code: code words that may be written
+    - counted loops: backward jumps over a straight-line body that steps X with IncX or DecX,
+      with the number of iterations when it follows from the code and unwritten data
+
+    Everything is conservative. When control cannot be followed exactly (a Ret or IRet with
+    words of its own left on the stack, a Store into a stack, a loop that keeps pushing, or
+    CopyToSp moving a stack), every word the access map lets the program write is counted as
+    possibly written. The aot engine uses the analysis to leave the store-into-code checks
+    out of translated code that can never be written.
+
+    The reports are PREFIX.dot (a Graphviz graph of the basic blocks) and PREFIX.json.
+*/
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "memory.h"
+#include "isa.h"
+
+using namespace std;
+
+
+/*
+ * ProgramAnalysis: What can be known of a program without running it
+ * -------------------------------------------------------------------
+ */
+class ProgramAnalysis {
+
+public:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    //Modes an instruction is reached in, as bits
+    static const unsigned char USER = 1;
+    static const unsigned char KERNEL = 2;
+
+    //Words the CPU saves on the system stack before running a handler
+    static const int CONTEXT_WORDS = 6;
+
+    //Stack depth beyond which a stack is treated as unbounded
+    static const int DEPTH_LIMIT = 1000;
+
+    //Iterations simulated to count the trips of a loop
+    static const int TRIP_LIMIT = 100000;
+
+    enum WordKind { UNUSED, CODE, DATA, DEAD };
+
+    enum EdgeKind {
+        NEXT,       //the following instruction
+        JUMP,       //a jump, taken
+        CALL,       //a call to its target
+        RETURN      //where a call continues when its callee returns
+    };
+
+    struct Entry {
+        int address;
+        unsigned char mode;
+    };
+
+    struct Edge {
+        int target;
+        EdgeKind kind;
+    };
+
+    /*
+     * Block: A basic block, entered only at start and left only after its last instruction
+     */
+    struct Block {
+        int start;
+        int last;           //address of the last instruction
+        int end;            //last word, the operand of the last instruction if it has one
+        unsigned char mode;
+        vector<Edge> successors;
+    };
+
+    /*
+     * Loop: A backward jump from latch to header stepping X
+     */
+    struct Loop {
+        int header;
+        int latch;
+        int step;           //change of X per iteration
+        long long trips;    //times the header runs, -1 when unknown
+    };
+
+    vector<Entry> entries;
+    vector<Block> blocks;
+    vector<Loop> loops;
+
+    //Modes in which an instruction starting at each address is reached, 0 if none is
+    unsigned char reached[MEMORY_SIZE];
+
+    WordKind kind[MEMORY_SIZE];
+
+    //Words that may be written while the program runs
+    bool stored[MEMORY_SIZE];
+
+    //A code word may be written
+    bool selfModifying;
+
+    //Every transfer of control is an edge of the graph
+    bool controlExact;
+
+    //No reachable CopyToSp moves a stack
+    bool stackKnown;
+
+    //Deepest each stack can grow, in words, -1 if unbounded
+    int userDepth;
+    int systemDepth;
+
+private:
+    //How a function is entered, which decides how it may leave
+    enum Role { PROGRAM, CALLEE, HANDLER };
+
+    //depths[] before a function is measured and while it is
+    static const int NOT_MEASURED = -2;
+    static const int MEASURING = -3;
+
+    const int* words;
+    const AccessMap& access;
+
+    bool referenced[MEMORY_SIZE];
+    bool leader[MEMORY_SIZE];
+    vector<int> depths;
+
+    /*
+     * Registers: Values known while simulating straight-line code
+     */
+    struct Value {
+        bool known;
+        int value;
+    };
+    struct Registers {
+        Value AC, X, Y;
+    };
+
+public:
+
+    /*
+     * Constructor: ProgramAnalysis
+     * ----------------------------
+     * Analyzes a loaded program.
+     * Parameters:
+     * - words: the memory image
+     * - access: the access map of the run
+     * - faultVector: address of the stack fault handler, -1 for none
+     */
+    ProgramAnalysis(const int* words, const AccessMap& access, int faultVector) :
+    selfModifying(false), controlExact(true), stackKnown(true), userDepth(0), systemDepth(CONTEXT_WORDS),
+    words(words), access(access), depths(MEMORY_SIZE, int(NOT_MEASURED)) {
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            reached[i] = 0;
+            kind[i] = UNUSED;
+            stored[i] = false;
+            referenced[i] = false;
+            leader[i] = false;
+        }
+
+        addEntry(0, USER);
+        addEntry(1000, KERNEL);
+        addEntry(1500, KERNEL);
+        if(faultVector >= 0){
+            addEntry(faultVector, KERNEL);
+        }
+
+        explore();
+        classify();
+        findBlocks();
+        measureStacks();
+        findStores();
+        findLoops();
+    }
+
+    /*
+     * Function: writeDot
+     * ------------------
+     * Writes the control-flow graph for Graphviz: one box per basic block with its disassembly,
+     * kernel blocks shaded, blocks holding possibly written code in red and loop headers bold.
+     * Parameters:
+     * - fileName: the file to write
+     * Returns:
+     * false if the file could not be written.
+     */
+    bool writeDot(const string& fileName) const {
+        ofstream out(fileName);
+        out << "digraph program {\n"
+            << "    node [shape=box, fontname=\"monospace\"];\n";
+        for(size_t i = 0; i < entries.size(); i++){
+            out << "    entry" << entries[i].address << " [shape=plaintext, label=\""
+                << modeName(entries[i].mode) << " entry\"];\n"
+                << "    entry" << entries[i].address << " -> b" << entries[i].address << ";\n";
+        }
+        for(size_t i = 0; i < blocks.size(); i++){
+            const Block& block = blocks[i];
+            bool modified = false;
+            for(int a = block.start; a <= block.end; a++){
+                modified = modified || stored[a];
+            }
+            bool header = false;
+            for(size_t l = 0; l < loops.size(); l++){
+                header = header || loops[l].header == block.start;
+            }
+
+            out << "    b" << block.start << " [label=\"";
+            for(int a = block.start; a <= block.last; a += instructionWords(a)){
+                out << a << ": " << disassemble(words[a], a + 1 < MEMORY_SIZE ? words[a + 1] : 0) << "\\l";
+            }
+            out << "\"";
+            if(block.mode & KERNEL){
+                out << ", style=filled, fillcolor=\"gray90\"";
+            }
+            if(modified){
+                out << ", color=red";
+            }
+            if(header){
+                out << ", penwidth=2";
+            }
+            out << "];\n";
+
+            for(size_t e = 0; e < block.successors.size(); e++){
+                const Edge& edge = block.successors[e];
+                out << "    b" << block.start << " -> b" << edge.target;
+                if(edge.kind == CALL){
+                    out << " [style=dashed, label=\"call\"]";
+                }
+                else if(edge.kind == RETURN){
+                    out << " [style=dotted, label=\"return\"]";
+                }
+                else if(edge.kind == JUMP && edge.target <= block.last){
+                    out << " [label=\"loop\"]";
+                }
+                out << ";\n";
+            }
+        }
+        out << "}\n";
+        return (bool)out;
+    }
+
+    /*
+     * Function: writeJson
+     * -------------------
+     * Writes every result of the analysis as one JSON object. Address ranges are [first, last] pairs.
+     * Parameters:
+     * - fileName: the file to write
+     * Returns:
+     * false if the file could not be written.
+     */
+    bool writeJson(const string& fileName) const {
+        static const char* EDGES[] = {"next", "jump", "call", "return"};
+
+        ofstream out(fileName);
+        out << "{\n  \"entries\": [";
+        for(size_t i = 0; i < entries.size(); i++){
+            out << (i > 0 ? ", " : "") << "{\"address\": " << entries[i].address
+                << ", \"mode\": \"" << modeName(entries[i].mode) << "\"}";
+        }
+        out << "],\n  \"blocks\": [";
+        for(size_t i = 0; i < blocks.size(); i++){
+            const Block& block = blocks[i];
+            out << (i > 0 ? "," : "") << "\n    {\"start\": " << block.start << ", \"end\": " << block.end
+                << ", \"mode\": \"" << modeName(block.mode) << "\", \"successors\": [";
+            for(size_t e = 0; e < block.successors.size(); e++){
+                out << (e > 0 ? ", " : "") << "{\"target\": " << block.successors[e].target
+                    << ", \"kind\": \"" << EDGES[block.successors[e].kind] << "\"}";
+            }
+            out << "]}";
+        }
+        out << "\n  ],\n";
+
+        out << "  \"code\": ";
+        writeRanges(out, kind, CODE);
+        out << ",\n  \"data\": ";
+        writeRanges(out, kind, DATA);
+        out << ",\n  \"dead\": ";
+        writeRanges(out, kind, DEAD);
+        out << ",\n  \"stored\": ";
+        writeRanges(out, stored, true);
+        out << ",\n";
+
+        out << "  \"selfModifying\": " << (selfModifying ? "true" : "false") << ",\n"
+            << "  \"controlExact\": " << (controlExact ? "true" : "false") << ",\n"
+            << "  \"stackKnown\": " << (stackKnown ? "true" : "false") << ",\n"
+            << "  \"userStackDepth\": " << userDepth << ",\n"
+            << "  \"systemStackDepth\": " << systemDepth << ",\n";
+
+        out << "  \"loops\": [";
+        for(size_t i = 0; i < loops.size(); i++){
+            out << (i > 0 ? ", " : "") << "{\"header\": " << loops[i].header << ", \"latch\": " << loops[i].latch
+                << ", \"step\": " << loops[i].step << ", \"trips\": " << loops[i].trips << "}";
+        }
+        out << "]\n}\n";
+        return (bool)out;
+    }
+
+    /*
+     * Function: codeWritten
+     * ---------------------
+     * Parameters:
+     * - mode: USER, KERNEL or both
+     * Returns:
+     * true if a word of an instruction reached in mode may be written.
+     */
+    bool codeWritten(unsigned char mode) const {
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if((reached[a] & mode) && (stored[a] || (instructionWords(a) > 1 && stored[a + 1]))){
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+
+    //An instruction that fits in memory at address, or NULL
+    const Opcode* instruction(int address) const {
+        const Opcode* op = findOpcode(words[address]);
+        return op != nullptr && address + op->operands < MEMORY_SIZE ? op : nullptr;
+    }
+
+    int instructionWords(int address) const {
+        return 1 + findOpcode(words[address])->operands;
+    }
+
+    static const char* modeName(unsigned char mode){
+        return mode == USER ? "user" : (mode == KERNEL ? "kernel" : "both");
+    }
+
+    void addEntry(int address, unsigned char mode){
+        if(address < MEMORY_SIZE && instruction(address) != nullptr){
+            entries.push_back(Entry{address, mode});
+        }
+    }
+
+    /*
+     * Function: edges
+     * ---------------
+     * Returns:
+     * Where control goes after the instruction at address. A call continues at its target and,
+     * once the callee returns, after itself; Int continues after itself once the handler returns.
+     * Ret and IRet have no edges of their own, the edges of their calls and interrupts stand for them.
+     */
+    vector<Edge> edges(int address) const {
+        const Opcode* op = findOpcode(words[address]);
+        vector<Edge> result;
+        if(op->branch && op->operands > 0){
+            int target = words[address + 1];
+            if(target >= 0 && target < MEMORY_SIZE){
+                result.push_back(Edge{target, op->code == 23 ? CALL : JUMP});
+            }
+        }
+        int next = address + 1 + op->operands;
+        if(op->code != 20 && op->code != 24 && op->code != 30 && op->code != 50 && next < MEMORY_SIZE){
+            result.push_back(Edge{next, op->code == 23 ? RETURN : NEXT});
+        }
+        return result;
+    }
+
+    /*
+     * Function: explore
+     * -----------------
+     * Marks every instruction reachable from the entries, with the modes it runs in.
+     */
+    void explore(){
+        vector<Entry> pending(entries);
+        while(!pending.empty()){
+            Entry entry = pending.back();
+            pending.pop_back();
+            if((reached[entry.address] & entry.mode) || instruction(entry.address) == nullptr){
+                continue;
+            }
+            reached[entry.address] |= entry.mode;
+
+            vector<Edge> next = edges(entry.address);
+            for(size_t i = 0; i < next.size(); i++){
+                pending.push_back(Entry{next[i].target, entry.mode});
+            }
+        }
+    }
+
+    /*
+     * Function: classify
+     * ------------------
+     * Code is every word of a reached instruction. Of the other words, a run of nonzero or
+     * referenced words is data if the code loads or stores one of them, and dead otherwise.
+     */
+    void classify(){
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if(!reached[a]){
+                continue;
+            }
+            const Opcode* op = findOpcode(words[a]);
+            kind[a] = CODE;
+            if(op->operands > 0){
+                kind[a + 1] = CODE;
+                int operand = words[a + 1];
+                bool data = (op->code >= 2 && op->code <= 5) || op->code == 7;
+                if(data && operand >= 0 && operand < MEMORY_SIZE){
+                    referenced[operand] = true;
+                }
+            }
+        }
+
+        int a = 0;
+        while(a < MEMORY_SIZE){
+            if(kind[a] != UNUSED || (words[a] == 0 && !referenced[a])){
+                a++;
+                continue;
+            }
+            int end = a;
+            bool data = false;
+            while(end < MEMORY_SIZE && kind[end] == UNUSED && (words[end] != 0 || referenced[end])){
+                data = data || referenced[end];
+                end++;
+            }
+            for(; a < end; a++){
+                kind[a] = data ? DATA : DEAD;
+            }
+        }
+    }
+
+    /*
+     * Function: findBlocks
+     * --------------------
+     * Splits the reached instructions into basic blocks. A block starts at an entry, at the
+     * target of a jump or call, and after every instruction that may transfer control or ends
+     * the program.
+     */
+    void findBlocks(){
+        for(size_t i = 0; i < entries.size(); i++){
+            leader[entries[i].address] = true;
+        }
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if(!reached[a]){
+                continue;
+            }
+            const Opcode* op = findOpcode(words[a]);
+            vector<Edge> next = edges(a);
+            for(size_t i = 0; i < next.size(); i++){
+                if(next[i].kind != NEXT || op->branch){
+                    leader[next[i].target] = true;
+                }
+            }
+        }
+
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if(!reached[a] || !leader[a]){
+                continue;
+            }
+            Block block;
+            block.start = a;
+            block.mode = 0;
+            int b = a;
+            while(true){
+                const Opcode* op = findOpcode(words[b]);
+                int next = b + 1 + op->operands;
+                block.mode |= reached[b];
+                if(op->branch || op->code == 50 || next >= MEMORY_SIZE || !reached[next] || leader[next]){
+                    break;
+                }
+                b = next;
+            }
+            block.last = b;
+            block.end = b + instructionWords(b) - 1;
+            block.successors = edges(b);
+            blocks.push_back(block);
+        }
+    }
+
+    /*
+     * Function: functionDepth
+     * -----------------------
+     * Follows a function from its entry, without entering its calls, keeping the number of
+     * words it has pushed at every instruction. A call adds the return address and the depth
+     * of the callee. Control is inexact where two paths meet with different depths, where a
+     * pop reaches below the entry, or where the function leaves other than its role allows.
+     * Parameters:
+     * - entry: address of the function
+     * - role: how it is entered; a callee leaves with Ret and a handler with IRet, at depth 0
+     * Returns:
+     * The deepest the stack grows below the entry, or -1 if that is unbounded (recursion, or
+     * a loop that keeps pushing).
+     */
+    int functionDepth(int entry, Role role){
+        if(entry < 0 || entry >= MEMORY_SIZE){
+            return 0;   //the call itself fails
+        }
+        if(depths[entry] == MEASURING){
+            return -1;
+        }
+        if(depths[entry] != NOT_MEASURED){
+            return depths[entry];
+        }
+        depths[entry] = MEASURING;
+
+        vector<int> depth(MEMORY_SIZE, -1);
+        vector<int> pending;
+        depth[entry] = 0;
+        pending.push_back(entry);
+        int deepest = 0;
+
+        while(!pending.empty() && deepest >= 0){
+            int a = pending.back();
+            pending.pop_back();
+            const Opcode* op = instruction(a);
+            if(op == nullptr){
+                continue;
+            }
+
+            int d = depth[a];
+            int after = d;
+            if(op->code == 27){
+                after = d + 1;
+            }
+            else if(op->code == 28){
+                after = d - 1;
+            }
+            else if(op->code == 18){
+                stackKnown = false;
+            }
+            else if(op->code == 23){
+                int callee = functionDepth(words[a + 1], CALLEE);
+                deepest = callee < 0 ? -1 : max(deepest, d + 1 + callee);
+            }
+            else if(op->code == 24 && (role != CALLEE || d != 0)){
+                controlExact = false;
+            }
+            else if(op->code == 30 && (role != HANDLER || d != 0)){
+                controlExact = false;
+            }
+
+            if(after < 0){
+                controlExact = false;
+                after = 0;
+            }
+            if(after > DEPTH_LIMIT){
+                deepest = -1;
+            }
+            if(deepest < 0){
+                break;
+            }
+            deepest = max(deepest, after);
+
+            vector<Edge> next = edges(a);
+            for(size_t i = 0; i < next.size(); i++){
+                int target = next[i].target;
+                if(next[i].kind == CALL){
+                    continue;
+                }
+                if(depth[target] == -1 || after > depth[target]){
+                    if(depth[target] != -1){
+                        controlExact = false;
+                    }
+                    depth[target] = after;
+                    pending.push_back(target);
+                }
+                else if(after != depth[target]){
+                    controlExact = false;
+                }
+            }
+        }
+
+        depths[entry] = deepest;
+        return deepest;
+    }
+
+    /*
+     * Function: measureStacks
+     * -----------------------
+     * The user stack holds what the program pushes from address 0. The system stack holds the
+     * saved context and what the deepest handler pushes.
+     */
+    void measureStacks(){
+        int handlers = 0;
+        for(size_t i = 0; i < entries.size(); i++){
+            if(entries[i].mode == USER){
+                userDepth = functionDepth(entries[i].address, PROGRAM);
+            }
+            else{
+                int depth = functionDepth(entries[i].address, HANDLER);
+                handlers = depth < 0 || handlers < 0 ? -1 : max(handlers, depth);
+            }
+        }
+        systemDepth = handlers < 0 ? -1 : CONTEXT_WORDS + handlers;
+
+        //Int in kernel mode starts the system stack over, on top of the context it saved
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if((reached[a] & KERNEL) && words[a] == 29){
+                controlExact = false;
+            }
+        }
+    }
+
+    /*
+     * Function: findStores
+     * --------------------
+     * Marks the words that Store and the stacks may write, where the access map allows it.
+     * A Store into a stack could change a return address, so control is inexact after it.
+     */
+    void findStores(){
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if(!reached[a] || words[a] != 7){
+                continue;
+            }
+            int target = words[a + 1];
+            if(target < 0 || target >= MEMORY_SIZE){
+                continue;
+            }
+            if(((reached[a] & USER) && access.allows(target, AccessMap::USER_DATA, false)) ||
+               ((reached[a] & KERNEL) && access.allows(target, AccessMap::USER_DATA, true))){
+                stored[target] = true;
+            }
+            controlExact = controlExact && !inStack(target);
+        }
+
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            if(inStack(a)){
+                stored[a] = stored[a] || (a < AccessMap::USER_STACK_TOP ? access.allows(a, AccessMap::USER_STACK, false) :
+                                                                          access.allows(a, AccessMap::USER_STACK, true));
+            }
+        }
+
+        if(!controlExact || !stackKnown){
+            for(int a = 0; a < MEMORY_SIZE; a++){
+                stored[a] = stored[a] || access.allows(a, AccessMap::USER_DATA, false) ||
+                            access.allows(a, AccessMap::USER_DATA, true) ||
+                            access.allows(a, AccessMap::USER_STACK, false) ||
+                            access.allows(a, AccessMap::USER_STACK, true);
+            }
+        }
+
+        for(int a = 0; a < MEMORY_SIZE; a++){
+            selfModifying = selfModifying || (kind[a] == CODE && stored[a]);
+        }
+    }
+
+    //Whether a stack may grow over address
+    bool inStack(int address) const {
+        if(address < AccessMap::USER_STACK_TOP){
+            return userDepth < 0 || address >= AccessMap::USER_STACK_TOP - userDepth;
+        }
+        return address < AccessMap::SYSTEM_STACK_TOP &&
+               (systemDepth < 0 || address >= AccessMap::SYSTEM_STACK_TOP - systemDepth);
+    }
+
+    /*
+     * Function: findLoops
+     * -------------------
+     * Finds the jumps back to a header whose body, from the header to the jump, is straight-line
+     * code that uses IncX or DecX. The body may leave the loop with conditional jumps but makes
+     * no calls and has no other jumps.
+     */
+    void findLoops(){
+        for(int latch = 0; latch < MEMORY_SIZE; latch++){
+            int code = words[latch];
+            if(!reached[latch] || code < 20 || code > 22){
+                continue;
+            }
+            int header = words[latch + 1];
+            if(header < 0 || header > latch || !reached[header]){
+                continue;
+            }
+
+            int step = 0;
+            bool counted = false;
+            bool straight = true;
+            int a = header;
+            while(straight && a < latch){
+                const Opcode* op = findOpcode(words[a]);
+                if(!reached[a] || op->code == 20 || op->code == 23 || op->code == 24 || op->code == 29 ||
+                   op->code == 30 || op->code == 50){
+                    straight = false;
+                    break;
+                }
+                if(op->branch && words[a + 1] >= header && words[a + 1] <= latch + 1){
+                    straight = false;
+                }
+                if(op->code == 25 || op->code == 26){
+                    counted = true;
+                    step += op->code == 25 ? 1 : -1;
+                }
+                a += 1 + op->operands;
+            }
+            if(straight && a == latch && counted){
+                loops.push_back(Loop{header, latch, step, trips(header, latch)});
+            }
+        }
+    }
+
+    /*
+     * Function: trips
+     * ---------------
+     * Simulates a loop on the registers it starts with, known when the only block entering the
+     * header from outside the loop sets them from constants or unwritten data.
+     * Returns:
+     * How many times the header runs, or -1 if a jump depends on something unknown or the loop
+     * runs more than TRIP_LIMIT times.
+     */
+    long long trips(int header, int latch) const {
+        Registers registers = {{false, 0}, {false, 0}, {false, 0}};
+        const Block* entry = NULL;
+        int entering = 0;
+        for(size_t i = 0; i < blocks.size(); i++){
+            for(size_t e = 0; e < blocks[i].successors.size(); e++){
+                if(blocks[i].successors[e].target == header && (blocks[i].last < header || blocks[i].last > latch)){
+                    entry = &blocks[i];
+                    entering++;
+                }
+            }
+        }
+        if(entering == 1){
+            for(int a = entry->start; a <= entry->last; a += instructionWords(a)){
+                evaluate(a, registers);
+            }
+        }
+
+        for(long long count = 1; count <= TRIP_LIMIT; count++){
+            for(int a = header; ; a += instructionWords(a)){
+                int code = words[a];
+                if(code == 21 || code == 22){
+                    if(!registers.AC.known){
+                        return -1;
+                    }
+                    bool taken = (registers.AC.value == 0) == (code == 21);
+                    if(a == latch){
+                        if(!taken){
+                            return count;
+                        }
+                        break;
+                    }
+                    if(taken){
+                        return count;
+                    }
+                }
+                else if(a == latch){
+                    break;
+                }
+                else{
+                    evaluate(a, registers);
+                }
+            }
+        }
+        return -1;
+    }
+
+    /*
+     * Function: evaluate
+     * ------------------
+     * Applies the instruction at address to the known registers. Jumps are left to the caller.
+     */
+    void evaluate(int address, Registers& r) const {
+        int code = words[address];
+        int operand = address + 1 < MEMORY_SIZE ? words[address + 1] : 0;
+        switch(code){
+            case 1:  r.AC = Value{true, operand}; break;
+            case 2:  r.AC = load(true, operand); break;
+            case 3:  r.AC = load(true, operand); r.AC = r.AC.known ? load(true, r.AC.value) : r.AC; break;
+            case 4:  r.AC = load(r.X.known, operand + r.X.value); break;
+            case 5:  r.AC = load(r.Y.known, operand + r.Y.value); break;
+            case 10: r.AC = Value{r.AC.known && r.X.known, r.AC.value + r.X.value}; break;
+            case 11: r.AC = Value{r.AC.known && r.Y.known, r.AC.value + r.Y.value}; break;
+            case 12: r.AC = Value{r.AC.known && r.X.known, r.AC.value - r.X.value}; break;
+            case 13: r.AC = Value{r.AC.known && r.Y.known, r.AC.value - r.Y.value}; break;
+            case 14: r.X = r.AC; break;
+            case 15: r.AC = r.X; break;
+            case 16: r.Y = r.AC; break;
+            case 17: r.AC = r.Y; break;
+            case 25: r.X.value++; break;
+            case 26: r.X.value--; break;
+            case 7: case 9: case 18: case 20: case 21: case 22: case 27: break;
+            case 23: case 29:
+                //The callee or handler may change any register
+                r.X.known = false;
+                r.Y.known = false;
+                r.AC.known = false;
+                break;
+            default:
+                r.AC.known = false;
+                break;
+        }
+    }
+
+    //A word that is never written, if the address is known and in memory
+    Value load(bool known, int address) const {
+        if(!known || address < 0 || address >= MEMORY_SIZE || stored[address]){
+            return Value{false, 0};
+        }
+        return Value{true, words[address]};
+    }
+
+    /*
+     * Function: writeRanges
+     * ---------------------
+     * Writes the addresses whose flags equal value as a JSON list of [first, last] ranges.
+     */
+    template<class T>
+    static void writeRanges(ostream& out, const T* flags, T value){
+        out << "[";
+        bool first = true;
+        int a = 0;
+        while(a < MEMORY_SIZE){
+            if(flags[a] != value){
+                a++;
+                continue;
+            }
+            int start = a;
+            while(a < MEMORY_SIZE && flags[a] == value){
+                a++;
+            }
+            out << (first ? "" : ", ") << "[" << start << ", " << a - 1 << "]";
+            first = false;
+        }
+        out << "]";
+    }
+};
+
+#endif
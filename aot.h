@@ -0,0 +1,596 @@
+/*
+    Program: Computer Simulator
+    File:    aot.h
+    Author:  Stanton Brown
+
+    Desription:
+    Ahead-of-time translation of a loaded program into native code (the aot engine).
+    The user code reachable from address 0 is translated into C++ source in which every
+    instruction is a labeled region operating on local copies of the registers: straight-line
+    code falls through, jumps and calls with known targets are gotos, and Ret dispatches
+    through a switch on the return address. The source is compiled with the local compiler
+    into a shared object which is loaded with dlopen. Shared objects are cached by a hash of
+    the memory image and access map, so a program that is run over and over is compiled once.
+
+    Translated code only runs in user mode and hands control back to the interpreter (the
+    direct engine's CPU) at an instruction boundary whenever an instruction needs it:
+    - before a timer interrupt, and before the instruction that reaches the cycle limit
+    - before Int, IRet, End and invalid instructions
+    - before any access that the access map refuses, so the interpreter reports the fault
+    - at jumps and returns to code that was not translated
+    Every translated instruction counts a cycle and a timer tick exactly like the interpreter.
+
+    If the program stores into a translated word, whether from translated code or from the
+    interpreter, the translation is dropped and the rest of the run is interpreted. When the
+    static analysis (analysis.h) proves that no translated word can be written, stores are
+    translated without that check and the interpreter's writes are not looked at.
+*/
+
+#ifndef AOT_H
+#define AOT_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "memory.h"
+#include "isa.h"
+#include "analysis.h"
+#include "stream.h"
+
+using namespace std;
+
+
+//Bumped whenever the generated code changes, so stale cached objects are not loaded
+static const int AOT_VERSION = 3;
+
+//State shared with the generated code, which gets the same definition as text
+#define AOT_STATE_FIELDS \
+    int PC; int SP; int AC; int X; int Y; int timer; int timeConstraint; int interruptEnabled; \
+    long long cycles; long long cycleLimit; int* memory; const unsigned char* access; \
+    int codeModified; void (*put)(int port, int value); int (*get)(); \
+    void* input; int (*read)(void* input, int port, int value);
+#define AOT_STRING(x) #x
+#define AOT_EXPAND(x) AOT_STRING(x)
+
+/*
+ * AotState: Registers and memory handed to the generated code
+ * -----------------------------------------------------------
+ */
+struct AotState {
+    AOT_STATE_FIELDS
+};
+
+
+/*
+ * AotProgram: A program translated into a loaded shared object
+ * ------------------------------------------------------------
+ */
+class AotProgram {
+
+public:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    //Only user code is translated
+    static const int USER_END = AccessMap::USER_STACK_TOP;
+
+    //Registers are copied in and out of this around every run()
+    AotState state;
+
+private:
+    typedef void (*Entry)(AotState*);
+
+    Entry entry;
+    void* handle;
+
+    //Addresses of translated instructions, and every word they are made of
+    bool translated[MEMORY_SIZE];
+    bool code[MEMORY_SIZE];
+
+    //No translated word can be written, so stores need no check
+    bool immutable;
+
+public:
+
+    /*
+     * Constructor: AotProgram
+     * -----------------------
+     * Creates an empty translation; load() fills it in.
+     */
+    AotProgram() : entry(NULL), handle(NULL), immutable(false) {
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            translated[i] = false;
+            code[i] = false;
+        }
+        state.codeModified = 0;
+        state.put = put;
+        state.get = get;
+        state.input = NULL;
+        state.read = read;
+    }
+
+    ~AotProgram(){
+        if(handle != NULL){
+            dlclose(handle);
+        }
+    }
+
+    /*
+     * Function: load
+     * --------------
+     * Translates the program in memory, compiling it unless a cached object exists, and loads it.
+     * Parameters:
+     * - memory: the loaded program
+     * - access: the access map of the run, static addresses are checked at translation time
+     * - faultVector: the stack fault handler of the run, -1 for none
+     * Returns:
+     * false (after a warning) if the program could not be compiled or loaded,
+     * in which case the run is interpreted.
+     */
+    bool load(Memory& memory, const AccessMap& access, int faultVector){
+        const int* words = memory.words();
+        findCode(words);
+
+        ProgramAnalysis analysis(words, access, faultVector);
+        immutable = true;
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            immutable = immutable && !(code[i] && analysis.stored[i]);
+        }
+
+        //Name the object after everything the generated code depends on
+        uint64_t hash = 14695981039346656037ULL;
+        hashBytes(hash, &AOT_VERSION, sizeof(AOT_VERSION));
+        hashBytes(hash, words, MEMORY_SIZE * sizeof(int));
+        hashBytes(hash, access.table(), MEMORY_SIZE + 1);
+        hashBytes(hash, &immutable, sizeof(immutable));
+        char name[32];
+        snprintf(name, sizeof(name), "aot-%016llx", (unsigned long long)hash);
+
+        string dir;
+        if(!cacheDirectory(dir)){
+            return false;
+        }
+        string base = dir + "/" + name;
+        string object = base + ".so";
+
+        if(::access(object.c_str(), R_OK) != 0 && !compile(base, words, access)){
+            return false;
+        }
+
+        handle = dlopen(object.c_str(), RTLD_NOW | RTLD_LOCAL);
+        entry = handle != NULL ? (Entry)dlsym(handle, "csim_run") : NULL;
+        if(entry == NULL){
+            cerr << "WARNING: Unable to load translated program " << object << ", interpreting" << endl;
+            return false;
+        }
+
+        state.memory = memory.words();
+        state.access = access.table();
+        return true;
+    }
+
+    /*
+     * Function: run
+     * -------------
+     * Runs translated code from state.PC until it hands back to the interpreter.
+     */
+    void run(){
+        entry(&state);
+    }
+
+    /*
+     * Function: valid
+     * ---------------
+     * Returns:
+     * false once the program has stored into its own translated code.
+     */
+    bool valid() const {
+        return state.codeModified == 0;
+    }
+
+    /*
+     * Function: written
+     * -----------------
+     * Called by the interpreter after it writes memory, to notice stores into translated code.
+     * Parameters:
+     * - address: the address written
+     */
+    void written(int address){
+        if(!immutable && (unsigned)address < (unsigned)MEMORY_SIZE && code[address]){
+            state.codeModified = 1;
+        }
+    }
+
+private:
+
+    /*
+     * Function: put
+     * -------------
+     * Put port, called by the generated code. Same output as the interpreter's instruction 9.
+     */
+    static void put(int port, int value){
+        if(port == 1){
+            cout << value;
+        }
+        else if(port == 2){
+            cout << char(value);
+        }
+        else{
+            cerr << "Invalid operand for instruction 9.." << endl;
+        }
+    }
+
+    /*
+     * Function: get
+     * -------------
+     * Get, called by the generated code so it shares the interpreter's random sequence.
+     */
+    static int get(){
+        return rand() % 100 + 1;
+    }
+
+    /*
+     * Function: read
+     * --------------
+     * Read port, called by the generated code with the CPU's input stream. Returns the new AC.
+     */
+    static int read(void* input, int port, int value){
+        if(!((InputStream*)input)->read(port, value)){
+            cerr << "Invalid operand for instruction 31.." << endl;
+        }
+        return value;
+    }
+
+    static void hashBytes(uint64_t& hash, const void* data, size_t size){
+        const unsigned char* bytes = (const unsigned char*)data;
+        for(size_t i = 0; i < size; i++){
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    }
+
+    /*
+     * Function: translatable
+     * ----------------------
+     * Returns:
+     * true for the instructions that run in translated code; the others are left to the interpreter.
+     */
+    static bool translatable(int opcode){
+        return (opcode >= 1 && opcode <= 28) || opcode == 31;
+    }
+
+    /*
+     * Function: findCode
+     * ------------------
+     * Follows the control flow from address 0 to find the user code to translate.
+     * Calls continue at their return address, and Int at the next instruction.
+     * Parameters:
+     * - words: the memory image
+     */
+    void findCode(const int* words){
+        bool seen[MEMORY_SIZE] = {};
+        int pending[MEMORY_SIZE];
+        int count = 0;
+        pending[count++] = 0;
+        seen[0] = true;
+
+        while(count > 0){
+            int address = pending[--count];
+            int opcode = words[address];
+            int operand = address + 1 < MEMORY_SIZE ? words[address + 1] : 0;
+            int next = address + (hasOperand(opcode) ? 2 : 1);
+            int successors[2];
+            int successorCount = 0;
+
+            if(translatable(opcode) && (!hasOperand(opcode) || address + 1 < MEMORY_SIZE)){
+                translated[address] = true;
+                code[address] = true;
+                if(hasOperand(opcode)){
+                    code[address + 1] = true;
+                }
+                if(findOpcode(opcode)->branch && hasOperand(opcode)){
+                    successors[successorCount++] = operand;
+                }
+                if(opcode != 20 && opcode != 24){
+                    successors[successorCount++] = next;
+                }
+            }
+            else if(opcode == 29){
+                successors[successorCount++] = next;
+            }
+
+            for(int i = 0; i < successorCount; i++){
+                int target = successors[i];
+                if(target >= 0 && target < USER_END && !seen[target]){
+                    seen[target] = true;
+                    pending[count++] = target;
+                }
+            }
+        }
+    }
+
+    /*
+     * Function: go
+     * ------------
+     * Returns:
+     * The statement continuing at an address: a goto if it is translated, otherwise an exit.
+     */
+    string go(int address) const {
+        if(address >= 0 && address < MEMORY_SIZE && translated[address]){
+            return "goto L" + to_string(address) + ";";
+        }
+        return "EXIT(" + to_string(address) + ")";
+    }
+
+    /*
+     * Function: generate
+     * ------------------
+     * Writes the C++ source of the translated program.
+     * Parameters:
+     * - out: receives the source
+     * - words: the memory image
+     * - access: the access map
+     */
+    void generate(ostream& out, const int* words, const AccessMap& access) const {
+        const unsigned char* bits = access.table();
+
+        out << "//Generated by the simulator's AOT translator (aot.h), do not edit\n"
+            << "struct AotState { " AOT_EXPAND(AOT_STATE_FIELDS) " };\n\n"
+            << "#define SIZE " << MEMORY_SIZE << "u\n"
+            << "#define DATA(x) (access[(unsigned)(x) < SIZE ? (unsigned)(x) : SIZE] & 1)\n"
+            << "#define STACK(x) (access[(unsigned)(x) < SIZE ? (unsigned)(x) : SIZE] & 4)\n"
+            << "#define EXIT(a) { s->PC = (a); s->SP = SP; s->AC = AC; s->X = X; s->Y = Y; "
+               "s->timer = timer; s->cycles = cycles; return; }\n"
+            << "#define BEGIN(a) L##a: if(cycles + 1 == cycleLimit || (interruptEnabled && "
+               "timer >= timeConstraint)) EXIT(a)\n"
+            << "#define COMMIT cycles++; timer++;\n";
+
+        if(immutable){
+            out << "#define STORE(x, v, next) { m[x] = (v); }\n\n";
+        }
+        else{
+            out << "#define STORE(x, v, next) { m[x] = (v); if(CODE[x]) { s->codeModified = 1; EXIT(next) } }\n\n";
+            out << "static const unsigned char CODE[SIZE] = {";
+            for(int i = 0; i < MEMORY_SIZE; i++){
+                out << (i % 40 == 0 ? "\n    " : "") << (code[i] ? 1 : 0) << ",";
+            }
+            out << "\n};\n\n";
+        }
+
+        out << "extern \"C\" void csim_run(AotState* s){\n"
+            << "    int* m = s->memory;\n"
+            << "    const unsigned char* access = s->access;\n"
+            << "    int SP = s->SP, AC = s->AC, X = s->X, Y = s->Y, timer = s->timer;\n"
+            << "    long long cycles = s->cycles;\n"
+            << "    const long long cycleLimit = s->cycleLimit;\n"
+            << "    const int timeConstraint = s->timeConstraint, interruptEnabled = s->interruptEnabled;\n"
+            << "    int pc = s->PC, t;\n\n"
+            << "dispatch:\n"
+            << "    switch(pc){\n";
+        for(int i = 0; i < USER_END; i++){
+            if(translated[i]){
+                out << "        case " << i << ": goto L" << i << ";\n";
+            }
+        }
+        out << "        default: EXIT(pc)\n"
+            << "    }\n\n";
+
+        for(int a = 0; a < USER_END; a++){
+            if(!translated[a]){
+                continue;
+            }
+            int opcode = words[a];
+            int v = a + 1 < MEMORY_SIZE ? words[a + 1] : 0;
+            string here = to_string(a);
+            string value = to_string(v);
+            string next = go(a + (hasOperand(opcode) ? 2 : 1));
+            string after = to_string(a + (hasOperand(opcode) ? 2 : 1));
+            bool staticData = (unsigned)v < (unsigned)MEMORY_SIZE && (bits[v] & AccessMap::USER_DATA);
+
+            out << "BEGIN(" << a << ")\n    ";
+            switch(opcode){
+                case 1:  out << "COMMIT AC = " << value << "; " << next; break;
+                case 2:
+                    if(!staticData){ out << "EXIT(" << here << ")"; break; }
+                    out << "COMMIT AC = m[" << value << "]; " << next;
+                    break;
+                case 3:
+                    if(!staticData){ out << "EXIT(" << here << ")"; break; }
+                    out << "t = m[" << value << "]; if(!DATA(t)) EXIT(" << here << ") COMMIT AC = m[t]; " << next;
+                    break;
+                case 4:
+                case 5:
+                case 6:
+                    out << "t = " << (opcode == 6 ? "SP + X" : value + (opcode == 4 ? " + X" : " + Y"))
+                        << "; if(!DATA(t)) EXIT(" << here << ") COMMIT AC = m[t]; " << next;
+                    break;
+                case 7:
+                    if(!staticData){ out << "EXIT(" << here << ")"; break; }
+                    out << "COMMIT STORE(" << value << ", AC, " << after << ") " << next;
+                    break;
+                case 8:  out << "COMMIT AC = s->get(); " << next; break;
+                case 9:  out << "COMMIT s->put(" << value << ", AC); " << next; break;
+                case 10: out << "COMMIT AC += X; " << next; break;
+                case 11: out << "COMMIT AC += Y; " << next; break;
+                case 12: out << "COMMIT AC -= X; " << next; break;
+                case 13: out << "COMMIT AC -= Y; " << next; break;
+                case 14: out << "COMMIT X = AC; " << next; break;
+                case 15: out << "COMMIT AC = X; " << next; break;
+                case 16: out << "COMMIT Y = AC; " << next; break;
+                case 17: out << "COMMIT AC = Y; " << next; break;
+                case 18: out << "COMMIT SP = AC; " << next; break;
+                case 19: out << "COMMIT AC = SP; " << next; break;
+                case 20: out << "COMMIT " << go(v); break;
+                case 21: out << "COMMIT if(AC == 0) " << go(v) << " " << next; break;
+                case 22: out << "COMMIT if(AC != 0) " << go(v) << " " << next; break;
+                case 23:
+                    out << "if(!STACK(SP - 1)) EXIT(" << here << ") COMMIT SP--; STORE(SP, " << a + 1 << ", "
+                        << value << ") " << go(v);
+                    break;
+                case 24: out << "if(!STACK(SP)) EXIT(" << here << ") COMMIT pc = m[SP] + 1; SP++; goto dispatch;"; break;
+                case 25: out << "COMMIT X++; " << next; break;
+                case 26: out << "COMMIT X--; " << next; break;
+                case 27: out << "if(!STACK(SP - 1)) EXIT(" << here << ") COMMIT SP--; STORE(SP, AC, " << after << ") " << next; break;
+                case 28: out << "if(!STACK(SP)) EXIT(" << here << ") COMMIT AC = m[SP]; SP++; " << next; break;
+                case 31: out << "COMMIT AC = s->read(s->input, " << value << ", AC); " << next; break;
+            }
+            out << "\n";
+        }
+        out << "}\n";
+    }
+
+    /*
+     * Function: cacheDirectory
+     * ------------------------
+     * Finds the directory compiled objects are cached in, creating it if needed:
+     * $CSIM_AOT_CACHE, else $XDG_CACHE_HOME/csim-aot, else ~/.cache/csim-aot.
+     * Objects in it are loaded into the process, so it is only used when it is a real
+     * directory (not a symlink) owned by the user that nobody else can write to.
+     * Parameters:
+     * - dir: receives the directory
+     * Returns:
+     * false (after a warning) if there is no safe directory to use.
+     */
+    static bool cacheDirectory(string& dir){
+        const char* cache = getenv("CSIM_AOT_CACHE");
+        const char* xdg = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        if(cache != NULL && cache[0] != '\0'){
+            dir = cache;
+        }
+        else if(xdg != NULL && xdg[0] == '/'){
+            dir = string(xdg) + "/csim-aot";
+        }
+        else if(home != NULL && home[0] == '/'){
+            //~/.cache may not exist yet, it is created private like the directory itself
+            mkdir((string(home) + "/.cache").c_str(), 0700);
+            dir = string(home) + "/.cache/csim-aot";
+        }
+        else{
+            cerr << "WARNING: No cache directory for translated programs (set CSIM_AOT_CACHE), interpreting" << endl;
+            return false;
+        }
+
+        if(mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST){
+            cerr << "WARNING: Unable to create " << dir << ": " << strerror(errno) << ", interpreting" << endl;
+            return false;
+        }
+        struct stat info;
+        if(lstat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid() ||
+           (info.st_mode & 077) != 0){
+            cerr << "WARNING: " << dir << " is not a directory private to this user (mode 0700), "
+                 << "not using it to cache translated programs; interpreting" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Function: runCompiler
+     * ---------------------
+     * Runs the compiler without a shell, so paths are passed through unchanged.
+     * Parameters:
+     * - arguments: the command line, arguments[0] is looked up in $PATH
+     * - log: file that receives the compiler's standard error
+     * Returns:
+     * true if the compiler ran and exited with status 0.
+     */
+    static bool runCompiler(const vector<string>& arguments, const string& log){
+        vector<char*> argv;
+        for(const string& argument : arguments){
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        }
+        argv.push_back(NULL);
+
+        pid_t pid = fork();
+        if(pid == -1){
+            return false;
+        }
+        if(pid == 0){
+            int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+            if(fd != -1){
+                dup2(fd, STDERR_FILENO);
+            }
+            execvp(argv[0], argv.data());
+            dprintf(STDERR_FILENO, "unable to run %s: %s\n", argv[0], strerror(errno));
+            _exit(127);
+        }
+
+        int status;
+        while(waitpid(pid, &status, 0) == -1){
+            if(errno != EINTR){
+                return false;
+            }
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    /*
+     * Function: compile
+     * -----------------
+     * Generates base.cpp and compiles it into base.so with the compiler named by $CXX (c++ by default).
+     * $CXX may hold extra words, such as "ccache g++", which become separate arguments.
+     * The source, object and log are written under temporary names and renamed, so concurrent runs
+     * of one image never overwrite each other's files or load a partial one.
+     * Parameters:
+     * - base: path of the files without extension
+     * - words: the memory image
+     * - access: the access map
+     * Returns:
+     * false (after a warning) if compilation failed.
+     */
+    bool compile(const string& base, const int* words, const AccessMap& access) const {
+        string unique = base + "." + to_string(getpid());
+        string source = unique + ".cpp";
+        string temporary = unique + ".tmp";
+        string log = unique + ".log";
+        {
+            ofstream out(source, ios::trunc);
+            generate(out, words, access);
+            if(!out){
+                cerr << "WARNING: Unable to write " << source << ", interpreting" << endl;
+                unlink(source.c_str());
+                return false;
+            }
+        }
+
+        vector<string> arguments;
+        istringstream compiler(getenv("CXX") != NULL ? getenv("CXX") : "");
+        string word;
+        while(compiler >> word){
+            arguments.push_back(word);
+        }
+        if(arguments.empty()){
+            arguments.push_back("c++");
+        }
+        for(const char* option : {"-O2", "-shared", "-fPIC", "-o"}){
+            arguments.push_back(option);
+        }
+        arguments.push_back(temporary);
+        arguments.push_back(source);
+
+        bool compiled = runCompiler(arguments, log);
+        rename(log.c_str(), (base + ".log").c_str());
+        if(!compiled || rename(temporary.c_str(), (base + ".so").c_str()) != 0){
+            cerr << "WARNING: Unable to compile the translated program, see " << base << ".log; interpreting" << endl;
+            unlink(temporary.c_str());
+            unlink(source.c_str());
+            return false;
+        }
+        rename(source.c_str(), (base + ".cpp").c_str());
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,981 @@
+/*
+    Program: Computer Simulator
+    File:    assembler.cpp
+    Author:  Stanton Brown
+
+    Desription:
+    Symbolic assembler for the simulator's instruction set.
+    Translates mnemonics from the instruction set table (isa.h), labels, data directives and .org sections
+    into either the text program format read by Memory or a binary image (see image.h)
+    that Memory copies directly into its array.
+
+    The whole source file is read into one buffer and assembled in a single pass.
+    Label definitions and references are queued during the pass and resolved together
+    once it completes, so labels may be used before they are defined. Only directives
+    that need a value immediately (.org, .space, .equ, subtraction) look labels up early.
+
+    Source syntax:
+    - label:               defines label as the current address (may share a line with an instruction)
+    - Mnemonic [operand]   one instruction, e.g. "LoadIdxX table" or "Put 2"
+    - .org addr            continue assembling at addr (".1000" is also accepted)
+    - .word v, v, ...      emit data words
+    - .space n             emit n zero words
+    - .ascii "text"        emit one word per character
+    - .asciz "text"        same as .ascii followed by a 0 word
+    - .equ name, value     define a constant
+    - // or ; comments run to the end of the line
+
+    Operands are decimal or 0x hex integers, character literals ('A', '\n'), labels,
+    or sums/differences of those (table+1, end-start).
+    Opcode 1 is written "Load value" and opcode 2 "LoadAddr addr".
+
+    Usage:
+    ./assembler [-b] [-o output_file] [-s memory_size] input_file
+
+    - -b:            write a binary image instead of the text format.
+    - -o:            output file, standard output if omitted.
+    - -s:            size of the address space, 2000 (the size of Memory) by default.
+    - input_file:    the assembly source to translate.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <charconv>
+
+#include "image.h"
+#include "isa.h"
+
+using namespace std;
+
+
+/*
+ * SymbolTable: Labels and constants by name
+ * -----------------------------------------
+ * Open addressing hash table keyed on views into the source buffer.
+ * Generated programs define a label on nearly every line, so entries are kept
+ * in one flat array instead of individually allocated nodes. A table for a million
+ * labels is far larger than the cache and nearly every access misses, so callers
+ * with many names to process hash them first and prefetch() slots a few names ahead.
+ */
+class SymbolTable {
+
+private:
+    struct Entry {
+        string_view name;   //empty for an unused slot
+        int value;
+        uint32_t hash;      //saves rehashing names when the table grows
+    };
+
+    vector<Entry> entries;
+    size_t count;
+
+    /*
+     * Function: slot
+     * --------------
+     * Finds the slot holding name, or the empty slot where it belongs.
+     * Parameters:
+     * - name: the symbol to look for
+     * - hash: hashName(name)
+     * Returns:
+     * Index of that slot.
+     */
+    size_t slot(string_view name, uint32_t hash) const {
+        size_t mask = entries.size() - 1;
+        size_t i = hash & mask;
+        while(!entries[i].name.empty() && (entries[i].hash != hash || entries[i].name != name)){
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    /*
+     * Function: rehash
+     * ----------------
+     * Resizes the table and re-inserts every entry.
+     * Parameters:
+     * - size: the new number of slots, a power of two
+     */
+    void rehash(size_t size){
+        vector<Entry> old(size, Entry{string_view(), 0, 0});
+        old.swap(entries);
+        for(const Entry& entry : old){
+            if(!entry.name.empty()){
+                entries[slot(entry.name, entry.hash)] = entry;
+            }
+        }
+    }
+
+public:
+
+    SymbolTable() : entries(1024, Entry{string_view(), 0, 0}), count(0) {}
+
+    /*
+     * Function: hashName
+     * ------------------
+     * FNV-1a hash of a symbol name.
+     */
+    static uint32_t hashName(string_view name){
+        uint32_t hash = 2166136261u;
+        for(char c : name){
+            hash = (hash ^ (unsigned char)c) * 16777619u;
+        }
+        return hash;
+    }
+
+    /*
+     * Function: reserve
+     * -----------------
+     * Sizes the table up front so it does not grow while names are being prefetched.
+     * Parameters:
+     * - expected: number of symbols the table will hold
+     */
+    void reserve(size_t expected){
+        size_t size = entries.size();
+        while(size < expected * 2){
+            size *= 2;
+        }
+        if(size > entries.size()){
+            rehash(size);
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    /*
+     * Function: prefetch
+     * ------------------
+     * Starts loading the slot a name hashes to, ahead of inserting or finding it.
+     * The table must not grow in between for the prefetch to be of use.
+     * Parameters:
+     * - hash: hashName() of the name
+     */
+    void prefetch(uint32_t hash) const {
+        __builtin_prefetch(&entries[hash & (entries.size() - 1)]);
+    }
+
+    /*
+     * Function: insert
+     * ----------------
+     * Adds a symbol unless it is already defined.
+     * Parameters:
+     * - name: the symbol
+     * - hash: hashName(name)
+     * - value: its address or constant
+     * Returns:
+     * false if the symbol was already defined.
+     */
+    bool insert(string_view name, uint32_t hash, int value){
+        //Keep the table at most half full so probe sequences stay short
+        if((count + 1) * 2 > entries.size()){
+            rehash(entries.size() * 2);
+        }
+        size_t i = slot(name, hash);
+        if(!entries[i].name.empty()){
+            return false;
+        }
+        entries[i] = Entry{name, value, hash};
+        count++;
+        return true;
+    }
+
+    /*
+     * Function: find
+     * --------------
+     * Looks up a symbol.
+     * Parameters:
+     * - name: the symbol
+     * - hash: hashName(name)
+     * - value: receives its value when found
+     * Returns:
+     * true if the symbol is defined.
+     */
+    bool find(string_view name, uint32_t hash, int& value) const {
+        const Entry& entry = entries[slot(name, hash)];
+        if(entry.name.empty()){
+            return false;
+        }
+        value = entry.value;
+        return true;
+    }
+};
+
+
+/*
+ * Assembler: Translates assembly source into a memory image
+ * ---------------------------------------------------------
+ * Holds the image being built, the symbol table and the unresolved label references.
+ * Errors are reported with their line number and counted; output is only written
+ * when the source assembled without errors.
+ */
+class Assembler {
+
+private:
+    //Stop reporting after this many errors
+    static const int MAX_ERRORS = 20;
+
+    //How many names ahead resolveLabels() prefetches symbol table slots
+    static const size_t PREFETCH_DISTANCE = 16;
+
+    /*
+     * Operand: Value of an operand expression
+     * ---------------------------------------
+     * A constant plus at most one label that may not be defined yet.
+     */
+    struct Operand {
+        string_view symbol;     //empty when the value is a plain constant
+        int constant;
+    };
+
+    /*
+     * Definition: A label or constant waiting to be added to the symbol table
+     */
+    struct Definition {
+        string_view name;
+        int value;
+        int line;
+        uint32_t hash;      //filled in by resolveLabels()
+    };
+
+    /*
+     * Fixup: A word that refers to a label, patched once the label is known
+     */
+    struct Fixup {
+        int address;
+        string_view symbol;
+        int constant;
+        int line;
+        uint32_t hash;      //filled in by resolveLabels()
+    };
+
+    //Source buffer, every string_view below points into it
+    string source;
+    const char* fileName;
+
+    //Memory image and which addresses of it were assembled
+    vector<int> image;
+    vector<unsigned char> used;
+    int highestAddress;
+
+    //Labels and constants, those not added to the table yet, and references waiting for their label
+    SymbolTable symbols;
+    vector<Definition> definitions;
+    vector<Fixup> fixups;
+
+    //Lower case mnemonic -> instruction set entry (isa.h)
+    unordered_map<string, const Opcode*> mnemonics;
+
+    //Current position
+    int address;
+    int lineNumber;
+    int errors;
+
+public:
+
+    /*
+     * Constructor: Assembler
+     * ----------------------
+     * Initializes an empty image for the given address space.
+     * Parameters:
+     * - memorySize: number of addressable words
+     */
+    Assembler(int memorySize) : fileName(""), image(memorySize, 0), used(memorySize, 0),
+    highestAddress(-1), address(0), lineNumber(0), errors(0) {
+        for(const Opcode& m : OPCODES){
+            string key(m.name);
+            for(char& c : key){
+                c = tolower((unsigned char)c);
+            }
+            mnemonics[key] = &m;
+        }
+    }
+
+    /*
+     * Function: assemble
+     * ------------------
+     * Reads and assembles the source file, then resolves forward references.
+     * Parameters:
+     * - inputFile: the assembly source file
+     * Returns:
+     * true if the source assembled without errors.
+     */
+    bool assemble(const char* inputFile){
+        fileName = inputFile;
+
+        //Read the entire source at once, it is scanned in place
+        FILE* file = fopen(inputFile, "rb");
+        if(file == NULL){
+            cerr << "ERROR: unable to open the input file" << endl;
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        source.resize(length > 0 ? length : 0);
+        if(length > 0 && fread(&source[0], 1, length, file) != (size_t)length){
+            cerr << "ERROR: unable to read the input file" << endl;
+            fclose(file);
+            return false;
+        }
+        fclose(file);
+
+        //Assemble line by line
+        size_t position = 0;
+        while(position < source.size() && errors < MAX_ERRORS){
+            size_t end = source.find('\n', position);
+            if(end == string::npos){
+                end = source.size();
+            }
+            lineNumber++;
+            assembleLine(string_view(source.data() + position, end - position));
+            position = end + 1;
+        }
+
+        //Patch every reference to a label
+        addDefinitions();
+        for(Fixup& fixup : fixups){
+            fixup.hash = SymbolTable::hashName(fixup.symbol);
+        }
+        for(size_t i = 0; i < fixups.size() && errors < MAX_ERRORS; i++){
+            if(i + PREFETCH_DISTANCE < fixups.size()){
+                symbols.prefetch(fixups[i + PREFETCH_DISTANCE].hash);
+            }
+            const Fixup& fixup = fixups[i];
+            int value;
+            if(!symbols.find(fixup.symbol, fixup.hash, value)){
+                lineNumber = fixup.line;
+                error("undefined label '" + string(fixup.symbol) + "'");
+                continue;
+            }
+            image[fixup.address] = value + fixup.constant;
+        }
+
+        return errors == 0;
+    }
+
+    /*
+     * Function: writeText
+     * -------------------
+     * Writes the image in the text program format: one word per line,
+     * with a ".address" line in front of every contiguous section.
+     * Parameters:
+     * - output: the file to write to
+     */
+    void writeText(FILE* output) const {
+        string buffer;
+        buffer.reserve(1 << 16);
+        char number[16];
+        int next = 0;
+
+        for(int i = 0; i <= highestAddress; i++){
+            if(!used[i]){
+                continue;
+            }
+
+            //Start a new section when addresses were skipped
+            if(i != next){
+                buffer += '.';
+                buffer.append(number, to_chars(number, number + sizeof(number), i).ptr);
+                buffer += '\n';
+            }
+            buffer.append(number, to_chars(number, number + sizeof(number), image[i]).ptr);
+            buffer += '\n';
+            next = i + 1;
+
+            if(buffer.size() >= (1 << 16) - 32){
+                fwrite(buffer.data(), 1, buffer.size(), output);
+                buffer.clear();
+            }
+        }
+        fwrite(buffer.data(), 1, buffer.size(), output);
+    }
+
+    /*
+     * Function: writeBinary
+     * ---------------------
+     * Writes the image as a binary memory image covering addresses 0 .. highest assembled address.
+     * Parameters:
+     * - output: the file to write to
+     */
+    void writeBinary(FILE* output) const {
+        ImageHeader header;
+        memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        header.version = IMAGE_VERSION;
+        header.words = highestAddress + 1;
+        fwrite(&header, sizeof(header), 1, output);
+        fwrite(image.data(), sizeof(int), header.words, output);
+    }
+
+private:
+
+    /*
+     * Function: error
+     * ---------------
+     * Reports an error at the current line.
+     * Parameters:
+     * - message: description of the error
+     */
+    void error(const string& message){
+        cerr << fileName << ":" << lineNumber << ": error: " << message << endl;
+        errors++;
+    }
+
+    /*
+     * Function: emit
+     * --------------
+     * Places one word at the current address and advances it.
+     * Parameters:
+     * - value: the word to place
+     */
+    void emit(int value){
+        if(address < 0 || address >= (int)image.size()){
+            error("address " + to_string(address) + " is outside of memory");
+            address++;
+            return;
+        }
+        if(used[address]){
+            error("address " + to_string(address) + " is assembled twice");
+        }
+        image[address] = value;
+        used[address] = 1;
+        if(address > highestAddress){
+            highestAddress = address;
+        }
+        address++;
+    }
+
+    /*
+     * Function: emitOperand
+     * ---------------------
+     * Places an operand word, recording a fixup when it refers to a label.
+     * Parameters:
+     * - operand: the operand to place
+     */
+    void emitOperand(const Operand& operand){
+        if(operand.symbol.empty()){
+            emit(operand.constant);
+            return;
+        }
+        if(address >= 0 && address < (int)image.size()){
+            fixups.push_back({address, operand.symbol, operand.constant, lineNumber, 0});
+        }
+        emit(0);
+    }
+
+    /*
+     * Function: define
+     * ----------------
+     * Queues a label or constant for the symbol table.
+     * Parameters:
+     * - name: the symbol
+     * - value: the address or constant it stands for
+     */
+    void define(string_view name, int value){
+        definitions.push_back({name, value, lineNumber, 0});
+    }
+
+    /*
+     * Function: addDefinitions
+     * ------------------------
+     * Adds the queued definitions to the symbol table, reporting names defined twice.
+     * The table is sized once for all of them and each slot is prefetched ahead of its insert.
+     */
+    void addDefinitions(){
+        if(definitions.empty()){
+            return;
+        }
+        for(Definition& definition : definitions){
+            definition.hash = SymbolTable::hashName(definition.name);
+        }
+        symbols.reserve(symbols.size() + definitions.size());
+
+        int current = lineNumber;
+        for(size_t i = 0; i < definitions.size(); i++){
+            if(i + PREFETCH_DISTANCE < definitions.size()){
+                symbols.prefetch(definitions[i + PREFETCH_DISTANCE].hash);
+            }
+            const Definition& definition = definitions[i];
+            if(!symbols.insert(definition.name, definition.hash, definition.value) && errors < MAX_ERRORS){
+                lineNumber = definition.line;
+                error("'" + string(definition.name) + "' is defined twice");
+            }
+        }
+        lineNumber = current;
+        definitions.clear();
+    }
+
+    /*
+     * Function: lookup
+     * ----------------
+     * Folds the label of an operand into its constant, for values that are needed right away.
+     * Parameters:
+     * - operand: the operand to resolve
+     * Returns:
+     * false if the operand refers to a label that is not defined yet.
+     */
+    bool lookup(Operand& operand){
+        if(operand.symbol.empty()){
+            return true;
+        }
+        addDefinitions();
+        int value;
+        if(!symbols.find(operand.symbol, SymbolTable::hashName(operand.symbol), value)){
+            return false;
+        }
+        operand.constant += value;
+        operand.symbol = string_view();
+        return true;
+    }
+
+    static bool isIdentifierStart(char c){
+        return isalpha((unsigned char)c) || c == '_';
+    }
+
+    static bool isIdentifier(char c){
+        return isalnum((unsigned char)c) || c == '_' || c == '.';
+    }
+
+    static void skipSpace(string_view& text){
+        size_t i = 0;
+        while(i < text.size() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == ',')){
+            i++;
+        }
+        text.remove_prefix(i);
+    }
+
+    static string_view takeIdentifier(string_view& text){
+        size_t i = 0;
+        while(i < text.size() && isIdentifier(text[i])){
+            i++;
+        }
+        string_view name = text.substr(0, i);
+        text.remove_prefix(i);
+        return name;
+    }
+
+    /*
+     * Function: parseCharacter
+     * ------------------------
+     * Reads one (possibly escaped) character of a character or string literal.
+     * Parameters:
+     * - text: the remaining line, advanced past the character
+     * - value: receives the character
+     * Returns:
+     * false if the line ended.
+     */
+    bool parseCharacter(string_view& text, int& value){
+        if(text.empty()){
+            return false;
+        }
+        if(text[0] != '\\' || text.size() < 2){
+            value = (unsigned char)text[0];
+            text.remove_prefix(1);
+            return true;
+        }
+        switch(text[1]){
+            case 'n':  value = '\n'; break;
+            case 't':  value = '\t'; break;
+            case 'r':  value = '\r'; break;
+            case '0':  value = 0;    break;
+            default:   value = (unsigned char)text[1]; break;
+        }
+        text.remove_prefix(2);
+        return true;
+    }
+
+    /*
+     * Function: parseTerm
+     * -------------------
+     * Reads a number, character literal or label.
+     * Parameters:
+     * - text: the remaining line, advanced past the term
+     * - operand: receives the term
+     * Returns:
+     * false if no term could be read.
+     */
+    bool parseTerm(string_view& text, Operand& operand){
+        operand = {string_view(), 0};
+        if(text.empty()){
+            error("expected a number or label");
+            return false;
+        }
+
+        //Character literal
+        if(text[0] == '\''){
+            text.remove_prefix(1);
+            if(!parseCharacter(text, operand.constant) || text.empty() || text[0] != '\''){
+                error("bad character literal");
+                return false;
+            }
+            text.remove_prefix(1);
+            return true;
+        }
+
+        //Label
+        if(isIdentifierStart(text[0])){
+            operand.symbol = takeIdentifier(text);
+            return true;
+        }
+
+        //Decimal or hexadecimal number
+        bool negative = false;
+        if(text[0] == '-' || text[0] == '+'){
+            negative = text[0] == '-';
+            text.remove_prefix(1);
+        }
+        int base = 10;
+        if(text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')){
+            base = 16;
+            text.remove_prefix(2);
+        }
+        long long value;
+        auto result = from_chars(text.data(), text.data() + text.size(), value, base);
+        if(result.ec != errc() || value > 0xFFFFFFFFLL){
+            error("expected a number or label");
+            return false;
+        }
+        text.remove_prefix(result.ptr - text.data());
+        operand.constant = (int)(negative ? -value : value);
+        return true;
+    }
+
+    /*
+     * Function: parseOperand
+     * ----------------------
+     * Reads an operand expression: terms joined with + and -.
+     * One added label is left for the end of the pass; further labels must already be defined.
+     * Parameters:
+     * - text: the remaining line, advanced past the expression
+     * - operand: receives the value
+     * Returns:
+     * false if the expression is malformed.
+     */
+    bool parseOperand(string_view& text, Operand& operand){
+        skipSpace(text);
+        if(!parseTerm(text, operand)){
+            return false;
+        }
+        while(true){
+            skipSpace(text);
+            if(text.empty() || (text[0] != '+' && text[0] != '-')){
+                return true;
+            }
+            bool subtract = text[0] == '-';
+            text.remove_prefix(1);
+            skipSpace(text);
+            Operand term;
+            if(!parseTerm(text, term)){
+                return false;
+            }
+            if(subtract){
+                if(!lookup(term)){
+                    error("label '" + string(term.symbol) + "' must be defined before it is subtracted");
+                    return false;
+                }
+                operand.constant -= term.constant;
+                continue;
+            }
+            if(!term.symbol.empty() && !operand.symbol.empty() && !lookup(operand) && !lookup(term)){
+                error("expression refers to more than one undefined label");
+                return false;
+            }
+            if(!term.symbol.empty()){
+                operand.symbol = term.symbol;
+            }
+            operand.constant += term.constant;
+        }
+    }
+
+    /*
+     * Function: parseString
+     * ---------------------
+     * Emits one word per character of a quoted string.
+     * Parameters:
+     * - text: the remaining line starting at the opening quote
+     * Returns:
+     * false if the string is not properly quoted.
+     */
+    bool parseString(string_view& text){
+        skipSpace(text);
+        if(text.empty() || text[0] != '"'){
+            error("expected a quoted string");
+            return false;
+        }
+        text.remove_prefix(1);
+        while(!text.empty() && text[0] != '"'){
+            int value;
+            parseCharacter(text, value);
+            emit(value);
+        }
+        if(text.empty()){
+            error("unterminated string");
+            return false;
+        }
+        text.remove_prefix(1);
+        return true;
+    }
+
+    /*
+     * Function: assembleDirective
+     * ---------------------------
+     * Handles a line starting with '.'.
+     * Parameters:
+     * - text: the line after the '.'
+     */
+    void assembleDirective(string_view text){
+        //".1000" form used by the text program format
+        if(!text.empty() && isdigit((unsigned char)text[0])){
+            Operand target;
+            if(parseOperand(text, target)){
+                if(!lookup(target)){
+                    error("section address must be known at this point");
+                    return;
+                }
+                address = target.constant;
+            }
+            expectEnd(text);
+            return;
+        }
+
+        string_view name = takeIdentifier(text);
+        Operand operand;
+
+        if(name == "org"){
+            if(parseOperand(text, operand)){
+                if(!lookup(operand)){
+                    error(".org needs an address known at this point");
+                    return;
+                }
+                address = operand.constant;
+            }
+        }
+        else if(name == "word"){
+            skipSpace(text);
+            while(!text.empty() && parseOperand(text, operand)){
+                emitOperand(operand);
+                skipSpace(text);
+            }
+        }
+        else if(name == "space"){
+            if(parseOperand(text, operand)){
+                if(!lookup(operand) || operand.constant < 0){
+                    error(".space needs a known, non-negative size");
+                    return;
+                }
+                for(int i = 0; i < operand.constant; i++){
+                    emit(0);
+                }
+            }
+        }
+        else if(name == "ascii" || name == "asciz"){
+            if(parseString(text) && name == "asciz"){
+                emit(0);
+            }
+        }
+        else if(name == "equ"){
+            skipSpace(text);
+            string_view symbol = takeIdentifier(text);
+            if(symbol.empty()){
+                error(".equ needs a name");
+                return;
+            }
+            if(parseOperand(text, operand)){
+                if(!lookup(operand)){
+                    error(".equ value must be known at this point");
+                    return;
+                }
+                define(symbol, operand.constant);
+            }
+        }
+        else{
+            error("unknown directive '." + string(name) + "'");
+            return;
+        }
+        expectEnd(text);
+    }
+
+    /*
+     * Function: expectEnd
+     * -------------------
+     * Reports anything left on the line after a complete statement.
+     * Parameters:
+     * - text: the rest of the line
+     */
+    void expectEnd(string_view text){
+        skipSpace(text);
+        if(!text.empty()){
+            error("unexpected '" + string(text) + "'");
+        }
+    }
+
+    /*
+     * Function: assembleLine
+     * ----------------------
+     * Assembles one source line: optional labels, then a directive, instruction or raw word.
+     * Parameters:
+     * - line: the line without its newline
+     */
+    void assembleLine(string_view line){
+        //Strip comments
+        for(size_t i = 0; i < line.size(); i++){
+            if(line[i] == ';' || (line[i] == '/' && i + 1 < line.size() && line[i + 1] == '/')){
+                line = line.substr(0, i);
+                break;
+            }
+            //Quotes may contain comment characters
+            if(line[i] == '"' || line[i] == '\''){
+                char quote = line[i];
+                for(i++; i < line.size() && line[i] != quote; i++){
+                    if(line[i] == '\\'){
+                        i++;
+                    }
+                }
+            }
+        }
+
+        skipSpace(line);
+
+        //Labels
+        while(!line.empty() && isIdentifierStart(line[0])){
+            string_view rest = line;
+            string_view name = takeIdentifier(rest);
+            skipSpace(rest);
+            if(rest.empty() || rest[0] != ':'){
+                break;
+            }
+            define(name, address);
+            rest.remove_prefix(1);
+            skipSpace(rest);
+            line = rest;
+        }
+
+        if(line.empty()){
+            return;
+        }
+
+        if(line[0] == '.'){
+            line.remove_prefix(1);
+            assembleDirective(line);
+            return;
+        }
+
+        //A raw word, as in the text program format
+        if(!isIdentifierStart(line[0])){
+            Operand operand;
+            if(parseOperand(line, operand)){
+                emitOperand(operand);
+                expectEnd(line);
+            }
+            return;
+        }
+
+        //Instruction
+        string_view name = takeIdentifier(line);
+        char key[32];
+        if(name.size() >= sizeof(key)){
+            error("unknown instruction '" + string(name) + "'");
+            return;
+        }
+        for(size_t i = 0; i < name.size(); i++){
+            key[i] = tolower((unsigned char)name[i]);
+        }
+        auto mnemonic = mnemonics.find(string(key, name.size()));
+        if(mnemonic == mnemonics.end()){
+            error("unknown instruction '" + string(name) + "'");
+            return;
+        }
+
+        emit(mnemonic->second->code);
+        if(mnemonic->second->operands > 0){
+            Operand operand;
+            skipSpace(line);
+            if(line.empty()){
+                error(string(mnemonic->second->name) + " needs an operand");
+                return;
+            }
+            if(!parseOperand(line, operand)){
+                return;
+            }
+            emitOperand(operand);
+        }
+        expectEnd(line);
+    }
+};
+
+
+/*
+ * Main Function
+ * -------------
+ * Parses the command line, assembles the input file and writes the requested output format.
+ * Parameters:
+ * - argc: the number of command-line arguments.
+ * - argv: an array of command-line arguments.
+*/
+int main(int argc, char *argv[]) {
+
+    //Options
+    bool binary = false;
+    const char* outputFile = NULL;
+    const char* inputFile = NULL;
+    int memorySize = 2000;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-b") == 0){
+            binary = true;
+        }
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc){
+            outputFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+            memorySize = atoi(argv[++i]);
+        }
+        else if(argv[i][0] != '-' && inputFile == NULL){
+            inputFile = argv[i];
+        }
+        else{
+            inputFile = NULL;
+            break;
+        }
+    }
+
+    //Check for proper usage
+    if(inputFile == NULL || memorySize <= 0){
+        cerr << "Usage: " << argv[0] << " [-b] [-o output_file] [-s memory_size] <file name>" << endl;
+        return 1;
+    }
+
+    Assembler assembler(memorySize);
+    if(!assembler.assemble(inputFile)){
+        return 1;
+    }
+
+    FILE* output = stdout;
+    if(outputFile != NULL){
+        output = fopen(outputFile, binary ? "wb" : "w");
+        if(output == NULL){
+            cerr << "ERROR: unable to open the output file" << endl;
+            return 1;
+        }
+    }
+
+    if(binary){
+        assembler.writeBinary(output);
+    }
+    else{
+        assembler.writeText(output);
+    }
+
+    if(output != stdout){
+        fclose(output);
+    }
+    return 0;
+}
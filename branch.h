@@ -0,0 +1,275 @@
+/*
+    Program: Computer Simulator
+    File:    branch.h
+    Author:  Stanton Brown
+
+    Desription:
+    What-if exploration from a branch point: a run of the predecoded engine is stopped at a chosen
+    cycle and forked into one child per variant. A variant may change the timer value, reseed Get,
+    or patch memory words, and then runs to the end on its own. The shared prefix is simulated
+    only once. fork() gives every child the parent's machine state copy-on-write, so a variant
+    only copies the pages it writes.
+
+    The output of the prefix is captured and copied to the front of every variant's output
+    file, which therefore holds the whole output of that variant's run. When every variant has
+    ended the parent prints one line per variant with its exit status and cycle count.
+*/
+
+#ifndef BRANCH_H
+#define BRANCH_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+
+/*
+ * BranchPoint: Forks a running CPU into its variants at a chosen cycle
+ * --------------------------------------------------------------------
+ */
+class BranchPoint {
+
+public:
+    /*
+     * Patch: A memory word a variant replaces
+     */
+    struct Patch {
+        int address;
+        int value;
+    };
+
+    /*
+     * Variant: What one child changes at the branch point
+     */
+    struct Variant {
+        int timer;          //timer value, -1 to keep the run's
+        long long seed;     //Get seed, -1 to continue the run's random sequence
+        int patch;          //index of its patch list, -1 for none
+    };
+
+    //Cycle at which the run branches, before that cycle's instruction
+    long long cycle;
+
+    //Cycle limit of every variant (0 for none), beyond the branch point
+    long long cycleLimit;
+
+    //Where variant K writes its output, PREFIX.K.out and PREFIX.K.err
+    string outputPrefix;
+
+    //State file prefix, variant K writes FILE.K; NULL for none
+    const char* dumpFile;
+
+    vector<Variant> variants;
+    vector<vector<Patch>> patches;
+
+private:
+    //Output of the prefix, and the standard output it replaces
+    FILE* prefixOutput;
+    int savedOutput;
+    bool branched;
+
+    //The child's cycle count, recorded in the shared results when it exits
+    string variantDump;
+    static inline long long* result = NULL;
+    static inline const long long* counter = NULL;
+
+    //The branch point whose prefix output is released if the run ends before it
+    static inline BranchPoint* active = NULL;
+
+public:
+
+    /*
+     * Constructor: BranchPoint
+     * ------------------------
+     * Parameters:
+     * - at: the cycle to branch at
+     */
+    BranchPoint(long long at) : cycle(at), cycleLimit(0), outputPrefix("branch"), dumpFile(NULL),
+    prefixOutput(NULL), savedOutput(-1), branched(false) {}
+
+    /*
+     * Function: captureOutput
+     * -----------------------
+     * Sends standard output to a temporary file until the branch point, so that it can be
+     * copied to every variant. If the program ends first, the output is released to the
+     * real standard output on exit.
+     */
+    void captureOutput(){
+        prefixOutput = tmpfile();
+        savedOutput = dup(STDOUT_FILENO);
+        if(prefixOutput == NULL || savedOutput == -1){
+            cerr << "ERROR: unable to capture the output of the branch prefix: " << strerror(errno) << endl;
+            exit(1);
+        }
+        dup2(fileno(prefixOutput), STDOUT_FILENO);
+        active = this;
+        atexit(releaseOutput);
+    }
+
+    /*
+     * Function: branch
+     * ----------------
+     * Forks the CPU into its variants, at most one per processor at a time. Each child applies
+     * its variant and returns to continue the simulation. The parent waits for all of them,
+     * reports and exits.
+     * Parameters:
+     * - cpu: the CPU stopped at the branch point
+     */
+    template<class CPU>
+    void branch(CPU& cpu){
+        cout.flush();
+        fflush(stdout);
+        branched = true;
+
+        int count = variants.size();
+        long long* cycles = (long long*)mmap(NULL, count * sizeof(long long), PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(cycles == MAP_FAILED){
+            cerr << "ERROR: mmap failed: " << strerror(errno) << endl;
+            exit(1);
+        }
+
+        long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        vector<pid_t> children(count, -1);
+        vector<int> status(count, -1);
+        int running = 0;
+        for(int k = 0; k < count; k++){
+            if(running == jobs){
+                reap(children, status);
+                running--;
+            }
+            cycles[k] = cpu.cycles;
+            children[k] = fork();
+            if(children[k] == -1){
+                cerr << "ERROR: fork failed: " << strerror(errno) << endl;
+                exit(1);
+            }
+            if(children[k] == 0){
+                startVariant(cpu, k, &cycles[k]);
+                return;
+            }
+            running++;
+        }
+        while(running > 0){
+            reap(children, status);
+            running--;
+        }
+
+        //Back to the real standard output for the report
+        cout.flush();
+        dup2(savedOutput, STDOUT_FILENO);
+        cout << "variant timer seed patch status cycles" << endl;
+        for(int k = 0; k < count; k++){
+            const Variant& variant = variants[k];
+            cout << k << ' ' << (variant.timer >= 0 ? to_string(variant.timer) : "-") << ' '
+                 << (variant.seed >= 0 ? to_string(variant.seed) : "-") << ' '
+                 << (variant.patch >= 0 ? to_string(variant.patch) : "-") << ' '
+                 << status[k] << ' ' << cycles[k] << endl;
+        }
+        exit(0);
+    }
+
+private:
+
+    /*
+     * Function: startVariant
+     * ----------------------
+     * Turns a freshly forked child into variant k: its own output files, state file and
+     * cycle limit, then the variant's timer, seed and patches.
+     */
+    template<class CPU>
+    void startVariant(CPU& cpu, int k, long long* cycles){
+        string name = outputPrefix + "." + to_string(k);
+        int out = open((name + ".out").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        int err = open((name + ".err").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(out == -1 || err == -1){
+            cerr << "ERROR: unable to create the output of variant " << k << ": " << strerror(errno) << endl;
+            _exit(1);
+        }
+        copyPrefix(out);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        close(out);
+        close(err);
+        close(savedOutput);
+        active = NULL;
+
+        result = cycles;
+        counter = &cpu.cycles;
+        atexit(recordCycles);
+
+        const Variant& variant = variants[k];
+        if(variant.timer >= 0){
+            cpu.timeConstraint = variant.timer;
+        }
+        if(variant.seed >= 0){
+            srand(variant.seed);
+        }
+        if(variant.patch >= 0){
+            const vector<Patch>& words = patches[variant.patch];
+            for(size_t i = 0; i < words.size(); i++){
+                cpu.patch(words[i].address, words[i].value);
+            }
+        }
+        cpu.cycleLimit = cycleLimit;
+        if(dumpFile != NULL){
+            variantDump = string(dumpFile) + "." + to_string(k);
+            cpu.dumpFile = variantDump.c_str();
+        }
+    }
+
+    //Appends the captured prefix output to fd
+    void copyPrefix(int fd){
+        char buffer[4096];
+        off_t offset = 0;
+        ssize_t size;
+        while((size = pread(fileno(prefixOutput), buffer, sizeof(buffer), offset)) > 0){
+            if(write(fd, buffer, size) != size){
+                break;
+            }
+            offset += size;
+        }
+    }
+
+    //Waits for one child and stores its exit status (128 + signal if it was killed)
+    static void reap(const vector<pid_t>& children, vector<int>& status){
+        int wstatus;
+        pid_t pid;
+        while((pid = wait(&wstatus)) == -1 && errno == EINTR){
+        }
+        for(size_t k = 0; k < children.size(); k++){
+            if(children[k] == pid){
+                status[k] = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+            }
+        }
+    }
+
+    static void recordCycles(){
+        *result = *counter;
+    }
+
+    //The run ended before the branch point: its output belongs on standard output after all
+    static void releaseOutput(){
+        if(active == NULL || active->branched){
+            return;
+        }
+        cout.flush();
+        fflush(stdout);
+        dup2(active->savedOutput, STDOUT_FILENO);
+        active->copyPrefix(STDOUT_FILENO);
+        cerr << "Program ended before the branch point at cycle " << active->cycle << endl;
+    }
+};
+
+#endif
@@ -0,0 +1,784 @@
+/*
+    Program: Computer Simulator
+    File:    cosim.h
+    Author:  Stanton Brown
+
+    Desription:
+    Co-simulation of the CPU and the Memory as two C++20 coroutines in one thread.
+    The CPU and the memory agent keep the message protocol of the pipe engine (see memserver.h):
+    a read address is answered with the word, -1/-6/-8 address data writes, -7 asks for every word
+    and -5 ends the memory. Instead of pipes the messages go through two mailboxes, and where
+    the pipe CPU blocks in read() the coroutine CPU suspends with co_await; a small executor then
+    resumes the memory agent, which answers and resumes the CPU. Each access is two coroutine
+    switches instead of two kernel context switches, while the sequence of messages is exactly
+    that of the pipe engine, so both can be compared message for message.
+
+    Coroutines need C++20 (g++ -std=c++20); with an older standard COSIM_AVAILABLE is not defined
+    and the coroutine engine is not built.
+*/
+
+#ifndef COSIM_H
+#define COSIM_H
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define COSIM_AVAILABLE 1
+
+#include <array>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+#include "isa.h"
+#include "memory.h"
+#include "memserver.h"
+#include "stream.h"
+
+using namespace std;
+
+
+/*
+ * Task: A coroutine that runs when it is awaited, or when an Executor starts it
+ * -----------------------------------------------------------------------------
+ * Awaiting a Task transfers control to it directly, and its end transfers control back
+ * to the awaiting coroutine, so nested calls do not grow the thread's stack.
+ */
+class Task {
+
+public:
+    struct promise_type {
+        coroutine_handle<> continuation;
+
+        Task get_return_object(){
+            return Task(coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        struct Final {
+            bool await_ready() noexcept {
+                return false;
+            }
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> done) noexcept {
+                coroutine_handle<> next = done.promise().continuation;
+                return next ? next : noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        Final final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void(){}
+
+        void unhandled_exception(){
+            terminate();
+        }
+    };
+
+private:
+    coroutine_handle<promise_type> handle;
+
+    explicit Task(coroutine_handle<promise_type> h) : handle(h) {}
+
+public:
+    Task(Task&& other) : handle(other.handle){
+        other.handle = nullptr;
+    }
+
+    ~Task(){
+        if(handle){
+            handle.destroy();
+        }
+    }
+
+    bool await_ready(){
+        return false;
+    }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> caller){
+        handle.promise().continuation = caller;
+        return handle;
+    }
+
+    void await_resume(){}
+
+    /*
+     * Function: start
+     * ---------------
+     * Returns:
+     * The coroutine, for an Executor to run it at the top level.
+     */
+    coroutine_handle<> start(){
+        return handle;
+    }
+};
+
+
+/*
+ * Executor: Runs coroutines in one thread until none of them can continue
+ * -----------------------------------------------------------------------
+ */
+class Executor {
+
+private:
+    deque<coroutine_handle<>> ready;
+
+public:
+    void schedule(coroutine_handle<> coroutine){
+        ready.push_back(coroutine);
+    }
+
+    void run(){
+        while(!ready.empty()){
+            coroutine_handle<> next = ready.front();
+            ready.pop_front();
+            next.resume();
+        }
+    }
+};
+
+
+/*
+ * Mailbox: One direction of the protocol, words sent by one agent to the other
+ * ----------------------------------------------------------------------------
+ * Like a pipe, sending never waits and receiving waits until a word is there.
+ */
+class Mailbox {
+
+private:
+    Executor& executor;
+    deque<int> words;
+    coroutine_handle<> waiting;
+
+public:
+    Mailbox(Executor& exec) : executor(exec), waiting(nullptr) {}
+
+    void send(int word){
+        words.push_back(word);
+        if(waiting){
+            executor.schedule(waiting);
+            waiting = nullptr;
+        }
+    }
+
+    /*
+     * Receive: Awaiting it gives the next word, suspending until one is sent
+     */
+    struct Receive {
+        Mailbox& mailbox;
+
+        bool await_ready(){
+            return !mailbox.words.empty();
+        }
+        void await_suspend(coroutine_handle<> receiver){
+            mailbox.waiting = receiver;
+        }
+        int await_resume(){
+            int word = mailbox.words.front();
+            mailbox.words.pop_front();
+            return word;
+        }
+    };
+
+    Receive receive(){
+        return Receive{*this};
+    }
+};
+
+
+/*
+ * Function: memoryAgent
+ * ---------------------
+ * The memory side of the protocol, the loop of the pipe engine's memory process.
+ * Parameters:
+ * - memory: the memory it owns
+ * - requests: messages from the CPU
+ * - replies: words for the CPU
+ */
+inline Task memoryAgent(Memory& memory, Mailbox& requests, Mailbox& replies){
+    while(true){
+        int signal = co_await requests.receive();
+        if(signal == MemoryServer::WRITE || signal == MemoryServer::PUSH || signal == MemoryServer::SYSTEM_PUSH){
+            int address = co_await requests.receive();
+            int data = co_await requests.receive();
+            memory.write(address, data);
+            if(signal != MemoryServer::WRITE){
+                memory.noteStackPointer(address, signal == MemoryServer::SYSTEM_PUSH);
+            }
+        }
+        else if(signal == MemoryServer::EXIT){
+            co_return;
+        }
+        else if(signal == MemoryServer::SNAPSHOT){
+            for(int i = 0; i < Memory::MEMORY_SIZE; i++){
+                replies.send(memory.words()[i]);
+            }
+        }
+        else{
+            replies.send(memory.read(signal));
+        }
+    }
+}
+
+
+/*
+ * CoroutineCPU: The pipe engine's CPU as a coroutine
+ * --------------------------------------------------
+ * Same registers, interrupt handling and memory messages as CPU, with co_await where
+ * CPU waits for the memory process. Taken jumps continue the dispatch loop like PredecodedCPU
+ * instead of recursing. The CPU never returns from its run: when the program ends it records
+ * the exit status and stays suspended, so the memory agent can take the remaining messages.
+ */
+class CoroutineCPU {
+
+public:
+    //Exit status used when a run is stopped by the cycle limit
+    static const int CYCLE_LIMIT_EXIT = 3;
+
+    //Registers
+    int PC;
+    int SP;
+    int IR;
+    int AC;
+    int X;
+    int Y;
+    int operand;
+
+    //mode
+    bool kernelMode;
+
+    //Timer for interrupts
+    int timer;
+    const int timeConstraint;
+
+    //enable/disable interupts
+    bool interuptEnabled;
+
+    //Executed instruction count, and the count at which the run is stopped (0 for no limit)
+    long long cycles;
+    long long cycleLimit;
+
+    //File receiving the final CPU state when the program ends, NULL for none
+    const char* dumpFile;
+
+    //Mark pushes (-6 in user mode, -8 in kernel mode) so the memory's profile can follow the stacks
+    bool profileStack;
+
+    //Who may access each address, and the stack fault handler address (-1 for none)
+    AccessMap access;
+    int faultVector;
+
+    //Stream read by instruction 31
+    InputStream input;
+
+    //Exit status, set once the program has ended
+    int exitStatus;
+
+private:
+    Mailbox& toMemory;
+    Mailbox& fromMemory;
+
+    //Stack fault being handled
+    int faultCode;
+    int faultAddress;
+
+    //Set by an instruction that continues at the target of a jump or call
+    bool jumped;
+
+    /*
+     * Request: Awaiting it reads a word through the memory agent
+     * ----------------------------------------------------------
+     * A negative address would be a signal, so it is reported here like CPU::request
+     * and the CPU stops.
+     */
+    struct Request {
+        CoroutineCPU& cpu;
+        int address;
+
+        bool await_ready(){
+            return false;
+        }
+        void await_suspend(coroutine_handle<> waiting){
+            if(address < 0){
+                cerr << "ERROR: Invalid memory address accessed: " << address << endl;
+                cerr << "Exiting..." << endl;
+                cpu.exitStatus = EXIT_FAILURE;
+                return;
+            }
+            cpu.toMemory.send(address);
+            cpu.fromMemory.receive().await_suspend(waiting);
+        }
+        int await_resume(){
+            return cpu.fromMemory.receive().await_resume();
+        }
+    };
+
+    Request request(int address){
+        return Request{*this, address};
+    }
+
+public:
+
+    /*
+     * Constructor: CoroutineCPU
+     * -------------------------
+     * Parameters:
+     * - requests: where messages to the memory agent go
+     * - replies: where the memory agent's words arrive
+     * - tCon: time constraint for interrupt handling
+     */
+    CoroutineCPU(Mailbox& requests, Mailbox& replies, int tCon) : PC(0), SP(1000), IR(0), AC(0), X(0), Y(0),
+    operand(0), kernelMode(false), timer(0), timeConstraint(tCon), interuptEnabled(true), cycles(0),
+    cycleLimit(0), dumpFile(NULL), profileStack(false), faultVector(-1), exitStatus(-1),
+    toMemory(requests), fromMemory(replies), faultCode(0), faultAddress(0), jumped(false) {}
+
+    /*
+     * Function: run
+     * -------------
+     * Instruction cycle loop until the program ends.
+     */
+    Task run(){
+        while(true){
+            IR = co_await request(PC);
+            co_await executeInstruction();
+            PC++;
+        }
+    }
+
+private:
+
+    //Handler of one instruction word
+    typedef Task (CoroutineCPU::*Handler)();
+
+    //Register transfer of one instruction word, which runs without suspending the CPU
+    typedef void (*Transfer)(int&, int&, int&, int&);
+
+    /*
+     * Function: makeHandlers
+     * ----------------------
+     * Returns:
+     * The handler of every instruction word, indexed by the word.
+     */
+    template<int... CODES>
+    static constexpr array<Handler, MAX_OPCODE + 1> makeHandlers(integer_sequence<int, CODES...>){
+        return {{&CoroutineCPU::execute<CODES>...}};
+    }
+
+    /*
+     * Function: makeTransfers
+     * -----------------------
+     * Returns:
+     * The transfer of every register transfer instruction word, NULL for the other words.
+     */
+    template<int... CODES>
+    static constexpr array<Transfer, MAX_OPCODE + 1> makeTransfers(integer_sequence<int, CODES...>){
+        return {{transferOf<CODES>()...}};
+    }
+
+    template<int CODE>
+    static constexpr Transfer transferOf(){
+        constexpr const Opcode* op = findOpcode(CODE);
+        if constexpr(op != nullptr && registerTransfer(*op)){
+            return &transfer<CODE, int>;
+        }
+        else{
+            return NULL;
+        }
+    }
+
+    /*
+     * Function: executeInstruction
+     * ----------------------------
+     * Executes the instruction in IR, and the instructions reached through taken jumps and calls.
+     * The caller increments PC afterwards.
+     */
+    Task executeInstruction(){
+        static constexpr array<Handler, MAX_OPCODE + 1> handlers = makeHandlers(make_integer_sequence<int, MAX_OPCODE + 1>());
+        static constexpr array<Transfer, MAX_OPCODE + 1> transfers = makeTransfers(make_integer_sequence<int, MAX_OPCODE + 1>());
+        while(true){
+            //Stop runaway programs once the cycle limit is reached
+            if(++cycles == cycleLimit){
+                cerr << "ERROR: Cycle limit reached" << endl;
+                co_await finish(CYCLE_LIMIT_EXIT);
+            }
+
+            //Check if a timer interupt has occured
+            if(interuptEnabled && timer >= timeConstraint){
+                co_await interrupt(0);
+            }
+            else{
+                timer++;
+            }
+
+            //Register transfers need no message, the others run as a coroutine of their own
+            jumped = false;
+            if(IR >= 0 && IR <= MAX_OPCODE && transfers[IR] != NULL){
+                transfers[IR](AC, X, Y, SP);
+            }
+            else if(IR >= 0 && IR <= MAX_OPCODE){
+                co_await (this->*handlers[IR])();
+            }
+            else{
+                co_await invalidInstruction();
+            }
+            if(!jumped){
+                co_return;
+            }
+
+            //Jumps and calls execute the target without returning to the caller
+            IR = co_await request(PC);
+        }
+    }
+
+    /*
+     * Function: execute
+     * -----------------
+     * Executes instruction word CODE, like PredecodedCPU::execute. Its operand is fetched, its
+     * data address formed and a jump or call taken as the instruction set table (isa.h)
+     * describes it, sending the memory agent the messages of the pipe CPU in the same order.
+     * A taken jump or call sets jumped, with PC at its target.
+     */
+    template<int CODE>
+    Task execute(){
+        constexpr const Opcode* op = findOpcode(CODE);
+        if constexpr(op == nullptr){
+            co_await invalidInstruction();
+        }
+        else{
+            //A conditional jump that is not taken skips its operand
+            if constexpr(CODE == 21 || CODE == 22){
+                if((AC == 0) != (CODE == 21)){
+                    PC++;
+                    co_return;
+                }
+            }
+
+            if constexpr(op->operands > 0){
+                PC++;
+                operand = co_await request(PC);
+            }
+
+            if constexpr(op->branch && op->operands > 0){
+                if constexpr(CODE == 23){
+                    co_await pushStack(PC);
+                }
+                PC = operand;
+                jumped = true;
+            }
+            else if constexpr(dataLoad(*op)){
+                //Loads, the table gives the addressing mode
+                if constexpr(op->mode == INDIRECT){
+                    co_await readMemory(operand);
+                }
+                co_await readMemory(effectiveAddress<op->mode>());
+                AC = operand;
+            }
+            else if constexpr(dataStore(*op)){
+                co_await writeMemory(effectiveAddress<op->mode>(), AC);
+            }
+            else if constexpr(registerTransfer(*op)){
+                transfer<CODE>(AC, X, Y, SP);
+            }
+            else if constexpr(CODE == 1){
+                AC = operand;
+            }
+            else if constexpr(CODE == 8){
+                AC = rand() % 100 + 1;
+            }
+            else if constexpr(CODE == 9){
+                if(operand == 1){
+                    cout << AC;
+                }
+                else if(operand == 2){
+                    cout << char(AC);
+                }
+                else{
+                    cerr << "Invalid operand for instruction 9.." << endl;
+                }
+            }
+            else if constexpr(CODE == 24){
+                co_await popStack();
+                PC = operand;
+            }
+            else if constexpr(CODE == 27){
+                co_await pushStack(AC);
+            }
+            else if constexpr(CODE == 28){
+                co_await popStack();
+                AC = operand;
+            }
+            else if constexpr(CODE == 29){
+                co_await interrupt(1);
+            }
+            else if constexpr(CODE == 30){
+                //IRet, restore user program context
+                co_await popStack();
+                Y = operand;
+                co_await popStack();
+                X = operand;
+                co_await popStack();
+                AC = operand;
+                co_await popStack();
+                IR = operand;
+                co_await popStack();
+                PC = operand;
+                co_await popStack();
+                SP = operand;
+                kernelMode = false;
+                interuptEnabled = true;
+            }
+            else if constexpr(CODE == 31){
+                if(!input.read(operand, AC)){
+                    cerr << "Invalid operand for instruction 31.." << endl;
+                }
+            }
+            else if constexpr(CODE == 50){
+                co_await finish(0);
+            }
+        }
+        co_return;
+    }
+
+    /*
+     * Function: effectiveAddress
+     * --------------------------
+     * Returns:
+     * The address of the data of an instruction with addressing mode MODE, the address read
+     * into operand for INDIRECT.
+     */
+    template<AddressingMode MODE>
+    int effectiveAddress(){
+        if constexpr(MODE == INDEXED_X){
+            return operand + X;
+        }
+        else if constexpr(MODE == INDEXED_Y){
+            return operand + Y;
+        }
+        else if constexpr(MODE == STACK_INDEXED){
+            return SP + X;
+        }
+        else{
+            return operand;
+        }
+    }
+
+    Task invalidInstruction(){
+        cerr << "ERROR: Invalid instruction: " << IR << endl;
+        co_await stop(1);
+    }
+
+    /*
+     * Function: interrupt
+     * -------------------
+     * Saves the user SP and PC and the rest of the context on the system stack, then runs the
+     * handler at 1000 (timer, code 0), 1500 (system call, code 1) or faultVector (stack fault,
+     * code 2) until it returns with IRet.
+     * Parameters:
+     * - code: The code indicating the type of interrupt.
+     */
+    Task interrupt(int code){
+        kernelMode = true;
+        int userSP = SP;
+        SP = 2000;
+        co_await pushStack(userSP);
+        co_await pushStack(PC);
+
+        interuptEnabled = false;
+        co_await pushStack(IR);
+        co_await pushStack(AC);
+        co_await pushStack(X);
+        co_await pushStack(Y);
+
+        if(code == 0){
+            timer = 0;
+            PC = 1000;
+        }
+        else if(code == 1){
+            PC = 1500;
+        }
+        else{
+            AC = faultCode;
+            X = faultAddress;
+            PC = faultVector;
+        }
+
+        while(kernelMode){
+            IR = co_await request(PC);
+            co_await executeInstruction();
+            if(kernelMode){
+                PC++;
+            }
+        }
+    }
+
+    /*
+     * Function: readMemory
+     * --------------------
+     * Reads a data word into operand after checking permissions.
+     */
+    Task readMemory(int address){
+        if(!access.allows(address, AccessMap::USER_DATA, kernelMode)){
+            co_await accessFault(address, AccessMap::USER_DATA);
+        }
+        operand = co_await request(address);
+    }
+
+    /*
+     * Function: writeMemory
+     * ---------------------
+     * Sends a data word to memory after checking permissions.
+     */
+    Task writeMemory(int address, int data){
+        if(!access.allows(address, AccessMap::USER_DATA, kernelMode)){
+            co_await accessFault(address, AccessMap::USER_DATA);
+        }
+        toMemory.send(MemoryServer::WRITE);
+        toMemory.send(address);
+        toMemory.send(data);
+    }
+
+    /*
+     * Function: pushStack
+     * -------------------
+     * Decrements SP and writes data at the new top of stack.
+     */
+    Task pushStack(int data){
+        SP--;
+        if(!access.allows(SP, AccessMap::USER_STACK, kernelMode)){
+            co_await accessFault(SP, AccessMap::USER_STACK);
+        }
+        toMemory.send(profileStack ? (kernelMode ? MemoryServer::SYSTEM_PUSH : MemoryServer::PUSH) : MemoryServer::WRITE);
+        toMemory.send(SP);
+        toMemory.send(data);
+    }
+
+    /*
+     * Function: popStack
+     * ------------------
+     * Reads the top of stack into operand and increments SP.
+     */
+    Task popStack(){
+        if(!access.allows(SP, AccessMap::USER_STACK, kernelMode)){
+            co_await accessFault(SP, AccessMap::USER_STACK);
+        }
+        operand = co_await request(SP);
+        SP++;
+    }
+
+    /*
+     * Function: accessFault
+     * ---------------------
+     * Reports a refused access, running the fault handler first for a user stack fault,
+     * see CPU::accessFault.
+     */
+    Task accessFault(int address, unsigned char kind){
+        AccessMap::Fault fault = access.classify(address, kind, kernelMode);
+        if(fault == AccessMap::NO_FAULT){
+            co_return;      //the memory access reports the invalid address
+        }
+
+        if(fault != AccessMap::PERMISSION_FAULT && faultVector >= 0 && !kernelMode){
+            faultCode = fault;
+            faultAddress = address;
+            co_await interrupt(2);
+        }
+
+        cerr << "ERROR: " << AccessMap::describe(fault);
+        if(fault != AccessMap::PERMISSION_FAULT){
+            cerr << " at address " << address;
+        }
+        cerr << endl;
+        cerr << "Exiting..." << endl;
+        co_await stop(1);
+    }
+
+    /*
+     * Function: finish
+     * ----------------
+     * Ends the program: saves the final state if requested, with the memory words sent by the
+     * memory agent, then tells the memory agent to exit.
+     * Parameters:
+     * - status: exit status of the program.
+     */
+    Task finish(int status){
+        if(dumpFile != NULL){
+            ofstream out(dumpFile, ios::trunc);
+            out << "PC " << PC << '\n' << "SP " << SP << '\n' << "IR " << IR << '\n'
+                << "AC " << AC << '\n' << "X " << X << '\n' << "Y " << Y << '\n'
+                << "timer " << timer << '\n' << "mode " << (kernelMode ? "kernel" : "user") << '\n';
+            out.close();
+
+            toMemory.send(MemoryServer::SNAPSHOT);
+            int words[Memory::MEMORY_SIZE];
+            for(int i = 0; i < Memory::MEMORY_SIZE; i++){
+                words[i] = co_await fromMemory.receive();
+            }
+            Memory::dumpWords(dumpFile, words);
+        }
+        toMemory.send(MemoryServer::EXIT);
+        co_await stop(status);
+    }
+
+    /*
+     * Function: stop
+     * --------------
+     * Records the exit status and suspends the CPU for good.
+     */
+    Task stop(int status){
+        exitStatus = status;
+        co_await suspend_always{};
+    }
+};
+
+
+/*
+ * CoSimulation: A CPU and a memory agent sharing one executor
+ * -----------------------------------------------------------
+ */
+class CoSimulation {
+
+private:
+    Executor executor;
+    Mailbox requests;
+    Mailbox replies;
+    Memory& memory;
+
+public:
+    CoroutineCPU cpu;
+
+    /*
+     * Constructor: CoSimulation
+     * -------------------------
+     * Parameters:
+     * - mem: the memory given to the memory agent
+     * - tCon: time constraint for interrupt handling
+     */
+    CoSimulation(Memory& mem, int tCon) : requests(executor), replies(executor), memory(mem),
+    cpu(requests, replies, tCon) {}
+
+    /*
+     * Function: run
+     * -------------
+     * Runs the CPU and the memory agent until neither can continue.
+     * Returns:
+     * The exit status of the program.
+     */
+    int run(){
+        Task cpuTask = cpu.run();
+        Task memoryTask = memoryAgent(memory, requests, replies);
+        executor.schedule(cpuTask.start());
+        executor.schedule(memoryTask.start());
+        executor.run();
+        cout.flush();
+        return cpu.exitStatus;
+    }
+};
+
+#endif
+
+#endif
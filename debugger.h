@@ -0,0 +1,452 @@
+/*
+    Program: Computer Simulator
+    File:    debugger.h
+    Author:  Stanton Brown
+
+    Desription:
+    Interactive debugger for the in-process execution engines (direct and predecoded).
+    Supports breakpoints on PC, watchpoints on memory addresses, single-stepping,
+    register and memory inspection, and reverse-continue to the last write of an address.
+
+    The engines call instruction() before every instruction and written() before every
+    memory write. Breakpoints and watchpoints are bitmaps indexed by address, so the
+    check at an instruction boundary is one bit test plus a flag test, whatever the number
+    of breakpoints.
+
+    Reverse execution works by deterministic replay: the engines are restarted from the
+    program file with the same Get seed (by throwing Debugger::Restart) and run forward to
+    the cycle of the write. Output of cycles that were already shown is suppressed during
+    the replay, so standard output matches an uninterrupted run.
+
+    Commands are read from standard input, the debugger prints to standard error:
+    - break addr / delete addr:      set or remove a breakpoint
+    - watch addr / unwatch addr:     stop after any write to addr
+    - step [n]:                      execute n instructions (1 by default)
+    - continue:                      run until a breakpoint or watchpoint
+    - reverse-continue addr (rc):    go back to the instruction that last wrote addr
+    - regs:                          print the registers
+    - x addr [count]:                print memory words
+    - info:                          list breakpoints and watchpoints
+    - quit:                          exit the simulator
+    An empty line repeats the previous command.
+*/
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+#include "memory.h"
+#include "isa.h"
+
+using namespace std;
+
+
+/*
+ * Debugger: Breakpoints, watchpoints and replay for one simulated machine
+ * -----------------------------------------------------------------------
+ * Lives across restarts of the engine; the engine attaches its registers and memory
+ * every time it is (re)created.
+ */
+class Debugger {
+
+public:
+    /*
+     * Restart: Thrown to unwind the engine so the program can be replayed from the start
+     */
+    struct Restart {};
+
+    /*
+     * Registers: Where the attached engine keeps its state
+     */
+    struct Registers {
+        int* PC;
+        int* SP;
+        int* IR;
+        int* AC;
+        int* X;
+        int* Y;
+        int* timer;
+        bool* kernelMode;
+        long long* cycles;
+    };
+
+private:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+    static const int BITMAP_WORDS = (MEMORY_SIZE + 63) / 64;
+
+    //One bit per address
+    uint64_t breakpoints[BITMAP_WORDS];
+    uint64_t watchpoints[BITMAP_WORDS];
+
+    //Cycle of the most recent write to each address, 0 if not written yet
+    long long lastWrite[MEMORY_SIZE];
+
+    //Attached engine
+    Memory* memory;
+    Registers registers;
+
+    //Set whenever anything other than a breakpoint can stop the next instruction,
+    //so the common case is a single flag test plus a bitmap test
+    bool attention;
+
+    //Remaining instructions to step, 0 when not stepping
+    long long steps;
+
+    //Watchpoint hit by the last instruction
+    bool watchHit;
+    int watchAddress;
+    int watchOld;
+    int watchNew;
+
+    //Replay state: cycle to stop at, and the cycle up to which output was already shown
+    bool replaying;
+    long long stopCycle;
+    long long shownUntil;
+
+    //Previous command, repeated on an empty line
+    string lastCommand;
+
+public:
+
+    /*
+     * Constructor: Debugger
+     * ---------------------
+     * Starts without breakpoints, stopped before the first instruction.
+     */
+    Debugger() : memory(NULL), attention(true), steps(1), watchHit(false), watchAddress(0),
+    watchOld(0), watchNew(0), replaying(false), stopCycle(0), shownUntil(-1) {
+        for(int i = 0; i < BITMAP_WORDS; i++){
+            breakpoints[i] = 0;
+            watchpoints[i] = 0;
+        }
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            lastWrite[i] = 0;
+        }
+    }
+
+    /*
+     * Function: attach
+     * ----------------
+     * Connects the debugger to a newly created engine.
+     * Parameters:
+     * - mem: the engine's memory
+     * - regs: the engine's registers
+     */
+    void attach(Memory* mem, const Registers& regs){
+        memory = mem;
+        registers = regs;
+    }
+
+    /*
+     * Function: instruction
+     * ---------------------
+     * Called by the engine before each instruction, after it has been fetched into IR.
+     * Stops for a step, watchpoint, breakpoint or replay target.
+     */
+    void instruction(){
+        int PC = *registers.PC;
+        if(attention || ((unsigned)PC < (unsigned)MEMORY_SIZE && testBit(breakpoints, PC))){
+            check(PC);
+        }
+    }
+
+    /*
+     * Function: written
+     * -----------------
+     * Called by the engine before it writes memory.
+     * Records the write for reverse-continue and notes a watchpoint hit.
+     * Parameters:
+     * - address: the address being written
+     * - data: the value being written
+     */
+    void written(int address, int data){
+        if((unsigned)address >= (unsigned)MEMORY_SIZE){
+            return;     //the write itself reports the invalid address
+        }
+        lastWrite[address] = *registers.cycles;
+        if(testBit(watchpoints, address) && !replaying){
+            watchHit = true;
+            watchAddress = address;
+            watchOld = memory->read(address);
+            watchNew = data;
+            attention = true;
+        }
+    }
+
+    /*
+     * Function: restarted
+     * -------------------
+     * Called once the engine has been recreated after a Restart.
+     * Replays silently up to the stop cycle chosen by reverse-continue.
+     */
+    void restarted(){
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            lastWrite[i] = 0;
+        }
+        replaying = true;
+        watchHit = false;
+        steps = 0;
+        attention = true;
+        cout.setstate(ios::badbit);
+    }
+
+private:
+
+    static bool testBit(const uint64_t* bitmap, int address){
+        return (bitmap[address >> 6] >> (address & 63)) & 1;
+    }
+
+    static void setBit(uint64_t* bitmap, int address, bool value){
+        if(value){
+            bitmap[address >> 6] |= (uint64_t)1 << (address & 63);
+        }
+        else{
+            bitmap[address >> 6] &= ~((uint64_t)1 << (address & 63));
+        }
+    }
+
+    /*
+     * Function: check
+     * ---------------
+     * Slow path of instruction(): decides whether to stop, and runs the command loop if so.
+     * Parameters:
+     * - PC: the address of the instruction about to run
+     */
+    void check(int PC){
+        long long cycle = *registers.cycles;
+
+        //Output resumes once the replay passes everything shown before
+        if(shownUntil >= 0 && cycle >= shownUntil){
+            cout.clear();
+            shownUntil = -1;
+        }
+
+        bool stop = false;
+        if(replaying){
+            if(cycle != stopCycle){
+                return;
+            }
+            replaying = false;
+            stop = true;
+            cerr << "Reversed to the write in cycle " << cycle + 1 << endl;
+        }
+        else{
+            if(watchHit){
+                watchHit = false;
+                stop = true;
+                cerr << "Watchpoint " << watchAddress << ": " << watchOld << " -> " << watchNew << endl;
+            }
+            if(steps > 0 && --steps == 0){
+                stop = true;
+            }
+            if((unsigned)PC < (unsigned)MEMORY_SIZE && testBit(breakpoints, PC)){
+                if(!stop){
+                    cerr << "Breakpoint " << PC << endl;
+                }
+                stop = true;
+            }
+        }
+
+        if(!stop){
+            updateAttention();
+            return;
+        }
+
+        steps = 0;
+        printLocation();
+        commandLoop();
+        updateAttention();
+    }
+
+    /*
+     * Function: updateAttention
+     * -------------------------
+     * Recomputes whether the slow path is needed for reasons other than a breakpoint.
+     */
+    void updateAttention(){
+        attention = steps > 0 || watchHit || replaying || shownUntil >= 0;
+    }
+
+    /*
+     * Function: printLocation
+     * -----------------------
+     * Shows the instruction about to run, as words and disassembled.
+     */
+    void printLocation(){
+        int PC = *registers.PC;
+        int operand = 0;
+        cerr << "PC " << PC << ": " << *registers.IR;
+        if(PC >= 0 && PC + 1 < MEMORY_SIZE){
+            operand = memory->read(PC + 1);
+            cerr << " " << operand;
+        }
+        cerr << "  " << disassemble(*registers.IR, operand) << "  (cycle " << *registers.cycles + 1 << ")" << endl;
+    }
+
+    /*
+     * Function: printRegisters
+     * ------------------------
+     * Prints every register of the attached engine.
+     */
+    void printRegisters(){
+        cerr << "PC: " << *registers.PC << "  SP: " << *registers.SP << "  IR: " << *registers.IR
+             << "  AC: " << *registers.AC << "  X: " << *registers.X << "  Y: " << *registers.Y << endl
+             << "timer: " << *registers.timer << "  mode: " << (*registers.kernelMode ? "kernel" : "user")
+             << "  cycles: " << *registers.cycles << endl;
+    }
+
+    /*
+     * Function: readAddress
+     * ---------------------
+     * Reads an address argument of a command.
+     * Parameters:
+     * - args: the rest of the command line
+     * - address: receives the address
+     * Returns:
+     * false (after reporting it) if the address is missing or outside of memory.
+     */
+    static bool readAddress(istringstream& args, int& address){
+        if(!(args >> address) || address < 0 || address >= MEMORY_SIZE){
+            cerr << "Expected an address from 0 to " << MEMORY_SIZE - 1 << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Function: commandLoop
+     * ---------------------
+     * Reads and runs commands until one resumes execution.
+     * End of input detaches the debugger and lets the program run to completion.
+     */
+    void commandLoop(){
+        cout.flush();
+        string line;
+        while(true){
+            cerr << "(csim) " << flush;
+            if(!getline(cin, line)){
+                cerr << endl;
+                detach();
+                return;
+            }
+            if(line.empty()){
+                line = lastCommand;
+            }
+            lastCommand = line;
+
+            istringstream args(line);
+            string command;
+            args >> command;
+            int address;
+
+            if(command.empty()){
+                continue;
+            }
+            else if(command == "break" || command == "b" || command == "delete" || command == "d"){
+                if(readAddress(args, address)){
+                    setBit(breakpoints, address, command[0] == 'b');
+                }
+            }
+            else if(command == "watch" || command == "w" || command == "unwatch"){
+                if(readAddress(args, address)){
+                    setBit(watchpoints, address, command[0] == 'w');
+                }
+            }
+            else if(command == "step" || command == "s"){
+                long long count;
+                steps = (args >> count) && count > 0 ? count : 1;
+                return;
+            }
+            else if(command == "continue" || command == "c"){
+                return;
+            }
+            else if(command == "reverse-continue" || command == "rc"){
+                if(readAddress(args, address)){
+                    reverse(address);
+                }
+            }
+            else if(command == "regs" || command == "r"){
+                printRegisters();
+            }
+            else if(command == "x"){
+                int count;
+                if(readAddress(args, address)){
+                    if(!(args >> count) || count < 1){
+                        count = 1;
+                    }
+                    for(int i = address; i < address + count && i < MEMORY_SIZE; i++){
+                        cerr << i << ": " << memory->read(i) << endl;
+                    }
+                }
+            }
+            else if(command == "info" || command == "i"){
+                printPoints("Breakpoints:", breakpoints);
+                printPoints("Watchpoints:", watchpoints);
+            }
+            else if(command == "quit" || command == "q"){
+                cout.clear();
+                cout.flush();
+                exit(0);
+            }
+            else{
+                cerr << "Commands: break/delete addr, watch/unwatch addr, step [n], continue,"
+                     << " reverse-continue addr, regs, x addr [count], info, quit" << endl;
+            }
+        }
+    }
+
+    /*
+     * Function: printPoints
+     * ---------------------
+     * Lists the addresses set in a bitmap.
+     */
+    static void printPoints(const char* title, const uint64_t* bitmap){
+        cerr << title;
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            if(testBit(bitmap, i)){
+                cerr << " " << i;
+            }
+        }
+        cerr << endl;
+    }
+
+    /*
+     * Function: reverse
+     * -----------------
+     * Restarts the program to replay it up to the instruction that last wrote an address.
+     * Parameters:
+     * - address: the address whose last write to return to
+     */
+    void reverse(int address){
+        if(lastWrite[address] == 0){
+            cerr << "No write to " << address << " so far" << endl;
+            return;
+        }
+        stopCycle = lastWrite[address] - 1;
+        long long now = *registers.cycles;
+        if(now > shownUntil){
+            shownUntil = now;
+        }
+        throw Restart();
+    }
+
+    /*
+     * Function: detach
+     * ----------------
+     * Removes every breakpoint and watchpoint so the program runs freely.
+     */
+    void detach(){
+        for(int i = 0; i < BITMAP_WORDS; i++){
+            breakpoints[i] = 0;
+            watchpoints[i] = 0;
+        }
+        steps = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+    Program: Computer Simulator
+    File:    image.h
+    Author:  Stanton Brown
+
+    Desription:
+    Binary memory image format shared by the assembler and the Memory loader.
+    An image is a small header followed by the raw words of memory starting at address 0,
+    so the loader can copy it straight into the memory array without parsing any text.
+
+    Layout (native byte order):
+    - magic:   the four characters "CSIM"
+    - version: IMAGE_VERSION
+    - words:   number of memory words that follow
+    - data:    `words` 32-bit integers for addresses 0 .. words-1
+*/
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+
+//Identifies a binary image, checked by the loader before falling back to the text format
+static const char IMAGE_MAGIC[4] = {'C', 'S', 'I', 'M'};
+
+//Bumped whenever the layout below changes
+static const uint32_t IMAGE_VERSION = 1;
+
+/*
+ * ImageHeader: Header of a binary memory image
+ * --------------------------------------------
+ * Written once at the start of the file, immediately followed by the memory words.
+ */
+struct ImageHeader {
+    char magic[4];      //IMAGE_MAGIC
+    uint32_t version;   //IMAGE_VERSION
+    uint32_t words;     //Number of memory words that follow the header
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+    Program: Computer Simulator
+    File:    interpreter.h
+    Author:  Stanton Brown
+
+    Desription:
+    The instruction set executed for one CPU at a time, shared by the library API (machine.h)
+    and the lockstep engine (lockstep.h), which runs it for the instances of a group that cannot
+    execute an instruction together. Both keep the interrupts being handled as an explicit stack,
+    so an instruction entering a handler returns ENTERED instead of running the handler inside it.
+
+    Like the predecoded engine, dispatch expands to a handler for every instruction word, whose
+    operand fetch, addressing mode and jump come from the instruction set table (isa.h).
+    The CPU is a template parameter. It has the registers PC, SP, IR, AC, X, Y and operand,
+    kernelMode and interruptEnabled, the Get generator, the output and errors strings and the
+    input stream, as members or references, and the memory and handler operations of its engine:
+    fetchOperand(), load(), writeMemory(), push(), pop(), interrupt(), end() and
+    invalidInstruction(). A Machine is such a CPU; the lockstep engine hands the interpreter a
+    view of one instance.
+*/
+
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <string>
+#include <cstdlib>
+#include <utility>
+
+#include "memory.h"
+#include "isa.h"
+
+using namespace std;
+
+
+/*
+ * Interpreter: Executes one instruction of one CPU
+ * ------------------------------------------------
+ */
+struct Interpreter {
+
+    //Interrupt being handled, recorded when the handler is entered
+    enum Origin { TIMER, SYSCALL, FAULT };
+
+    //What an instruction did, telling the engine what the CPU does next
+    enum Outcome { NEXT, JUMPED, ENTERED, HALTED };
+
+    /*
+     * Function: execute
+     * -----------------
+     * Executes the instruction in IR, like PredecodedCPU::executeInstruction without the cycle
+     * count and timer check, which the caller has done.
+     * Parameters:
+     * - cpu: the CPU
+     * Returns:
+     * NEXT when the caller should advance PC, JUMPED when PC is the next instruction,
+     * ENTERED when a handler was entered and HALTED when the CPU left the instruction.
+     */
+    template<class CPU>
+    static Outcome execute(CPU& cpu){
+        return dispatch(cpu, make_integer_sequence<int, MAX_OPCODE + 1>());
+    }
+
+private:
+
+    /*
+     * Function: dispatch
+     * ------------------
+     * Executes IR with the handler of its instruction word, expanded from the list of words
+     * like PredecodedCPU::dispatch.
+     */
+    template<class CPU, int... CODES>
+    static Outcome dispatch(CPU& cpu, integer_sequence<int, CODES...>){
+        Outcome outcome = HALTED;
+        if(!((cpu.IR == CODES && (outcome = execute<CODES>(cpu), true)) || ...)){
+            cpu.invalidInstruction();
+        }
+        return outcome;
+    }
+
+    /*
+     * Function: execute
+     * -----------------
+     * Executes instruction word CODE. Its operand is fetched, its data address formed and a
+     * jump or call taken as the instruction set table (isa.h) describes it.
+     */
+    template<int CODE, class CPU>
+    static Outcome execute(CPU& cpu){
+        constexpr const Opcode* op = findOpcode(CODE);
+        if constexpr(op == nullptr){
+            cpu.invalidInstruction();
+            return HALTED;
+        }
+        else{
+            //A conditional jump that is not taken skips its operand
+            if constexpr(CODE == 21 || CODE == 22){
+                if((cpu.AC == 0) != (CODE == 21)){
+                    cpu.PC++;
+                    return NEXT;
+                }
+            }
+
+            if constexpr(op->operands > 0){
+                if(!cpu.fetchOperand()) return HALTED;
+            }
+
+            int value;
+            if constexpr(op->branch && op->operands > 0){
+                //Jump or call, PC is the target
+                if constexpr(CODE == 23){
+                    if(!cpu.push(cpu.PC)) return HALTED;
+                }
+                cpu.PC = cpu.operand;
+                return JUMPED;
+            }
+            else if constexpr(dataLoad(*op)){
+                int address;
+                if(!effectiveAddress<op->mode>(cpu, address) || !cpu.load(address, value, AccessMap::USER_DATA)){
+                    return HALTED;
+                }
+                cpu.AC = value;
+            }
+            else if constexpr(dataStore(*op)){
+                int address;
+                if(!effectiveAddress<op->mode>(cpu, address) || !cpu.writeMemory(address, cpu.AC)) return HALTED;
+            }
+            else if constexpr(registerTransfer(*op)){
+                transfer<CODE>(cpu.AC, cpu.X, cpu.Y, cpu.SP);
+            }
+            else if constexpr(CODE == 1){
+                cpu.AC = cpu.operand;
+            }
+            else if constexpr(CODE == 8){
+                int32_t random;
+                random_r(&cpu.generator, &random);
+                cpu.AC = random % 100 + 1;
+            }
+            else if constexpr(CODE == 9){
+                if(cpu.operand == 1){
+                    cpu.output += to_string(cpu.AC);
+                }
+                else if(cpu.operand == 2){
+                    cpu.output += char(cpu.AC);
+                }
+                else{
+                    cpu.errors += "Invalid operand for instruction 9..\n";
+                }
+            }
+            else if constexpr(CODE == 24){
+                if(!cpu.pop(value)) return HALTED;
+                cpu.PC = value;
+            }
+            else if constexpr(CODE == 27){
+                if(!cpu.push(cpu.AC)) return HALTED;
+            }
+            else if constexpr(CODE == 28){
+                if(!cpu.pop(value)) return HALTED;
+                cpu.AC = value;
+            }
+            else if constexpr(CODE == 29){
+                return cpu.interrupt(SYSCALL) ? ENTERED : HALTED;
+            }
+            else if constexpr(CODE == 30){
+                if(!cpu.pop(cpu.Y) || !cpu.pop(cpu.X) || !cpu.pop(cpu.AC) || !cpu.pop(cpu.IR) || !cpu.pop(cpu.PC) ||
+                   !cpu.pop(value)) return HALTED;
+                cpu.SP = value;
+                cpu.kernelMode = false;
+                cpu.interruptEnabled = true;
+            }
+            else if constexpr(CODE == 31){
+                if(!cpu.stream.read(cpu.operand, cpu.AC)){
+                    cpu.errors += "Invalid operand for instruction 31..\n";
+                }
+            }
+            else if constexpr(CODE == 50){
+                cpu.end();
+                return HALTED;
+            }
+            return NEXT;
+        }
+    }
+
+    /*
+     * Function: effectiveAddress
+     * --------------------------
+     * Forms the data address of an instruction with addressing mode MODE.
+     * Returns:
+     * false if the CPU left the instruction reading the address of an indirect load.
+     */
+    template<AddressingMode MODE, class CPU>
+    static bool effectiveAddress(CPU& cpu, int& address){
+        if constexpr(MODE == INDIRECT){
+            return cpu.load(cpu.operand, address, AccessMap::USER_DATA);
+        }
+        else if constexpr(MODE == INDEXED_X){
+            address = cpu.operand + cpu.X;
+        }
+        else if constexpr(MODE == INDEXED_Y){
+            address = cpu.operand + cpu.Y;
+        }
+        else if constexpr(MODE == STACK_INDEXED){
+            address = cpu.SP + cpu.X;
+        }
+        else{
+            address = cpu.operand;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,248 @@
+/*
+    Program: Computer Simulator
+    File:    isa.h
+    Author:  Stanton Brown
+
+    Desription:
+    The instruction set as one constexpr table: mnemonic, operand count, addressing mode,
+    how many memory accesses it makes beyond its own words, the registers it reads and writes,
+    and whether it transfers control.
+    The dispatch of the predecoded, coroutine and library engines (and the lockstep engine's
+    per-instance steps), the assembler's mnemonics, the disassembly of the debugger and the
+    regression tester, the operand layout used by the aot translator and the hazards of the
+    pipeline model all come from this table, so an instruction is described in one place.
+    The engines fetch operands, form data addresses and take jumps as the table says; what the
+    register transfers compute is given once, by transfer().
+*/
+
+#ifndef ISA_H
+#define ISA_H
+
+#include <string>
+
+using namespace std;
+
+
+/*
+ * AddressingMode: How an instruction finds its data
+ */
+enum AddressingMode {
+    IMPLIED,        //registers only, or no data
+    IMMEDIATE,      //the operand is the value (Load value, Put port)
+    ABSOLUTE,       //the operand is the address
+    INDIRECT,       //the operand is the address of the address
+    INDEXED_X,      //operand + X
+    INDEXED_Y,      //operand + Y
+    STACK_INDEXED,  //SP + X
+    STACK           //the top of stack
+};
+
+/*
+ * Register: Bits of the registers an instruction reads or writes
+ */
+enum Register {
+    REG_AC = 1,
+    REG_X = 2,
+    REG_Y = 4,
+    REG_SP = 8,
+    REG_ALL = 15
+};
+
+/*
+ * Opcode: One instruction of the instruction set
+ * ----------------------------------------------
+ * - code: the instruction word
+ * - name: its mnemonic
+ * - operands: number of operand words following it (0 or 1)
+ * - mode: where its data comes from
+ * - accesses: reads and writes of memory other than its own words (Int and IRet move the
+ *   six words of the saved context)
+ * - sources, results: Register bits of the registers it reads and writes
+ * - branch: may continue somewhere other than the next instruction
+ */
+struct Opcode {
+    int code;
+    const char* name;
+    int operands;
+    AddressingMode mode;
+    int accesses;
+    unsigned char sources;
+    unsigned char results;
+    bool branch;
+};
+
+//Instruction set as listed in the README, End last
+inline constexpr Opcode OPCODES[] = {
+    {1, "Load", 1, IMMEDIATE, 0, 0, REG_AC, false},
+    {2, "LoadAddr", 1, ABSOLUTE, 1, 0, REG_AC, false},
+    {3, "LoadInd", 1, INDIRECT, 2, 0, REG_AC, false},
+    {4, "LoadIdxX", 1, INDEXED_X, 1, REG_X, REG_AC, false},
+    {5, "LoadIdxY", 1, INDEXED_Y, 1, REG_Y, REG_AC, false},
+    {6, "LoadSpX", 0, STACK_INDEXED, 1, REG_SP | REG_X, REG_AC, false},
+    {7, "Store", 1, ABSOLUTE, 1, REG_AC, 0, false},
+    {8, "Get", 0, IMPLIED, 0, 0, REG_AC, false},
+    {9, "Put", 1, IMMEDIATE, 0, REG_AC, 0, false},
+    {10, "AddX", 0, IMPLIED, 0, REG_AC | REG_X, REG_AC, false},
+    {11, "AddY", 0, IMPLIED, 0, REG_AC | REG_Y, REG_AC, false},
+    {12, "SubX", 0, IMPLIED, 0, REG_AC | REG_X, REG_AC, false},
+    {13, "SubY", 0, IMPLIED, 0, REG_AC | REG_Y, REG_AC, false},
+    {14, "CopyToX", 0, IMPLIED, 0, REG_AC, REG_X, false},
+    {15, "CopyFromX", 0, IMPLIED, 0, REG_X, REG_AC, false},
+    {16, "CopyToY", 0, IMPLIED, 0, REG_AC, REG_Y, false},
+    {17, "CopyFromY", 0, IMPLIED, 0, REG_Y, REG_AC, false},
+    {18, "CopyToSp", 0, IMPLIED, 0, REG_AC, REG_SP, false},
+    {19, "CopyFromSp", 0, IMPLIED, 0, REG_SP, REG_AC, false},
+    {20, "Jump", 1, ABSOLUTE, 0, 0, 0, true},
+    {21, "JumpIfEqual", 1, ABSOLUTE, 0, REG_AC, 0, true},
+    {22, "JumpIfNotEqual", 1, ABSOLUTE, 0, REG_AC, 0, true},
+    {23, "Call", 1, ABSOLUTE, 1, REG_SP, REG_SP, true},
+    {24, "Ret", 0, STACK, 1, REG_SP, REG_SP, true},
+    {25, "IncX", 0, IMPLIED, 0, REG_X, REG_X, false},
+    {26, "DecX", 0, IMPLIED, 0, REG_X, REG_X, false},
+    {27, "Push", 0, STACK, 1, REG_AC | REG_SP, REG_SP, false},
+    {28, "Pop", 0, STACK, 1, REG_SP, REG_AC | REG_SP, false},
+    {29, "Int", 0, STACK, 6, REG_ALL, REG_SP, true},
+    {30, "IRet", 0, STACK, 6, REG_SP, REG_ALL, true},
+    {31, "Read", 1, IMMEDIATE, 0, 0, REG_AC, false},
+    {50, "End", 0, IMPLIED, 0, 0, 0, false},
+};
+inline constexpr int OPCODE_COUNT = sizeof(OPCODES) / sizeof(OPCODES[0]);
+
+//Largest instruction word
+inline constexpr int MAX_OPCODE = 50;
+
+/*
+ * OpcodeIndex: Position of every instruction word in OPCODES, -1 for invalid words
+ */
+struct OpcodeIndex {
+    int at[MAX_OPCODE + 1];
+};
+
+constexpr OpcodeIndex makeOpcodeIndex(){
+    OpcodeIndex index = {};
+    for(int code = 0; code <= MAX_OPCODE; code++){
+        index.at[code] = -1;
+    }
+    for(int i = 0; i < OPCODE_COUNT; i++){
+        index.at[OPCODES[i].code] = i;
+    }
+    return index;
+}
+
+inline constexpr OpcodeIndex OPCODE_INDEX = makeOpcodeIndex();
+
+/*
+ * Function: findOpcode
+ * --------------------
+ * Looks up an instruction word, at compile time if the word is a constant.
+ * Parameters:
+ * - code: the instruction word
+ * Returns:
+ * Its table entry, or NULL for an invalid instruction.
+ */
+constexpr const Opcode* findOpcode(int code){
+    if(code < 0 || code > MAX_OPCODE || OPCODE_INDEX.at[code] < 0){
+        return nullptr;
+    }
+    return &OPCODES[OPCODE_INDEX.at[code]];
+}
+
+/*
+ * Function: hasOperand
+ * --------------------
+ * Returns:
+ * true if the instruction is followed by an operand word.
+ */
+constexpr bool hasOperand(int code){
+    return findOpcode(code) != nullptr && findOpcode(code)->operands > 0;
+}
+
+/*
+ * Function: addressOperand
+ * ------------------------
+ * Returns:
+ * true if the operand of the instruction is an address, which moves when code moves.
+ */
+constexpr bool addressOperand(const Opcode& op){
+    return op.operands > 0 && op.mode != IMMEDIATE;
+}
+
+/*
+ * Function: dataLoad
+ * ------------------
+ * Returns:
+ * true if the instruction loads AC from the data address of its addressing mode (LoadAddr to LoadSpX).
+ */
+constexpr bool dataLoad(const Opcode& op){
+    return op.accesses > 0 && op.mode != STACK && op.results == REG_AC;
+}
+
+/*
+ * Function: dataStore
+ * -------------------
+ * Returns:
+ * true if the instruction stores AC at the data address of its addressing mode (Store).
+ */
+constexpr bool dataStore(const Opcode& op){
+    return op.accesses > 0 && op.mode != STACK && op.results == 0;
+}
+
+/*
+ * Function: registerTransfer
+ * --------------------------
+ * Returns:
+ * true if the instruction only computes registers from registers (AddX to CopyFromSp, IncX, DecX).
+ */
+constexpr bool registerTransfer(const Opcode& op){
+    return op.mode == IMPLIED && op.sources != 0;
+}
+
+/*
+ * Function: transfer
+ * ------------------
+ * Executes register transfer instruction CODE on the registers of any engine. WORD is int, or
+ * a vector of the registers of several instances for the lockstep engine.
+ */
+template<int CODE, class WORD>
+inline void transfer(WORD& AC, WORD& X, WORD& Y, WORD& SP){
+    static_assert(registerTransfer(*findOpcode(CODE)), "not a register transfer");
+    if constexpr(CODE == 10) AC += X;
+    else if constexpr(CODE == 11) AC += Y;
+    else if constexpr(CODE == 12) AC -= X;
+    else if constexpr(CODE == 13) AC -= Y;
+    else if constexpr(CODE == 14) X = AC;
+    else if constexpr(CODE == 15) AC = X;
+    else if constexpr(CODE == 16) Y = AC;
+    else if constexpr(CODE == 17) AC = Y;
+    else if constexpr(CODE == 18) SP = AC;
+    else if constexpr(CODE == 19) AC = SP;
+    else if constexpr(CODE == 25) X += 1;
+    else if constexpr(CODE == 26) X -= 1;
+}
+
+/*
+ * Function: disassemble
+ * ---------------------
+ * Parameters:
+ * - code: an instruction word
+ * - operand: the word following it
+ * Returns:
+ * The instruction in assembler syntax, e.g. "LoadIdxX 700", or "?" for an invalid word.
+ */
+inline string disassemble(int code, int operand){
+    const Opcode* op = findOpcode(code);
+    if(op == nullptr){
+        return "?";
+    }
+    return op->operands > 0 ? string(op->name) + " " + to_string(operand) : string(op->name);
+}
+
+static_assert(findOpcode(6)->operands == 0, "LoadSpX takes no operand");
+static_assert(findOpcode(50) == &OPCODES[OPCODE_COUNT - 1], "End is the last instruction");
+static_assert(findOpcode(0) == nullptr && findOpcode(32) == nullptr, "0 and 32 to 49 are invalid");
+static_assert(dataLoad(*findOpcode(2)) && dataLoad(*findOpcode(6)) && !dataLoad(*findOpcode(28)), "loads are 2 to 6");
+static_assert(dataStore(*findOpcode(7)) && !dataStore(*findOpcode(23)) && !dataStore(*findOpcode(27)), "Store is 7");
+static_assert(registerTransfer(*findOpcode(10)) && registerTransfer(*findOpcode(26)) && !registerTransfer(*findOpcode(8)),
+              "register transfers are 10 to 19, 25 and 26");
+
+#endif
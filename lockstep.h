@@ -0,0 +1,1440 @@
+/*
+    Program: Computer Simulator
+    File:    lockstep.h
+    Author:  Stanton Brown
+
+    Desription:
+    Lockstep engine for parameter sweeps: runs many instances of one program that differ only
+    in their timer value and Get seed, all in one process.
+
+    The registers of the instances are kept as structure-of-arrays, one array per register.
+    Instances at the same PC in the same mode form a group, which executes each instruction
+    once for all of its members: the instruction and its operand are fetched once, and the
+    register, memory, stack and control instructions are loops over the members. A group
+    persists from step to step. It splits only when its members diverge: a conditional jump
+    or Ret that goes different ways, an interrupt, a fault or the end of an instance. The
+    scheduler runs the group with the lowest PC, so groups that fell behind catch up with the
+    others, and two groups that reach the same PC merge. Groups in a handler run after the
+    user mode groups: instances whose timers fire at different times wait at the handler and
+    run it together.
+
+    The cycle and timer ticks of a group's members are counted lazily. A group knows how many
+    steps it can take before a member's timer fires or a member reaches the cycle limit, and
+    only then looks at the members one by one.
+
+    Groups are kept in the order they run, so the scheduler runs the first group and only
+    compares it with the next one after each step. A group of consecutive instances runs its
+    register instructions, address calculations and branch tests LANES instances at a time
+    as SIMD vectors.
+
+    Memory is divided into pages that all instances share with the loaded program until an
+    instance writes one, at which point the instance gets its own copy (copy-on-write). Each
+    group knows which pages any of its members has copied, so a fetch or load from a page that
+    is still shared reads the image once for the whole group.
+
+    The CPU's interrupt handling is recursive (a handler runs inside the instruction that
+    entered it), which cannot be shared between instances. Here it is kept per instance as
+    an explicit stack of the interrupts being handled, so every instance behaves exactly like
+    a run of the predecoded engine with the same timer and seed: the same output, exit status,
+    error messages and final state.
+
+    LockstepSweep splits a sweep into shards of consecutive instances, each run by its own
+    engine on its own thread.
+*/
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+
+#include "memory.h"
+#include "stream.h"
+#include "isa.h"
+#include "interpreter.h"
+
+using namespace std;
+
+
+/*
+ * LockstepEngine: Many instances of one program executed together
+ * ---------------------------------------------------------------
+ */
+class LockstepEngine : private Interpreter {
+
+public:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    //Words per copy-on-write page
+    static const int PAGE_SIZE = 100;
+    static const int PAGES = MEMORY_SIZE / PAGE_SIZE;
+    static_assert(PAGES <= 32, "the pages of an instance are a bit mask");
+
+    //Exit status of an instance stopped by the cycle limit, as in project1.cpp
+    static const int CYCLE_LIMIT_EXIT = 3;
+
+    //Settings shared by every instance
+    long long cycleLimit;
+    AccessMap access;
+    int faultVector;
+
+    //File read by instruction 31, NULL for an empty stream
+    const InputFile* input;
+
+    //Number of the first instance in the whole sweep, for its file names and report line
+    int first;
+
+private:
+    int count;
+
+    //Registers, one entry per instance
+    vector<int> PC, SP, IR, AC, X, Y;
+    vector<int> timer, timeConstraint, operand;
+    vector<long long> cycles;
+    vector<int> kernelMode, interruptEnabled;
+
+    //Interrupts being handled by each instance, innermost last, and the fault its handler reports
+    vector<vector<char> > origins;
+    vector<int> depth;
+    vector<int> faultCode, faultAddress;
+
+    //Per instance results
+    vector<int> running;
+    vector<int> status;
+    vector<string> output, errors;
+
+    //Per instance Get generators, the same sequence as srand(seed) and rand()
+    vector<random_data> generators;
+    vector<char> generatorStates;
+
+    //Per instance positions in the input stream
+    vector<InputStream> inputs;
+
+    //The loaded program, and each instance's page table pointing into it or at its own copies
+    vector<int> image;
+    vector<int*> pages;
+    vector<int*> copies;
+
+    //Pages each instance has its own copy of, one bit per page
+    vector<unsigned int> privatePages;
+
+    //Cycle count at which each instance in a group next has its timer fire or reaches the cycle limit
+    vector<long long> deadline;
+
+    //Instances at the same PC in the same mode, executed together
+    struct Group {
+        vector<int> members;        //instance numbers, ascending
+        int pc;
+        int kernel;
+        unsigned int privatePages;  //pages any member has its own copy of
+        long long pending;          //steps whose cycle and timer ticks the members have not counted
+        long long budget;           //steps left before a member's timer fires or it reaches the cycle limit
+        int ir;                     //instruction of the last pending step, -1 if none
+    };
+
+    //The schedule: groups in the order they run, by key(), at most one per PC and mode
+    vector<Group> groups;
+
+    //The members of a group by position; the members of a dense group are consecutive instances
+    template<bool DENSE>
+    struct Members {
+        const int* list;
+        int first;
+
+        int operator[](int k) const {
+            return DENSE ? first + k : list[k];
+        }
+    };
+
+    //Per member addresses of the instruction being executed
+    vector<int> addresses;
+
+    //Registers of LANES consecutive instances, which the compiler executes as SIMD instructions
+    //(SSE2 on any x86-64); dense groups run their member loops LANES members at a time
+    static const int LANES = 4;
+    typedef int Lanes __attribute__((vector_size(LANES * sizeof(int))));
+
+    //Register transfer instruction executed for the members of a group
+    template<bool DENSE>
+    using MemberTransfer = void (*)(Members<DENSE>, int, int*, int*, int*, int*);
+
+    //Instances entering the timer handler at a step
+    vector<int> entering;
+
+    //One instance as the CPU the interpreter executes
+    struct Instance {
+        LockstepEngine& engine;
+        int i;
+        int &PC, &SP, &IR, &AC, &X, &Y, &operand;
+        int &kernelMode, &interruptEnabled;
+        random_data& generator;
+        string &output, &errors;
+        InputStream& stream;
+
+        Instance(LockstepEngine& engine, int i) : engine(engine), i(i),
+        PC(engine.PC[i]), SP(engine.SP[i]), IR(engine.IR[i]), AC(engine.AC[i]), X(engine.X[i]), Y(engine.Y[i]),
+        operand(engine.operand[i]), kernelMode(engine.kernelMode[i]), interruptEnabled(engine.interruptEnabled[i]),
+        generator(engine.generators[i]), output(engine.output[i]), errors(engine.errors[i]), stream(engine.inputs[i]) {}
+
+        bool fetchOperand(){ return engine.fetchOperand(i); }
+        bool load(int address, int& value, unsigned char kind){ return engine.load(i, address, value, kind); }
+        bool writeMemory(int address, int data){ return engine.write(i, address, data); }
+        bool push(int data){ return engine.push(i, data); }
+        bool pop(int& data){ return engine.pop(i, data); }
+        bool interrupt(Origin origin){ return engine.interrupt(i, origin); }
+
+        void end(){
+            engine.running[i] = 0;
+            engine.status[i] = 0;
+        }
+
+        void invalidInstruction(){
+            engine.halt(i, 1, "ERROR: Invalid instruction: " + to_string(IR) + "\n");
+        }
+    };
+
+public:
+
+    /*
+     * Constructor: LockstepEngine
+     * ---------------------------
+     * Creates one instance per (timer, seed) pair, all running the program in memory.
+     * Parameters:
+     * - memory: the loaded program
+     * - timers: timer value of each instance
+     * - seeds: Get seed of each instance
+     */
+    LockstepEngine(Memory& memory, const vector<int>& timers, const vector<unsigned int>& seeds) :
+    cycleLimit(0), faultVector(-1), input(NULL), first(0), count(timers.size()),
+    PC(count, 0), SP(count, 1000), IR(count, 0), AC(count, 0), X(count, 0), Y(count, 0),
+    timer(timers.size(), 0), timeConstraint(timers), operand(count, 0), cycles(count, 0),
+    kernelMode(count, 0), interruptEnabled(count, 1), origins(count), depth(count, 0),
+    faultCode(count, 0), faultAddress(count, 0), running(count, 1), status(count, 0),
+    output(count), errors(count), generators(count), generatorStates(count * 128),
+    image(memory.words(), memory.words() + MEMORY_SIZE), pages(count * PAGES), privatePages(count, 0),
+    deadline(count, 0), addresses(count) {
+        for(int i = 0; i < count; i++){
+            memset(&generators[i], 0, sizeof(random_data));
+            initstate_r(seeds[i], &generatorStates[i * 128], 128, &generators[i]);
+            for(int p = 0; p < PAGES; p++){
+                pages[i * PAGES + p] = &image[p * PAGE_SIZE];
+            }
+        }
+    }
+
+    ~LockstepEngine(){
+        for(size_t i = 0; i < copies.size(); i++){
+            delete[] copies[i];
+        }
+    }
+
+    /*
+     * Function: run
+     * -------------
+     * Runs every instance until it ends.
+     * Returns:
+     * The number of steps, each executing one instruction for a group of instances.
+     */
+    long long run(){
+        long long steps = 0;
+        inputs.assign(count, InputStream(input));
+        groups.clear();
+        if(count > 0){
+            Group all;
+            for(int i = 0; i < count; i++){
+                all.members.push_back(i);
+            }
+            all.pc = 0;
+            all.kernel = 0;
+            prepare(all);
+            groups.push_back(all);
+        }
+
+        while(!groups.empty()){
+            //The first group runs next: the lowest PC, groups in a handler last.
+            //Members whose timer fires or that reach the cycle limit leave the group first,
+            //the others then continue together
+            if(groups[0].budget <= 0 && (unsigned)groups[0].pc < (unsigned)MEMORY_SIZE){
+                interruptMembers(0);
+                steps++;
+                continue;
+            }
+            const vector<int>& members = groups[0].members;
+            long long executed = members.back() - members.front() + 1 == (int)members.size() ?
+                                 executeGroup<true>(0) : executeGroup<false>(0);
+            if(executed == 0){
+                stepMembers(0);
+                executed = 1;
+            }
+            steps += executed;
+        }
+        return steps;
+    }
+
+    /*
+     * Function: report
+     * ----------------
+     * Writes each instance's standard output and error to PREFIX.K.out and PREFIX.K.err,
+     * and prints one summary line per instance, K numbering the instances from first.
+     * Parameters:
+     * - prefix: path prefix of the output files
+     * - seeds: Get seed of each instance
+     */
+    void report(const string& prefix, const vector<unsigned int>& seeds) const {
+        for(int i = 0; i < count; i++){
+            ofstream(prefix + "." + to_string(first + i) + ".out", ios::trunc) << output[i];
+            ofstream(prefix + "." + to_string(first + i) + ".err", ios::trunc) << errors[i];
+            cout << first + i << ' ' << timeConstraint[i] << ' ' << seeds[i] << ' ' << status[i] << ' '
+                 << cycles[i] << endl;
+        }
+    }
+
+    /*
+     * Function: dump
+     * --------------
+     * Writes the final state of every instance that ended with End or the cycle limit to
+     * FILE.K, in the format of --dump-state.
+     * Parameters:
+     * - fileName: state file prefix
+     */
+    void dump(const string& fileName) const {
+        for(int i = 0; i < count; i++){
+            string name = fileName + "." + to_string(first + i);
+            unlink(name.c_str());
+            if(status[i] != 0 && status[i] != CYCLE_LIMIT_EXIT){
+                continue;
+            }
+            ofstream out(name, ios::trunc);
+            out << "PC " << PC[i] << '\n' << "SP " << SP[i] << '\n' << "IR " << IR[i] << '\n'
+                << "AC " << AC[i] << '\n' << "X " << X[i] << '\n' << "Y " << Y[i] << '\n'
+                << "timer " << timer[i] << '\n' << "mode " << (kernelMode[i] ? "kernel" : "user") << '\n';
+            out << "memory" << '\n';
+            for(int a = 0; a < MEMORY_SIZE; a++){
+                if(word(i, a) != 0){
+                    out << a << ' ' << word(i, a) << '\n';
+                }
+            }
+        }
+    }
+
+private:
+
+    static long long key(const Group& group){
+        return (group.kernel ? (long long)1 << 32 : 0) + (long long)group.pc + ((long long)1 << 31);
+    }
+
+    static unsigned int pageBit(int address){
+        return 1u << (address / PAGE_SIZE);
+    }
+
+    /*
+     * Function: prepare
+     * -----------------
+     * Sets up a group whose members have counted all their steps: the pages they have copied
+     * and the steps the group can take before one of them needs to be looked at on its own.
+     */
+    void prepare(Group& group){
+        group.privatePages = 0;
+        group.pending = 0;
+        group.budget = LLONG_MAX;
+        group.ir = -1;
+        for(size_t k = 0; k < group.members.size(); k++){
+            int i = group.members[k];
+            long long steps = due(i);
+            deadline[i] = steps == LLONG_MAX ? LLONG_MAX : cycles[i] + steps;
+            group.privatePages |= privatePages[i];
+            group.budget = min(group.budget, steps);
+        }
+    }
+
+    /*
+     * Function: due
+     * -------------
+     * Returns:
+     * The steps an instance can take before its timer fires or it reaches the cycle limit,
+     * 0 when that happens at the next step.
+     */
+    long long due(int i) const {
+        long long steps = LLONG_MAX;
+        if(cycleLimit > 0){
+            steps = cycleLimit - cycles[i] - 1;
+        }
+        if(interruptEnabled[i]){
+            steps = min(steps, (long long)timeConstraint[i] - timer[i]);
+        }
+        return steps;
+    }
+
+    /*
+     * Function: sync
+     * --------------
+     * Counts a group's pending steps in its members' cycles and timers, and gives them the
+     * group's PC and the last instruction it executed.
+     */
+    void sync(Group& group){
+        long long pending = group.pending;
+        for(size_t k = 0; k < group.members.size(); k++){
+            int i = group.members[k];
+            cycles[i] += pending;
+            timer[i] += pending;
+            PC[i] = group.pc;
+            if(group.ir >= 0){
+                IR[i] = group.ir;
+            }
+        }
+        group.pending = 0;
+        group.ir = -1;
+    }
+
+    /*
+     * Function: position
+     * ------------------
+     * Returns:
+     * The index of the first group in the schedule whose key is not below k.
+     */
+    size_t position(long long k) const {
+        size_t low = 0;
+        size_t high = groups.size();
+        while(low < high){
+            size_t middle = (low + high) / 2;
+            if(key(groups[middle]) < k){
+                low = middle + 1;
+            }
+            else{
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    /*
+     * Function: schedule
+     * ------------------
+     * Adds a prepared group, merging it into the group already at its PC and mode if there is one.
+     */
+    void schedule(Group& group){
+        size_t at = position(key(group));
+        if(at < groups.size() && key(groups[at]) == key(group)){
+            merge(groups[at], group);
+            return;
+        }
+        groups.insert(groups.begin() + at, move(group));
+    }
+
+    /*
+     * Function: merge
+     * ---------------
+     * Adds the members of a group that has counted all its steps to the group at the same PC
+     * and mode. They take over the pending steps of the group they join, so that group does
+     * not need to be synchronized.
+     */
+    void merge(Group& into, const Group& group){
+        for(size_t j = 0; j < group.members.size(); j++){
+            int i = group.members[j];
+            cycles[i] -= into.pending;
+            timer[i] -= into.pending;
+            into.members.insert(upper_bound(into.members.begin(), into.members.end(), i), i);
+        }
+        into.privatePages |= group.privatePages;
+        into.budget = min(into.budget, group.budget);
+    }
+
+    /*
+     * Function: admit
+     * ---------------
+     * Adds an instance that has counted all its steps to a group, taking over the group's
+     * pending steps.
+     */
+    void admit(Group& group, int i){
+        long long steps = due(i);
+        deadline[i] = steps == LLONG_MAX ? LLONG_MAX : cycles[i] + steps;
+        group.budget = min(group.budget, steps);
+        group.privatePages |= privatePages[i];
+        cycles[i] -= group.pending;
+        timer[i] -= group.pending;
+        group.members.insert(upper_bound(group.members.begin(), group.members.end(), i), i);
+    }
+
+    /*
+     * Function: place
+     * ---------------
+     * Moves a group that has moved to a new PC or mode to its place in the schedule, and merges
+     * it with the group already there, if any. Groups usually move past only a few others.
+     */
+    void place(size_t index){
+        long long k = key(groups[index]);
+        while(index + 1 < groups.size() && key(groups[index + 1]) < k){
+            swap(groups[index], groups[index + 1]);
+            index++;
+        }
+        while(index > 0 && key(groups[index - 1]) > k){
+            swap(groups[index], groups[index - 1]);
+            index--;
+        }
+
+        size_t other = index;
+        if(index + 1 < groups.size() && key(groups[index + 1]) == k){
+            other = index + 1;
+        }
+        else if(index > 0 && key(groups[index - 1]) == k){
+            other = index - 1;
+        }
+        if(other == index){
+            return;
+        }
+
+        //The smaller group joins the larger one
+        size_t from = groups[other].members.size() < groups[index].members.size() ? other : index;
+        size_t into = from == index ? other : index;
+        sync(groups[from]);
+        merge(groups[into], groups[from]);
+        groups.erase(groups.begin() + from);
+    }
+
+    /*
+     * Function: regroup
+     * -----------------
+     * Replaces a group whose members have counted all their steps by groups of the members
+     * still running, one per PC and mode.
+     */
+    void regroup(size_t index){
+        //Drop the members that ended; usually the others all went to the same place
+        vector<int>& members = groups[index].members;
+        size_t kept = 0;
+        bool together = true;
+        for(size_t k = 0; k < members.size(); k++){
+            int i = members[k];
+            if(running[i]){
+                together &= kept == 0 || (PC[i] == PC[members[0]] && kernelMode[i] == kernelMode[members[0]]);
+                members[kept++] = i;
+            }
+        }
+        members.resize(kept);
+        if(kept == 0){
+            groups.erase(groups.begin() + index);
+            return;
+        }
+        if(together){
+            groups[index].pc = PC[members[0]];
+            groups[index].kernel = kernelMode[members[0]];
+            prepare(groups[index]);
+            place(index);
+            return;
+        }
+
+        vector<Group> parts;
+        for(size_t k = 0; k < kept; k++){
+            int i = members[k];
+            size_t p = 0;
+            while(p < parts.size() && (parts[p].pc != PC[i] || parts[p].kernel != kernelMode[i])){
+                p++;
+            }
+            if(p == parts.size()){
+                parts.push_back(Group());
+                parts[p].pc = PC[i];
+                parts[p].kernel = kernelMode[i];
+            }
+            parts[p].members.push_back(i);
+        }
+        groups.erase(groups.begin() + index);
+        for(size_t p = 0; p < parts.size(); p++){
+            prepare(parts[p]);
+            schedule(parts[p]);
+        }
+    }
+
+    /*
+     * Function: interruptMembers
+     * --------------------------
+     * Starts the instruction at the group's PC for the members whose timer fires or that reach
+     * the cycle limit: they count the cycle, then end or enter the timer handler as a new group.
+     * The other members stay in the group, which has not executed the instruction yet, and keep
+     * their pending steps. The group's private pages may now include pages no member has copied,
+     * which only costs a comparison of the members' words.
+     */
+    void interruptMembers(size_t index){
+        Group& group = groups[index];
+        vector<int>& members = group.members;
+        int pc = group.pc;
+        long long pending = group.pending;
+
+        entering.clear();
+        size_t kept = 0;
+        group.budget = LLONG_MAX;
+        for(size_t k = 0; k < members.size(); k++){
+            int i = members[k];
+            long long steps = deadline[i] - (cycles[i] + pending);
+            if(steps > 0){
+                members[kept++] = i;
+                group.budget = min(group.budget, steps);
+                continue;
+            }
+            cycles[i] += pending;
+            timer[i] += pending;
+            PC[i] = pc;
+            IR[i] = word(i, pc);
+            cycles[i]++;
+            if(cycles[i] == cycleLimit){
+                halt(i, CYCLE_LIMIT_EXIT, "ERROR: Cycle limit reached\n");
+            }
+            else if(interrupt(i, TIMER)){
+                entering.push_back(i);
+            }
+        }
+        members.resize(kept);
+        if(kept == 0){
+            groups.erase(groups.begin() + index);
+        }
+        if(entering.empty()){
+            return;
+        }
+
+        //Join the instances already waiting at the timer handler
+        Group entered;
+        entered.pc = 1000;
+        entered.kernel = 1;
+        size_t at = position(key(entered));
+        if(at < groups.size() && key(groups[at]) == key(entered)){
+            for(size_t j = 0; j < entering.size(); j++){
+                admit(groups[at], entering[j]);
+            }
+            return;
+        }
+        entered.members = entering;
+        prepare(entered);
+        groups.insert(groups.begin() + at, move(entered));
+    }
+
+    /*
+     * Function: stepMembers
+     * ---------------------
+     * Executes the instruction at the group's PC member by member, for the instructions the
+     * group cannot execute as a whole, then regroups the members by where they went.
+     */
+    void stepMembers(size_t index){
+        Group& group = groups[index];
+        sync(group);
+        for(size_t k = 0; k < group.members.size(); k++){
+            int i = group.members[k];
+            if((unsigned)PC[i] >= (unsigned)MEMORY_SIZE){
+                invalidAddress(i, PC[i]);
+                continue;
+            }
+            IR[i] = word(i, PC[i]);
+            cycles[i]++;
+            if(cycles[i] == cycleLimit){
+                halt(i, CYCLE_LIMIT_EXIT, "ERROR: Cycle limit reached\n");
+                continue;
+            }
+            if(interruptEnabled[i] && timer[i] >= timeConstraint[i]){
+                interrupt(i, TIMER);
+                continue;
+            }
+            timer[i]++;
+            finishInstruction(i, execute(i));
+        }
+        regroup(index);
+    }
+
+    /*
+     * Function: common
+     * ----------------
+     * Reads a valid address that may hold the same word for every member of a group.
+     * Returns:
+     * false if the members' words differ.
+     */
+    bool common(const Group& group, int address, int& value) const {
+        if((group.privatePages & pageBit(address)) == 0){
+            value = image[address];
+            return true;
+        }
+        const int* m = group.members.data();
+        int n = group.members.size();
+        value = word(m[0], address);
+        for(int k = 1; k < n; k++){
+            if(word(m[k], address) != value){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Function: accessible
+     * --------------------
+     * Returns:
+     * true if every member may access its entry of addresses without a fault.
+     */
+    bool accessible(const Group& group, unsigned char kind) const {
+        int n = group.members.size();
+        for(int k = 0; k < n; k++){
+            if((unsigned)addresses[k] >= (unsigned)MEMORY_SIZE || !access.allows(addresses[k], kind, group.kernel)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool accessible(const Group& group, int address, unsigned char kind) const {
+        return (unsigned)address < (unsigned)MEMORY_SIZE && access.allows(address, kind, group.kernel);
+    }
+
+    /*
+     * Function: gather
+     * ----------------
+     * Reads every member's entry of addresses into one of its registers.
+     */
+    template<bool DENSE>
+    void gather(const Group& group, int* registers){
+        Members<DENSE> m = {group.members.data(), group.members[0]};
+        int n = group.members.size();
+        if(group.privatePages == 0){
+            for(int k = 0; k < n; k++){ registers[m[k]] = image[addresses[k]]; }
+        }
+        else{
+            for(int k = 0; k < n; k++){ registers[m[k]] = word(m[k], addresses[k]); }
+        }
+    }
+
+    /*
+     * Function: executeGroup
+     * ----------------------
+     * Executes the instruction at the group's PC for all members at once, and the ones after it
+     * while the group is the only one left. An instruction is left to the members one by one
+     * when they could go separate ways inside it: when they do not share its code, or when an
+     * access would fault or leave memory for some of them.
+     * Parameters:
+     * - index: the group, which can take at least one more step
+     * Returns:
+     * The number of instructions executed, 0 if the members have to execute the first one on their own.
+     */
+    template<bool DENSE>
+    long long executeGroup(size_t index){
+        Group& group = groups[index];
+        Members<DENSE> m = {group.members.data(), group.members[0]};
+        int n = group.members.size();
+        int* ac = AC.data();
+        int* x = X.data();
+        int* y = Y.data();
+        int* sp = SP.data();
+        long long executed = 0;
+        static constexpr array<MemberTransfer<DENSE>, MAX_OPCODE + 1> transfers =
+            makeTransfers<DENSE>(make_integer_sequence<int, MAX_OPCODE + 1>());
+
+        while(true){
+            int pc = group.pc;
+            if((unsigned)pc >= (unsigned)(MEMORY_SIZE - 1)){
+                return executed;
+            }
+            int opcode = image[pc];
+            int value = image[pc + 1];
+            if((group.privatePages & (pageBit(pc) | pageBit(pc + 1))) != 0 &&
+               (!common(group, pc, opcode) || !common(group, pc + 1, value))){
+                return executed;
+            }
+            int next = pc + 1;
+
+            //Instructions that access memory first check that no member would fault or leave memory
+            switch(opcode){
+                case 1:
+                    fill<DENSE>(m, n, ac, value);
+                    next = pc + 2;
+                    break;
+                case 2: {
+                    if(!accessible(group, value, AccessMap::USER_DATA)) return executed;
+                    int data;
+                    if(common(group, value, data)){
+                        fill<DENSE>(m, n, ac, data);
+                    }
+                    else{
+                        for(int k = 0; k < n; k++){ ac[m[k]] = word(m[k], value); }
+                    }
+                    next = pc + 2;
+                    break;
+                }
+                case 3: {
+                    if(!accessible(group, value, AccessMap::USER_DATA)) return executed;
+                    int pointer;
+                    if(common(group, value, pointer)){
+                        fill<true>(Members<true>{NULL, 0}, n, addresses.data(), pointer);
+                    }
+                    else{
+                        for(int k = 0; k < n; k++){ addresses[k] = word(m[k], value); }
+                    }
+                    if(!accessible(group, AccessMap::USER_DATA)) return executed;
+                    gather<DENSE>(group, ac);
+                    next = pc + 2;
+                    break;
+                }
+                case 4:
+                case 5: {
+                    formAddresses<DENSE>(m, n, opcode == 4 ? x : y, NULL, value);
+                    if(!accessible(group, AccessMap::USER_DATA)) return executed;
+                    gather<DENSE>(group, ac);
+                    next = pc + 2;
+                    break;
+                }
+                case 6:
+                    formAddresses<DENSE>(m, n, sp, x, 0);
+                    if(!accessible(group, AccessMap::USER_DATA)) return executed;
+                    gather<DENSE>(group, ac);
+                    break;
+                case 7:
+                    if(!accessible(group, value, AccessMap::USER_DATA)) return executed;
+                    for(int k = 0; k < n; k++){ store(m[k], value, ac[m[k]]); }
+                    group.privatePages |= pageBit(value);
+                    next = pc + 2;
+                    break;
+                case 8:
+                    for(int k = 0; k < n; k++){
+                        int32_t random;
+                        random_r(&generators[m[k]], &random);
+                        ac[m[k]] = random % 100 + 1;
+                    }
+                    break;
+                case 9:
+                    for(int k = 0; k < n; k++){
+                        int i = m[k];
+                        if(value == 1){
+                            output[i] += to_string(ac[i]);
+                        }
+                        else if(value == 2){
+                            output[i] += char(ac[i]);
+                        }
+                        else{
+                            errors[i] += "Invalid operand for instruction 9..\n";
+                        }
+                    }
+                    next = pc + 2;
+                    break;
+                case 31:
+                    for(int k = 0; k < n; k++){
+                        if(!inputs[m[k]].read(value, ac[m[k]])){
+                            errors[m[k]] += "Invalid operand for instruction 31..\n";
+                        }
+                    }
+                    next = pc + 2;
+                    break;
+                case 20:
+                    next = value;
+                    break;
+                case 21:
+                case 22: {
+                    //Taken jumps go to the operand, the others skip it
+                    int zero = countZero<DENSE>(m, n, ac);
+                    int taken = opcode == 21 ? zero : n - zero;
+                    if(taken == n){
+                        next = value;
+                    }
+                    else if(taken == 0){
+                        next = pc + 2;
+                    }
+                    else{
+                        tick(group, opcode);
+                        sync(group);
+                        for(int k = 0; k < n; k++){ PC[m[k]] = (ac[m[k]] == 0) == (opcode == 21) ? value : pc + 2; }
+                        regroup(index);
+                        return executed + 1;
+                    }
+                    break;
+                }
+                case 23:
+                    formAddresses<DENSE>(m, n, sp, NULL, -1);
+                    if(!accessible(group, AccessMap::USER_STACK)) return executed;
+                    for(int k = 0; k < n; k++){
+                        int i = m[k];
+                        sp[i]--;
+                        store(i, sp[i], pc + 1);
+                        group.privatePages |= privatePages[i];
+                    }
+                    next = value;
+                    break;
+                case 24: {
+                    //Returns continue after the Call; members returning to different places split
+                    formAddresses<DENSE>(m, n, sp, NULL, 0);
+                    if(!accessible(group, AccessMap::USER_STACK)) return executed;
+                    bool same = true;
+                    for(int k = 0; k < n; k++){
+                        int i = m[k];
+                        addresses[k] = word(i, sp[i]) + 1;
+                        sp[i]++;
+                        same &= addresses[k] == addresses[0];
+                    }
+                    if(!same){
+                        tick(group, opcode);
+                        sync(group);
+                        for(int k = 0; k < n; k++){ PC[m[k]] = addresses[k]; }
+                        regroup(index);
+                        return executed + 1;
+                    }
+                    next = addresses[0];
+                    break;
+                }
+                case 27:
+                    formAddresses<DENSE>(m, n, sp, NULL, -1);
+                    if(!accessible(group, AccessMap::USER_STACK)) return executed;
+                    for(int k = 0; k < n; k++){
+                        int i = m[k];
+                        sp[i]--;
+                        store(i, sp[i], ac[i]);
+                        group.privatePages |= privatePages[i];
+                    }
+                    break;
+                case 28:
+                    formAddresses<DENSE>(m, n, sp, NULL, 0);
+                    if(!accessible(group, AccessMap::USER_STACK)) return executed;
+                    gather<DENSE>(group, ac);
+                    add<DENSE>(m, n, sp, 1);
+                    break;
+                case 29:
+                    //Every member enters the system call handler, except those that end saving their context
+                    tick(group, opcode);
+                    sync(group);
+                    for(int k = 0; k < n; k++){ interrupt(m[k], SYSCALL); }
+                    regroup(index);
+                    return executed + 1;
+                default:
+                    //Register transfers, from the instruction set table
+                    if((unsigned)opcode <= (unsigned)MAX_OPCODE && transfers[opcode] != NULL){
+                        transfers[opcode](m, n, ac, x, y, sp);
+                        break;
+                    }
+                    return executed;   //IRet, End and invalid instructions
+            }
+
+            tick(group, opcode);
+            group.pc = next;
+            executed++;
+
+            //Keep going while no other group is at the new PC or has to run first; the group
+            //was first in the schedule, so only the one after it needs to be looked at
+            if(group.budget <= 0 || (index + 1 < groups.size() && key(groups[index + 1]) <= key(group))){
+                place(index);
+                return executed;
+            }
+        }
+    }
+
+    /*
+     * Function: loadLanes, storeLanes
+     * -------------------------------
+     * Move the registers of LANES consecutive instances between their arrays and a vector.
+     */
+    static Lanes loadLanes(const int* registers){
+        Lanes lanes;
+        memcpy(&lanes, registers, sizeof(Lanes));
+        return lanes;
+    }
+
+    static void storeLanes(int* registers, Lanes lanes){
+        memcpy(registers, &lanes, sizeof(Lanes));
+    }
+
+    /*
+     * Function: fill
+     * --------------
+     * Sets every member's entry of registers to value.
+     */
+    template<bool DENSE>
+    static void fill(Members<DENSE> m, int n, int* registers, int value){
+        int k = 0;
+        if constexpr(DENSE){
+            registers += m.first;
+            Lanes lanes = Lanes{} + value;
+            for(; k + LANES <= n; k += LANES){ storeLanes(registers + k, lanes); }
+            for(; k < n; k++){ registers[k] = value; }
+        }
+        else{
+            for(; k < n; k++){ registers[m[k]] = value; }
+        }
+    }
+
+    /*
+     * Function: add
+     * -------------
+     * Adds delta to every member's entry of registers.
+     */
+    template<bool DENSE>
+    static void add(Members<DENSE> m, int n, int* registers, int delta){
+        int k = 0;
+        if constexpr(DENSE){
+            registers += m.first;
+            for(; k + LANES <= n; k += LANES){ storeLanes(registers + k, loadLanes(registers + k) + delta); }
+            for(; k < n; k++){ registers[k] += delta; }
+        }
+        else{
+            for(; k < n; k++){ registers[m[k]] += delta; }
+        }
+    }
+
+    /*
+     * Function: countZero
+     * -------------------
+     * Returns:
+     * The number of members whose entry of registers is 0.
+     */
+    template<bool DENSE>
+    static int countZero(Members<DENSE> m, int n, const int* registers){
+        int zero = 0;
+        int k = 0;
+        if constexpr(DENSE){
+            registers += m.first;
+            Lanes counts = {};
+            for(; k + LANES <= n; k += LANES){ counts -= loadLanes(registers + k) == 0; }
+            for(int l = 0; l < LANES; l++){ zero += counts[l]; }
+            for(; k < n; k++){ zero += registers[k] == 0; }
+        }
+        else{
+            for(; k < n; k++){ zero += registers[m[k]] == 0; }
+        }
+        return zero;
+    }
+
+    /*
+     * Function: formAddresses
+     * -----------------------
+     * Sets every member's entry of addresses to its base register plus offset, and plus its
+     * index register unless index is NULL.
+     */
+    template<bool DENSE>
+    void formAddresses(Members<DENSE> m, int n, const int* base, const int* index, int offset){
+        int* to = addresses.data();
+        int k = 0;
+        if constexpr(DENSE){
+            base += m.first;
+            if(index != NULL){
+                index += m.first;
+                for(; k + LANES <= n; k += LANES){ storeLanes(to + k, loadLanes(base + k) + loadLanes(index + k) + offset); }
+                for(; k < n; k++){ to[k] = base[k] + index[k] + offset; }
+            }
+            else{
+                for(; k + LANES <= n; k += LANES){ storeLanes(to + k, loadLanes(base + k) + offset); }
+                for(; k < n; k++){ to[k] = base[k] + offset; }
+            }
+        }
+        else{
+            for(; k < n; k++){ to[k] = base[m[k]] + (index != NULL ? index[m[k]] : 0) + offset; }
+        }
+    }
+
+    /*
+     * Function: transferMembers
+     * -------------------------
+     * Executes register transfer instruction CODE (isa.h) for every member, on the registers
+     * of LANES members at a time in a dense group.
+     */
+    template<int CODE, bool DENSE>
+    static void transferMembers(Members<DENSE> m, int n, int* ac, int* x, int* y, int* sp){
+        constexpr int results = findOpcode(CODE)->results;
+        int k = 0;
+        if constexpr(DENSE){
+            ac += m.first;
+            x += m.first;
+            y += m.first;
+            sp += m.first;
+            for(; k + LANES <= n; k += LANES){
+                Lanes a = loadLanes(ac + k), b = loadLanes(x + k), c = loadLanes(y + k), d = loadLanes(sp + k);
+                transfer<CODE>(a, b, c, d);
+                if constexpr((results & REG_AC) != 0) storeLanes(ac + k, a);
+                if constexpr((results & REG_X) != 0) storeLanes(x + k, b);
+                if constexpr((results & REG_Y) != 0) storeLanes(y + k, c);
+                if constexpr((results & REG_SP) != 0) storeLanes(sp + k, d);
+            }
+            for(; k < n; k++){ transfer<CODE>(ac[k], x[k], y[k], sp[k]); }
+        }
+        else{
+            for(; k < n; k++){
+                int i = m[k];
+                transfer<CODE>(ac[i], x[i], y[i], sp[i]);
+            }
+        }
+    }
+
+    /*
+     * Function: makeTransfers
+     * -----------------------
+     * Returns:
+     * transferMembers for every register transfer instruction word, NULL for the other words.
+     */
+    template<bool DENSE, int... CODES>
+    static constexpr array<MemberTransfer<DENSE>, MAX_OPCODE + 1> makeTransfers(integer_sequence<int, CODES...>){
+        return {{transferOf<CODES, DENSE>()...}};
+    }
+
+    template<int CODE, bool DENSE>
+    static constexpr MemberTransfer<DENSE> transferOf(){
+        constexpr const Opcode* op = findOpcode(CODE);
+        if constexpr(op != nullptr && registerTransfer(*op)){
+            return &transferMembers<CODE, DENSE>;
+        }
+        else{
+            return NULL;
+        }
+    }
+
+    /*
+     * Function: tick
+     * --------------
+     * Counts a step executed by a group, to be added to its members' cycles and timers later.
+     */
+    static void tick(Group& group, int opcode){
+        group.pending++;
+        group.budget--;
+        group.ir = opcode;
+    }
+
+    /*
+     * Function: word
+     * --------------
+     * Returns:
+     * The word at a valid address in an instance's memory.
+     */
+    int word(int i, int address) const {
+        return pages[i * PAGES + address / PAGE_SIZE][address % PAGE_SIZE];
+    }
+
+    /*
+     * Function: store
+     * ---------------
+     * Writes a word to a valid address, copying the page first if it is still shared.
+     */
+    void store(int i, int address, int data){
+        if((privatePages[i] & pageBit(address)) == 0){
+            copyPage(i, address);
+        }
+        pages[i * PAGES + address / PAGE_SIZE][address % PAGE_SIZE] = data;
+    }
+
+    void copyPage(int i, int address){
+        int*& page = pages[i * PAGES + address / PAGE_SIZE];
+        int* copy = new int[PAGE_SIZE];
+        memcpy(copy, page, PAGE_SIZE * sizeof(int));
+        copies.push_back(copy);
+        page = copy;
+        privatePages[i] |= pageBit(address);
+    }
+
+    /*
+     * Function: halt
+     * --------------
+     * Ends an instance.
+     * Parameters:
+     * - i: the instance
+     * - exitStatus: its exit status
+     * - message: text for its standard error
+     */
+    void halt(int i, int exitStatus, const string& message){
+        running[i] = 0;
+        status[i] = exitStatus;
+        errors[i] += message;
+    }
+
+    void invalidAddress(int i, int address){
+        halt(i, EXIT_FAILURE, "ERROR: Invalid memory address accessed: " + to_string(address) + "\nExiting...\n");
+    }
+
+    /*
+     * Function: interrupt
+     * -------------------
+     * Enters an interrupt handler: saves SP and PC on the system stack, then IR, AC, X and Y,
+     * and continues at the handler.
+     * Parameters:
+     * - i: the instance
+     * - origin: the interrupt
+     * Returns:
+     * false if the instance ended while saving its context.
+     */
+    bool interrupt(int i, Origin origin){
+        kernelMode[i] = 1;
+        int userSP = SP[i];
+        SP[i] = 2000;
+        if(!push(i, userSP) || !push(i, PC[i])){
+            return false;
+        }
+
+        interruptEnabled[i] = 0;
+        if(!push(i, IR[i]) || !push(i, AC[i]) || !push(i, X[i]) || !push(i, Y[i])){
+            return false;
+        }
+
+        origins[i].push_back(origin);
+        depth[i]++;
+        if(origin == TIMER){
+            timer[i] = 0;
+            PC[i] = 1000;
+        }
+        else if(origin == SYSCALL){
+            PC[i] = 1500;
+        }
+        else{
+            AC[i] = faultCode[i];
+            X[i] = faultAddress[i];
+            PC[i] = faultVector;
+        }
+        return true;
+    }
+
+    /*
+     * Function: finishInstruction
+     * ---------------------------
+     * Advances an instance past a completed instruction. At the top level and inside a handler
+     * that is still running this is PC++. When an IRet has left kernel mode, every handler being
+     * run returns in turn: a system call continues after its Int instruction, a timer interrupt
+     * executes the restored instruction, and a stack fault ends the program.
+     * Parameters:
+     * - i: the instance
+     * - outcome: what the instruction did
+     */
+    void finishInstruction(int i, Outcome outcome){
+        while(outcome == NEXT){
+            if(depth[i] == 0 || kernelMode[i]){
+                PC[i]++;
+                return;
+            }
+
+            Origin origin = (Origin)origins[i].back();
+            origins[i].pop_back();
+            depth[i]--;
+            if(origin == TIMER){
+                outcome = execute(i);
+            }
+            else if(origin == FAULT){
+                halt(i, 1, faultMessage(faultCode[i], faultAddress[i]));
+                return;
+            }
+        }
+    }
+
+    static string faultMessage(int fault, int address){
+        string message = string("ERROR: ") + AccessMap::describe((AccessMap::Fault)fault);
+        if(fault != AccessMap::PERMISSION_FAULT){
+            message += " at address " + to_string(address);
+        }
+        return message + "\nExiting...\n";
+    }
+
+    /*
+     * Function: permitted
+     * -------------------
+     * Checks an access against the access map, handling a refused one like the CPU does.
+     * Returns:
+     * false if the instance left the instruction: it ended, or entered the fault handler.
+     */
+    bool permitted(int i, int address, unsigned char kind){
+        return access.allows(address, kind, kernelMode[i]) || refuse(i, address, kind);
+    }
+
+    /*
+     * Function: refuse
+     * ----------------
+     * Handles an access the access map refuses.
+     * Returns:
+     * true if the access goes on to report an invalid address, false if the instance left the instruction.
+     */
+    bool refuse(int i, int address, unsigned char kind){
+        AccessMap::Fault fault = access.classify(address, kind, kernelMode[i]);
+        if(fault == AccessMap::NO_FAULT){
+            return true;    //the access reports the invalid address
+        }
+        if(fault != AccessMap::PERMISSION_FAULT && faultVector >= 0 && !kernelMode[i]){
+            faultCode[i] = fault;
+            faultAddress[i] = address;
+            interrupt(i, FAULT);
+            return false;
+        }
+        halt(i, 1, faultMessage(fault, address));
+        return false;
+    }
+
+    /*
+     * Function: load
+     * --------------
+     * Reads memory for an instruction, with the permission check for data and stack accesses.
+     * Parameters:
+     * - i: the instance
+     * - address: the address to read
+     * - value: receives the word
+     * - kind: AccessMap::USER_DATA or AccessMap::USER_STACK, 0 for operand fetches
+     * Returns:
+     * false if the instance left the instruction.
+     */
+    bool load(int i, int address, int& value, unsigned char kind){
+        if(kind != 0 && !permitted(i, address, kind)){
+            return false;
+        }
+        if((unsigned)address >= (unsigned)MEMORY_SIZE){
+            invalidAddress(i, address);
+            return false;
+        }
+        value = word(i, address);
+        return true;
+    }
+
+    bool write(int i, int address, int data){
+        if(!permitted(i, address, AccessMap::USER_DATA)){
+            return false;
+        }
+        if((unsigned)address >= (unsigned)MEMORY_SIZE){
+            invalidAddress(i, address);
+            return false;
+        }
+        store(i, address, data);
+        return true;
+    }
+
+    bool push(int i, int data){
+        SP[i]--;
+        if(!permitted(i, SP[i], AccessMap::USER_STACK)){
+            return false;
+        }
+        if((unsigned)SP[i] >= (unsigned)MEMORY_SIZE){
+            invalidAddress(i, SP[i]);
+            return false;
+        }
+        store(i, SP[i], data);
+        return true;
+    }
+
+    bool pop(int i, int& data){
+        if(!load(i, SP[i], data, AccessMap::USER_STACK)){
+            return false;
+        }
+        SP[i]++;
+        return true;
+    }
+
+    bool fetchOperand(int i){
+        PC[i]++;
+        return load(i, PC[i], operand[i], 0);
+    }
+
+    /*
+     * Function: execute
+     * -----------------
+     * Executes the instruction in IR for one instance with the interpreter shared with machine.h.
+     * Parameters:
+     * - i: the instance
+     * Returns:
+     * What the instruction did, as Interpreter::execute.
+     */
+    Outcome execute(int i){
+        Instance instance(*this, i);
+        return Interpreter::execute(instance);
+    }
+};
+
+
+/*
+ * LockstepSweep: A sweep split into shards, one lockstep engine and thread each
+ * ---------------------------------------------------------------------------
+ * Instances never share state, so each shard of consecutive instances runs on its own
+ * thread without synchronization until all are done. Instances only form groups within
+ * their shard.
+ */
+class LockstepSweep {
+
+public:
+    //Settings shared by every instance, as in LockstepEngine
+    long long cycleLimit;
+    AccessMap access;
+    int faultVector;
+    const InputFile* input;
+
+private:
+    vector<unique_ptr<LockstepEngine> > shards;
+    vector<vector<unsigned int> > shardSeeds;
+
+public:
+
+    /*
+     * Constructor: LockstepSweep
+     * --------------------------
+     * Creates one instance per (timer, seed) pair, split into shards of nearly equal size.
+     * Parameters:
+     * - memory: the loaded program
+     * - timers: timer value of each instance
+     * - seeds: Get seed of each instance
+     * - threads: number of shards, at most one per instance
+     */
+    LockstepSweep(Memory& memory, const vector<int>& timers, const vector<unsigned int>& seeds, int threads) :
+    cycleLimit(0), faultVector(-1), input(NULL) {
+        int count = timers.size();
+        threads = max(1, min(threads, count));
+        for(int t = 0; t < threads; t++){
+            int first = (long long)count * t / threads;
+            int last = (long long)count * (t + 1) / threads;
+            vector<int> shardTimers(timers.begin() + first, timers.begin() + last);
+            shardSeeds.push_back(vector<unsigned int>(seeds.begin() + first, seeds.begin() + last));
+            shards.push_back(unique_ptr<LockstepEngine>(new LockstepEngine(memory, shardTimers, shardSeeds.back())));
+            shards.back()->first = first;
+        }
+    }
+
+    /*
+     * Function: run
+     * -------------
+     * Runs every shard on its own thread, the first on the calling thread, until all instances end.
+     * Returns:
+     * The number of steps of all shards.
+     */
+    long long run(){
+        vector<long long> steps(shards.size(), 0);
+        vector<thread> threads;
+        for(size_t t = 0; t < shards.size(); t++){
+            shards[t]->cycleLimit = cycleLimit;
+            shards[t]->access = access;
+            shards[t]->faultVector = faultVector;
+            shards[t]->input = input;
+            if(t > 0){
+                threads.push_back(thread(runShard, shards[t].get(), &steps[t]));
+            }
+        }
+        runShard(shards[0].get(), &steps[0]);
+
+        long long total = steps[0];
+        for(size_t t = 1; t < shards.size(); t++){
+            threads[t - 1].join();
+            total += steps[t];
+        }
+        return total;
+    }
+
+    /*
+     * Function: report
+     * ----------------
+     * Writes each instance's output and prints the summary of every instance, as
+     * LockstepEngine::report.
+     * Parameters:
+     * - prefix: path prefix of the output files
+     */
+    void report(const string& prefix) const {
+        cout << "instance timer seed status cycles" << endl;
+        for(size_t t = 0; t < shards.size(); t++){
+            shards[t]->report(prefix, shardSeeds[t]);
+        }
+    }
+
+    void dump(const string& fileName) const {
+        for(size_t t = 0; t < shards.size(); t++){
+            shards[t]->dump(fileName);
+        }
+    }
+
+private:
+    static void runShard(LockstepEngine* engine, long long* steps){
+        *steps = engine->run();
+    }
+};
+
+#endif
@@ -0,0 +1,643 @@
+/*
+    Program: Computer Simulator
+    File:    machine.h
+    Author:  Stanton Brown
+
+    Desription:
+    Library API for embedding the simulator in another program, such as a test service that
+    runs many short programs. The engines of project1.cpp own their process: they print as they
+    go and call exit on End or on any error. A Machine is one simulated computer (CPU and
+    memory) that never does either:
+
+    - load() reads a program file or takes an image from the host, and reports a bad file
+      as an error message instead of exiting
+    - run(N) counts up to N cycles, or until End or a fault, and can be called again to
+      continue; like --max-cycles=N it stops with the instruction of the Nth cycle fetched but
+      not executed; it returns a Result saying whether the machine stopped, ended or faulted,
+      with the fault's kind, instruction, address and message
+    - Put output and the messages about invalid ports are collected in strings
+
+    The CPU keeps the interrupts it is handling as an explicit stack, as the lockstep engine
+    does, so a run can stop between any two instructions, including inside a handler, and
+    produce exactly the output, exit status and state of the other engines. Its instructions
+    are executed by the interpreter it shares with the lockstep engine (interpreter.h).
+
+    Memory is divided into pages of PAGE_SIZE words. Every store marks its page dirty, and
+    reset() copies only the dirty pages back from the loaded image before clearing the
+    registers, so reusing a machine costs as much as the program wrote, not a reload.
+    MachinePool hands out such machines for one program: release() resets a machine and keeps
+    it for the next acquire(). Machines share nothing they write, so different machines can
+    run on different threads at the same time.
+*/
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+
+#include "memory.h"
+#include "stream.h"
+#include "interpreter.h"
+
+using namespace std;
+
+
+/*
+ * Machine: One simulated computer for a host program
+ * --------------------------------------------------
+ */
+class Machine : private Interpreter {
+
+    friend struct Interpreter;
+
+public:
+    static constexpr int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    //Words per page tracked by reset()
+    static constexpr int PAGE_SIZE = 100;
+    static constexpr int PAGES = MEMORY_SIZE / PAGE_SIZE;
+
+    /*
+     * Status: Where a run left the machine
+     * - STOPPED: the cycle limit was reached, run() continues from here
+     * - ENDED: the program executed End
+     * - FAULTED: the program made an error, described by the fault
+     */
+    enum Status { STOPPED, ENDED, FAULTED };
+
+    //Fault kinds; the access faults have the values of AccessMap::Fault
+    enum FaultKind { NO_FAULT, PERMISSION_FAULT, STACK_OVERFLOW, STACK_UNDERFLOW, GUARD_FAULT,
+                     INVALID_ADDRESS, INVALID_INSTRUCTION };
+
+    /*
+     * Fault: An error that ended a program
+     */
+    struct Fault {
+        FaultKind kind;
+        int PC;             //address of the instruction making it
+        int instruction;    //that instruction's word
+        int address;        //address accessed, or the invalid instruction word
+
+        /*
+         * Function: message
+         * -----------------
+         * Returns:
+         * The error the other engines print for the fault, without "ERROR: ".
+         */
+        string message() const {
+            switch(kind){
+                case NO_FAULT:            return "";
+                case INVALID_ADDRESS:     return "Invalid memory address accessed: " + to_string(address);
+                case INVALID_INSTRUCTION: return "Invalid instruction: " + to_string(address);
+                case PERMISSION_FAULT:    return AccessMap::describe(AccessMap::PERMISSION_FAULT);
+                default:
+                    return string(AccessMap::describe((AccessMap::Fault)kind)) + " at address " + to_string(address);
+            }
+        }
+    };
+
+    /*
+     * Result: What a call of run() did
+     */
+    struct Result {
+        Status status;
+        long long cycles;   //cycles counted by this call
+        Fault fault;        //kind NO_FAULT unless the status is FAULTED
+    };
+
+    //Registers
+    int PC;
+    int SP;
+    int IR;
+    int AC;
+    int X;
+    int Y;
+    bool kernelMode;
+    int timer;
+    bool interruptEnabled;
+
+    //Cycles counted since the last reset
+    long long cycles;
+
+    //Settings, kept by reset(): timer constraint, Get seed, access map, stack fault handler
+    //(-1 for none) and the file read by instruction 31 (NULL for an empty stream)
+    int timeConstraint;
+    unsigned int seed;
+    AccessMap access;
+    int faultVector;
+    const InputFile* input;
+
+    //Put output, and the messages about invalid ports, since the last reset
+    string output;
+    string errors;
+
+private:
+    //The loaded program, shared by machines loaded from one another, and the working memory
+    shared_ptr<const vector<int> > image;
+    int memory[MEMORY_SIZE];
+
+    //Pages written since the last reset
+    bool dirty[PAGES];
+    vector<int> dirtyPages;
+
+    //Interrupts being handled, innermost last, and the stack fault a fault handler is handling
+    vector<char> origins;
+    int faultCode, faultAddress;
+
+    int operand;
+    int instructionPC;
+    Status status;
+
+    //The instruction in IR was fetched and counted by a run that stopped at its limit
+    bool fetched;
+    Fault fault;
+
+    //Get generator, the same sequence as srand(seed) and rand()
+    random_data generator;
+    char generatorState[128];
+
+    InputStream stream;
+
+public:
+
+    /*
+     * Constructor: Machine
+     * --------------------
+     * Creates a machine with empty memory; load() gives it a program.
+     * Parameters:
+     * - tCon: time constraint for timer interrupts
+     * - seed: seed of the numbers returned by Get
+     */
+    Machine(int tCon, unsigned int seed = 1) : timeConstraint(tCon), seed(seed), faultVector(-1), input(NULL),
+    image(make_shared<vector<int> >(MEMORY_SIZE, 0)) {
+        for(int p = 0; p < PAGES; p++){
+            dirty[p] = false;
+        }
+        memcpy(memory, image->data(), sizeof(memory));
+        reset();
+    }
+
+    //The generator points into the machine, so machines are not copied; see loadFrom
+    Machine(const Machine&) = delete;
+    Machine& operator=(const Machine&) = delete;
+
+    /*
+     * Function: load
+     * --------------
+     * Loads a program file (text or binary image) and resets the machine.
+     * Parameters:
+     * - fileName: the program file
+     * - error: receives the error message if the file cannot be loaded
+     * Returns:
+     * false if the file cannot be loaded; the machine keeps its program.
+     */
+    bool load(const char* fileName, string& error){
+        vector<int> words(MEMORY_SIZE, 0);
+        if(!Memory::load(fileName, words.data(), error)){
+            return false;
+        }
+        setImage(make_shared<vector<int> >(move(words)));
+        return true;
+    }
+
+    /*
+     * Function: load
+     * --------------
+     * Loads an image given by the host, starting at address 0, and resets the machine.
+     * Parameters:
+     * - words: the words of the image
+     * - count: the number of words, at most MEMORY_SIZE
+     * Returns:
+     * false if the image does not fit in memory.
+     */
+    bool load(const int* words, int count){
+        if(count < 0 || count > MEMORY_SIZE){
+            return false;
+        }
+        shared_ptr<vector<int> > loaded = make_shared<vector<int> >(MEMORY_SIZE, 0);
+        memcpy(loaded->data(), words, count * sizeof(int));
+        setImage(loaded);
+        return true;
+    }
+
+    /*
+     * Function: loadFrom
+     * ------------------
+     * Loads the program of another machine, sharing its image, takes its settings and resets.
+     * Parameters:
+     * - other: the machine to copy
+     */
+    void loadFrom(const Machine& other){
+        timeConstraint = other.timeConstraint;
+        seed = other.seed;
+        access = other.access;
+        faultVector = other.faultVector;
+        input = other.input;
+        setImage(other.image);
+    }
+
+    /*
+     * Function: reset
+     * ---------------
+     * Puts the machine back in its state right after load: the pages written since are copied
+     * back from the image, and the registers, output, Get sequence and input stream start over.
+     */
+    void reset(){
+        for(size_t i = 0; i < dirtyPages.size(); i++){
+            int p = dirtyPages[i];
+            memcpy(&memory[p * PAGE_SIZE], image->data() + p * PAGE_SIZE, PAGE_SIZE * sizeof(int));
+            dirty[p] = false;
+        }
+        dirtyPages.clear();
+
+        PC = 0;
+        SP = 1000;
+        IR = 0;
+        AC = 0;
+        X = 0;
+        Y = 0;
+        kernelMode = false;
+        timer = 0;
+        interruptEnabled = true;
+        cycles = 0;
+        output.clear();
+        errors.clear();
+        origins.clear();
+        faultCode = 0;
+        faultAddress = 0;
+        operand = 0;
+        instructionPC = 0;
+        status = STOPPED;
+        fetched = false;
+        fault = Fault{NO_FAULT, 0, 0, 0};
+
+        memset(&generator, 0, sizeof(generator));
+        initstate_r(seed, generatorState, sizeof(generatorState), &generator);
+        stream = InputStream(input);
+    }
+
+    /*
+     * Function: run
+     * -------------
+     * Counts cycles until the limit, End or a fault, with the cycle limit of the other engines:
+     * the instruction of the limit's cycle is fetched and counted, but not executed. A stopped
+     * machine continues where it stopped, executing that instruction first; an ended or faulted
+     * one stays as it is until reset.
+     * Parameters:
+     * - limit: the most cycles to count, 0 for no limit
+     * Returns:
+     * The status, the cycles counted and the fault.
+     */
+    Result run(long long limit){
+        long long start = cycles;
+        if(status == STOPPED && fetched){
+            fetched = false;
+            dispatch();
+        }
+        long long stopAt = limit > 0 ? start + limit : 0;
+        while(status == STOPPED && !fetched){
+            step(stopAt);
+        }
+        return Result{status, cycles - start, fault};
+    }
+
+    /*
+     * Function: state
+     * ---------------
+     * Returns:
+     * Where the last run left the machine.
+     */
+    Status state() const {
+        return status;
+    }
+
+    /*
+     * Function: read
+     * --------------
+     * Reads a word of memory for the host, 0 outside of memory.
+     */
+    int read(int address) const {
+        return (unsigned)address < (unsigned)MEMORY_SIZE ? memory[address] : 0;
+    }
+
+    /*
+     * Function: write
+     * ---------------
+     * Writes a word of memory for the host, e.g. a program's arguments; reset() undoes it.
+     * Returns:
+     * false outside of memory.
+     */
+    bool write(int address, int value){
+        if((unsigned)address >= (unsigned)MEMORY_SIZE){
+            return false;
+        }
+        store(address, value);
+        return true;
+    }
+
+    /*
+     * Function: words
+     * ---------------
+     * Returns:
+     * The memory, MEMORY_SIZE words.
+     */
+    const int* words() const {
+        return memory;
+    }
+
+private:
+
+    //Switches to another image: the whole memory is rewritten, then the machine is reset
+    void setImage(const shared_ptr<const vector<int> >& loaded){
+        image = loaded;
+        memcpy(memory, image->data(), sizeof(memory));
+        for(int p = 0; p < PAGES; p++){
+            dirty[p] = false;
+        }
+        dirtyPages.clear();
+        reset();
+    }
+
+    /*
+     * Function: step
+     * --------------
+     * Fetches the instruction at PC and counts the cycle. At the cycle of the limit the machine
+     * stops with the instruction in IR, otherwise it goes on to dispatch it.
+     * Parameters:
+     * - stopAt: the cycle count to stop at, 0 for none
+     */
+    void step(long long stopAt){
+        if((unsigned)PC >= (unsigned)MEMORY_SIZE){
+            instructionPC = PC;
+            stop(INVALID_ADDRESS, PC);
+            return;
+        }
+        instructionPC = PC;
+        IR = memory[PC];
+        cycles++;
+        if(cycles == stopAt){
+            fetched = true;
+            return;
+        }
+        dispatch();
+    }
+
+    //Takes a due timer interrupt or executes the fetched instruction
+    void dispatch(){
+        if(interruptEnabled && timer >= timeConstraint){
+            interrupt(TIMER);
+            return;
+        }
+        timer++;
+        finishInstruction(execute(*this));
+    }
+
+    //Ends the run with a fault
+    void stop(FaultKind kind, int address){
+        status = FAULTED;
+        fault = Fault{kind, instructionPC, (unsigned)instructionPC < (unsigned)MEMORY_SIZE ? memory[instructionPC] : 0,
+                      address};
+    }
+
+    //Writes a valid address, marking its page dirty
+    void store(int address, int data){
+        int p = address / PAGE_SIZE;
+        if(!dirty[p]){
+            dirty[p] = true;
+            dirtyPages.push_back(p);
+        }
+        memory[address] = data;
+    }
+
+    /*
+     * Function: interrupt
+     * -------------------
+     * Enters an interrupt handler: saves SP and PC on the system stack, then IR, AC, X and Y,
+     * and continues at the handler.
+     * Returns:
+     * false if the machine faulted while saving its context.
+     */
+    bool interrupt(Origin origin){
+        kernelMode = true;
+        int userSP = SP;
+        SP = 2000;
+        if(!push(userSP) || !push(PC)){
+            return false;
+        }
+
+        interruptEnabled = false;
+        if(!push(IR) || !push(AC) || !push(X) || !push(Y)){
+            return false;
+        }
+
+        origins.push_back(origin);
+        if(origin == TIMER){
+            timer = 0;
+            PC = 1000;
+        }
+        else if(origin == SYSCALL){
+            PC = 1500;
+        }
+        else{
+            AC = faultCode;
+            X = faultAddress;
+            PC = faultVector;
+        }
+        return true;
+    }
+
+    /*
+     * Function: finishInstruction
+     * ---------------------------
+     * Advances past a completed instruction. When an IRet has left kernel mode, every handler
+     * being run returns in turn: a system call continues after its Int instruction, a timer
+     * interrupt executes the restored instruction, and a stack fault ends the program.
+     */
+    void finishInstruction(Outcome outcome){
+        while(outcome == NEXT){
+            if(origins.empty() || kernelMode){
+                PC++;
+                return;
+            }
+
+            Origin origin = (Origin)origins.back();
+            origins.pop_back();
+            if(origin == TIMER){
+                instructionPC = PC;
+                outcome = execute(*this);
+            }
+            else if(origin == FAULT){
+                stop((FaultKind)faultCode, faultAddress);
+                return;
+            }
+        }
+    }
+
+    /*
+     * Function: permitted
+     * -------------------
+     * Checks an access against the access map, handling a refused one like the CPU does.
+     * Returns:
+     * false if the machine left the instruction: it faulted, or entered the fault handler.
+     */
+    bool permitted(int address, unsigned char kind){
+        if(access.allows(address, kind, kernelMode)){
+            return true;
+        }
+        AccessMap::Fault refused = access.classify(address, kind, kernelMode);
+        if(refused == AccessMap::NO_FAULT){
+            return true;    //the access reports the invalid address
+        }
+        if(refused != AccessMap::PERMISSION_FAULT && faultVector >= 0 && !kernelMode){
+            faultCode = refused;
+            faultAddress = address;
+            interrupt(FAULT);
+            return false;
+        }
+        stop((FaultKind)refused, address);
+        return false;
+    }
+
+    //Reads memory for an instruction; kind is AccessMap::USER_DATA or USER_STACK, 0 for operands
+    bool load(int address, int& value, unsigned char kind){
+        if(kind != 0 && !permitted(address, kind)){
+            return false;
+        }
+        if((unsigned)address >= (unsigned)MEMORY_SIZE){
+            stop(INVALID_ADDRESS, address);
+            return false;
+        }
+        value = memory[address];
+        return true;
+    }
+
+    bool writeMemory(int address, int data){
+        if(!permitted(address, AccessMap::USER_DATA)){
+            return false;
+        }
+        if((unsigned)address >= (unsigned)MEMORY_SIZE){
+            stop(INVALID_ADDRESS, address);
+            return false;
+        }
+        store(address, data);
+        return true;
+    }
+
+    bool push(int data){
+        SP--;
+        if(!permitted(SP, AccessMap::USER_STACK)){
+            return false;
+        }
+        if((unsigned)SP >= (unsigned)MEMORY_SIZE){
+            stop(INVALID_ADDRESS, SP);
+            return false;
+        }
+        store(SP, data);
+        return true;
+    }
+
+    bool pop(int& data){
+        if(!load(SP, data, AccessMap::USER_STACK)){
+            return false;
+        }
+        SP++;
+        return true;
+    }
+
+    bool fetchOperand(){
+        PC++;
+        return load(PC, operand, 0);
+    }
+
+    //End and an invalid instruction, for the interpreter
+    void end(){
+        status = ENDED;
+    }
+
+    void invalidInstruction(){
+        stop(INVALID_INSTRUCTION, IR);
+    }
+};
+
+
+/*
+ * MachinePool: Reusable machines running one program
+ * --------------------------------------------------
+ * The pool copies its prototype's program and settings into every machine it creates.
+ * A released machine is reset, restoring only the pages it dirtied, and handed out again,
+ * so a host making millions of short runs neither reloads the program nor allocates memory.
+ * The pool owns every machine it creates: they are freed with the pool, released or not.
+ * acquire() and release() may be called from different threads.
+ */
+class MachinePool {
+
+private:
+    const Machine& prototype;
+    vector<unique_ptr<Machine> > machines;
+    vector<Machine*> idle;
+    mutex lock;
+
+public:
+
+    /*
+     * Constructor: MachinePool
+     * ------------------------
+     * Parameters:
+     * - prototype: a loaded machine with the settings of the runs; it must outlive the pool
+     *   and not be changed while the pool is used
+     */
+    MachinePool(const Machine& prototype) : prototype(prototype) {}
+
+    /*
+     * Function: acquire
+     * -----------------
+     * Returns:
+     * A machine ready to run the program from the start, to be given back with release().
+     * It stays owned by the pool.
+     */
+    Machine* acquire(){
+        {
+            lock_guard<mutex> guard(lock);
+            if(!idle.empty()){
+                Machine* machine = idle.back();
+                idle.pop_back();
+                return machine;
+            }
+        }
+        unique_ptr<Machine> machine(new Machine(prototype.timeConstraint, prototype.seed));
+        machine->loadFrom(prototype);
+        Machine* created = machine.get();
+        lock_guard<mutex> guard(lock);
+        machines.push_back(move(machine));
+        return created;
+    }
+
+    /*
+     * Function: release
+     * -----------------
+     * Resets a machine from acquire() and keeps it for the next acquire().
+     */
+    void release(Machine* machine){
+        machine->reset();
+        lock_guard<mutex> guard(lock);
+        idle.push_back(machine);
+    }
+
+    /*
+     * Function: size
+     * --------------
+     * Returns:
+     * The number of machines the pool has created.
+     */
+    size_t size(){
+        lock_guard<mutex> guard(lock);
+        return machines.size();
+    }
+};
+
+#endif
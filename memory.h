@@ -0,0 +1,470 @@
+/*
+    Program: Computer Simulator
+    File:    memory.h
+    Author:  Stanton Brown
+
+    Desription:
+    Memory class shared by the simulator's execution engines and tools.
+    Initializes from a text program or binary image and provides read/write functionalities.
+
+    AccessMap is the protection side of the memory subsystem: one byte of access bits per
+    address saying who may touch it (user or kernel) and how (data or stack). The CPU checks
+    every data and stack access with a single lookup, so user/system separation, stack limits
+    and stack guard regions all cost the same as the original user/system check.
+*/
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include "image.h"
+#include "memprofile.h"
+
+using namespace std;
+
+
+/*
+ * Memory: Represents the computer's memory
+ * ----------------------------------------
+ * This class represents the memory of the computer.
+ * It includes functionalities to read and write data into memory.
+ * The memory size is fixed at 2000 and is initialized from an input file,
+ * either a text program or a binary image produced by the assembler.
+ */
+class Memory{
+
+public:
+    //Specifies the size of the memory
+    static const int MEMORY_SIZE = 2000;
+
+    //Access counters, NULL unless profiling is enabled
+    MemoryProfile* profile = NULL;
+
+private:
+    //Used to store user program and system memory
+    int memory[MEMORY_SIZE] = {};
+
+public:
+
+    /*
+     * Constructor: Memory
+     * ----------------
+     * Initializes the Memory by calling on the readInputFile function
+     * Parameters:
+     * - inputFile: the file that represents the program to be executed
+     */
+    Memory(const char* inputFile){
+        readInputFile(inputFile);
+
+    }
+
+    /*
+     * Function: readInputFile 
+     * -------------------
+     * Initializes the memory with data from the input file, exiting if it cannot be loaded.
+     * Parameters:
+     * - fileName: the name of the input file containing initial memory data.
+     */
+    void readInputFile(const char* fileName){
+        string error;
+        if(!load(fileName, memory, error)){
+            cerr << error << endl;
+            exit(1);
+        }
+    }
+
+    /*
+     * Function: load 
+     * --------------
+     * Reads a program file into an array of words without exiting, for hosts embedding the simulator.
+     * Binary images (see image.h) are copied directly into the words,
+     * anything else is read as a text program and populates the words accordingly.
+     * Parameters:
+     * - fileName: the name of the input file containing initial memory data.
+     * - words: MEMORY_SIZE words, zero where the program defines nothing.
+     * - error: receives the error message when the file cannot be loaded.
+     * Returns:
+     * false if the file cannot be loaded.
+     */
+    static bool load(const char* fileName, int* words, string& error){
+        ifstream inputFile(fileName, ios::binary);
+        if(!inputFile.is_open()){
+            error = "ERROR: unable to open the input file";
+            return false;
+        }
+
+        //Check for a binary image before parsing as text
+        ImageHeader header;
+        if(inputFile.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+           memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0){
+            return readImage(inputFile, header, words, error);
+        }
+
+        //Not an image, start over as a text program
+        inputFile.clear();
+        inputFile.seekg(0);
+
+        string line;
+        int memoryIndex = 0;
+
+        //Loop through the entire file line by line
+        while (getline(inputFile, line)) {
+            istringstream iss(line);
+            //Check if we are loading to a new address
+            if (iss.peek() == '.'){
+                int newIndex;
+                iss.ignore();
+
+                //read in the new index ignoring space
+                while(iss >> newIndex){
+                    if (iss.peek() == ' ') {
+                        iss.ignore();
+                    }
+                    else {
+                        break; 
+                    }
+                }
+
+                //set new memory index and continue
+                memoryIndex = newIndex;
+                continue;
+            }
+
+            //Read instruction into memory while ignoring space 
+            int value;
+            while (iss >> value) { 
+                if (memoryIndex < 0 || memoryIndex >= MEMORY_SIZE) {
+                    error = "ERROR: Program does not fit in memory at address: " + to_string(memoryIndex);
+                    return false;
+                }
+                words[memoryIndex] = value;
+                ++memoryIndex;
+                if (iss.peek() == ' ') {
+                    iss.ignore(); 
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        inputFile.close(); 
+        return true;
+    }
+
+    /*
+     * Function: readImage 
+     * -------------------
+     * Copies the words of a binary memory image into memory.
+     * Parameters:
+     * - inputFile: the open image, positioned just past the header.
+     * - header: the header already read from the image.
+     * - words: MEMORY_SIZE words receiving the image.
+     * - error: receives the error message when the image is invalid.
+     * Returns:
+     * false if the image is invalid.
+     */
+    static bool readImage(ifstream& inputFile, const ImageHeader& header, int* words, string& error){
+        if(header.version != IMAGE_VERSION){
+            error = "ERROR: Unsupported image version: " + to_string(header.version);
+            return false;
+        }
+        if(header.words > (uint32_t)MEMORY_SIZE){
+            error = "ERROR: Image of " + to_string(header.words) + " words does not fit in memory";
+            return false;
+        }
+
+        //Words follow the header directly, in the same layout as the memory array
+        if(!inputFile.read(reinterpret_cast<char*>(words), header.words * sizeof(int))){
+            error = "ERROR: Image is truncated";
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Function: read 
+     * -------------
+     * Reads data from memory at the specified address.
+     * Parameters:
+     * - address: the memory address to read from.
+     * Returns:
+     * The value stored at the specified memory address.
+     */
+    int read(int address) const {
+        if (address < 0 || address >= MEMORY_SIZE) {
+            cerr << "ERROR: Invalid memory address accessed: " << address << endl;
+            cerr << "Exiting..." << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        if(profile != NULL){
+            profile->read(address);
+        }
+
+        return memory[address];
+    }
+
+    /*
+     * Function: write 
+     * --------------
+     * Writes data to memory at the specified address.
+     * Parameters:
+     * - address: the memory address to write to.
+     * - data: the data to be written to memory.
+     */
+    void write(int address, int data) {
+        if (address < 0 || address >= MEMORY_SIZE) {
+            cerr << "ERROR: Invalid memory address accessed: " << address << endl;
+            cerr << "Exiting..." << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        if(profile != NULL){
+            profile->write(address);
+        }
+
+        memory[address] = data;
+    }
+
+    /*
+     * Function: noteStackPointer
+     * --------------------------
+     * Tells the profile how deep a stack has grown.
+     * The CPU calls this after every push.
+     * Parameters:
+     * - SP: the stack pointer after the push.
+     * - kernelMode: whether the CPU pushed in kernel mode, onto the system stack.
+     */
+    void noteStackPointer(int SP, bool kernelMode){
+        if(profile != NULL){
+            profile->stack(SP, kernelMode);
+        }
+    }
+
+    /*
+     * Function: words
+     * ---------------
+     * Returns:
+     * The memory array itself, for translated code that reads and writes it without calls.
+     * Accesses through it bypass the bounds check and the profile.
+     */
+    int* words(){
+        return memory;
+    }
+
+    /*
+     * Function: dump 
+     * --------------
+     * Appends every nonzero memory word to a state file as "address value" lines.
+     * Used to compare the final memory of different execution engines.
+     * Parameters:
+     * - fileName: the state file to append to.
+     */
+    void dump(const char* fileName) const {
+        dumpWords(fileName, memory);
+    }
+
+    /*
+     * Function: dumpWords
+     * -------------------
+     * Appends the nonzero words of a copy of memory to a state file, as dump does.
+     * Parameters:
+     * - fileName: the state file to append to.
+     * - words: MEMORY_SIZE words.
+     */
+    static void dumpWords(const char* fileName, const int* words){
+        ofstream out(fileName, ios::app);
+        out << "memory" << '\n';
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            if(words[i] != 0){
+                out << i << ' ' << words[i] << '\n';
+            }
+        }
+    }
+
+};
+
+
+/*
+ * AccessMap: Access permissions of every address
+ * ----------------------------------------------
+ * Each address has a USER and a KERNEL bit for data accesses and for stack accesses.
+ * The bit needed by an access is its USER bit shifted left by the kernel mode flag,
+ * so the check is the same table lookup in both modes.
+ * By default the user may use addresses below 1000 for data and stack and the kernel may use
+ * everything, which is the original user/system memory split. limitStack restricts a stack
+ * to the top of its region and optionally puts a guard region below it that no data access
+ * may touch either.
+ */
+class AccessMap {
+
+public:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    //Tops of the user and system stacks, each grows down from here
+    static const int USER_STACK_TOP = 1000;
+    static const int SYSTEM_STACK_TOP = 2000;
+
+    //Access bits, the KERNEL bit of a kind is its USER bit shifted left by one
+    static const unsigned char USER_DATA = 1;
+    static const unsigned char KERNEL_DATA = 2;
+    static const unsigned char USER_STACK = 4;
+    static const unsigned char KERNEL_STACK = 8;
+
+    //Why an access was refused, see classify()
+    enum Fault { NO_FAULT, PERMISSION_FAULT, STACK_OVERFLOW, STACK_UNDERFLOW, GUARD_FAULT };
+
+private:
+    //Access bits by address; the extra last entry is used for every out of range address and is 0
+    unsigned char bits[MEMORY_SIZE + 1];
+
+    //Lowest address each stack may use and the lowest address of its guard region, -1 when unlimited
+    int userLimit, userGuard;
+    int systemLimit, systemGuard;
+
+public:
+
+    /*
+     * Constructor: AccessMap
+     * ----------------------
+     * Starts with the original permissions and unlimited stacks.
+     */
+    AccessMap() : userLimit(-1), userGuard(-1), systemLimit(-1), systemGuard(-1) {
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            bits[i] = KERNEL_DATA | KERNEL_STACK;
+            if(i < USER_STACK_TOP){
+                bits[i] |= USER_DATA | USER_STACK;
+            }
+        }
+        bits[MEMORY_SIZE] = 0;
+    }
+
+    /*
+     * Function: allows
+     * ----------------
+     * Checks an access with one lookup and no branch on the address or the mode.
+     * Parameters:
+     * - address: the address accessed
+     * - kind: USER_DATA or USER_STACK
+     * - kernelMode: whether the CPU is in kernel mode
+     * Returns:
+     * true if the access is permitted; otherwise classify() tells why not.
+     */
+    bool allows(int address, unsigned char kind, bool kernelMode) const {
+        unsigned index = (unsigned)address < (unsigned)MEMORY_SIZE ? (unsigned)address : MEMORY_SIZE;
+        return bits[index] & (kind << kernelMode);
+    }
+
+    /*
+     * Function: table
+     * ---------------
+     * Returns:
+     * The access bits of every address followed by the out of range entry, for translated code.
+     */
+    const unsigned char* table() const {
+        return bits;
+    }
+
+    /*
+     * Function: limitStack
+     * --------------------
+     * Limits a stack to its top `size` words, with a guard region of `guard` words below it.
+     * Stack accesses outside the limit and any data access to the guard region fault.
+     * Parameters:
+     * - system: true for the system stack (kernel mode), false for the user stack
+     * - size: the number of words the stack may hold
+     * - guard: the number of words in the guard region
+     * Returns:
+     * false if the stack and its guard region do not fit in the stack's memory region.
+     */
+    bool limitStack(bool system, int size, int guard){
+        int top = system ? SYSTEM_STACK_TOP : USER_STACK_TOP;
+        int bottom = system ? USER_STACK_TOP : 0;
+        if(size < 1 || guard < 0 || top - size - guard < bottom){
+            return false;
+        }
+
+        int limit = top - size;
+        unsigned char stack = system ? KERNEL_STACK : USER_STACK;
+        unsigned char data = system ? KERNEL_DATA : USER_DATA;
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            if(i < limit || i >= top){
+                bits[i] &= ~stack;
+            }
+            if(i >= limit - guard && i < limit){
+                bits[i] &= ~data;
+            }
+        }
+
+        if(system){
+            systemLimit = limit;
+            systemGuard = limit - guard;
+        }
+        else{
+            userLimit = limit;
+            userGuard = limit - guard;
+        }
+        return true;
+    }
+
+    /*
+     * Function: classify
+     * ------------------
+     * Explains an access that allows() refused.
+     * Parameters:
+     * - address: the address accessed
+     * - kind: USER_DATA or USER_STACK
+     * - kernelMode: whether the CPU is in kernel mode
+     * Returns:
+     * The fault, or NO_FAULT for an address outside of memory that Memory reports itself.
+     */
+    Fault classify(int address, unsigned char kind, bool kernelMode) const {
+        int limit = kernelMode ? systemLimit : userLimit;
+        int top = kernelMode ? SYSTEM_STACK_TOP : USER_STACK_TOP;
+
+        if(kind == USER_STACK && limit >= 0){
+            if(address >= top){
+                return STACK_UNDERFLOW;
+            }
+            if(address < limit){
+                return STACK_OVERFLOW;
+            }
+        }
+        if(kind == USER_DATA){
+            int guard = kernelMode ? systemGuard : userGuard;
+            if(address >= guard && address < limit){
+                return GUARD_FAULT;
+            }
+        }
+
+        //The original rules: the user may not touch system memory, invalid addresses are left to Memory
+        if(!kernelMode && address >= USER_STACK_TOP){
+            return PERMISSION_FAULT;
+        }
+        return NO_FAULT;
+    }
+
+    /*
+     * Function: describe
+     * ------------------
+     * Returns:
+     * The error message for a stack fault.
+     */
+    static const char* describe(Fault fault){
+        switch(fault){
+            case STACK_OVERFLOW:  return "Stack overflow";
+            case STACK_UNDERFLOW: return "Stack underflow";
+            case GUARD_FAULT:     return "Stack guard region accessed";
+            default:              return "User can not access system memory";
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,283 @@
+/*
+    Program: Computer Simulator
+    File:    memprofile.h
+    Author:  Stanton Brown
+
+    Desription:
+    Optional instrumentation of Memory::read and Memory::write.
+    Counts reads and writes per address, estimates the working set over fixed windows of
+    memory accesses, and tracks how deep the user stack (below 1000, pushed in user mode) and
+    the system stack (below 2000, pushed in kernel mode) have grown. Everything is kept in flat
+    arrays updated with a few increments per access, so the profile is cheap enough to leave on
+    in long soak runs.
+
+    At exit the profile is written as:
+    - PREFIX.csv:          address,page,reads,writes for every address
+    - PREFIX-ws.csv:       window,words,pages: distinct words and pages touched in each window
+    - PREFIX-heatmap.txt:  totals, stack high-water marks, working set summary, per-page
+                           counts, and a text heatmap with one character per address
+*/
+
+#ifndef MEMPROFILE_H
+#define MEMPROFILE_H
+
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+
+/*
+ * MemoryProfile: Access counters and working-set estimates for one Memory
+ * -----------------------------------------------------------------------
+ * Time is measured in memory accesses: a window closes after every `window` reads and writes.
+ */
+class MemoryProfile {
+
+public:
+    //Words per page in the per-page counts and working set
+    static const int PAGE_SIZE = 100;
+
+    //Top of the two stacks, each grows down from here
+    static const int USER_STACK = 1000;
+    static const int SYSTEM_STACK = 2000;
+
+private:
+    int size;
+    string prefix;
+
+    //Per address counters
+    vector<uint64_t> reads;
+    vector<uint64_t> writes;
+
+    //Working set: window each address and page was last touched in, and the current window's counts
+    long long window;
+    long long accesses;
+    long long windowEnd;
+    long long currentWindow;
+    vector<long long> lastWindow;
+    vector<long long> lastPageWindow;
+    int windowWords;
+    int windowPages;
+
+    //Distinct words and pages of every closed window
+    vector<int> workingWords;
+    vector<int> workingPages;
+
+    //Lowest stack pointer seen for each stack
+    int userStackLow;
+    int systemStackLow;
+
+public:
+
+    /*
+     * Constructor: MemoryProfile
+     * --------------------------
+     * Parameters:
+     * - memorySize: number of addresses
+     * - windowSize: memory accesses per working-set window
+     * - outputPrefix: path prefix of the report files
+     */
+    MemoryProfile(int memorySize, long long windowSize, const string& outputPrefix) : size(memorySize),
+    prefix(outputPrefix), reads(memorySize, 0), writes(memorySize, 0), window(windowSize), accesses(0),
+    windowEnd(windowSize), currentWindow(0), lastWindow(memorySize, -1),
+    lastPageWindow((memorySize + PAGE_SIZE - 1) / PAGE_SIZE, -1), windowWords(0), windowPages(0),
+    userStackLow(USER_STACK), systemStackLow(SYSTEM_STACK) {}
+
+    /*
+     * Function: read
+     * --------------
+     * Counts a read of a valid address.
+     */
+    void read(int address){
+        reads[address]++;
+        touch(address);
+    }
+
+    /*
+     * Function: write
+     * ---------------
+     * Counts a write to a valid address.
+     */
+    void write(int address){
+        writes[address]++;
+        touch(address);
+    }
+
+    /*
+     * Function: stack
+     * ---------------
+     * Records the stack pointer after a push that went deeper than any push before it.
+     * The stack is the one of the CPU's mode, so a system stack that overflows below
+     * USER_STACK still counts as system stack depth.
+     * Parameters:
+     * - SP: the new stack pointer
+     * - kernelMode: whether the push was made in kernel mode
+     */
+    void stack(int SP, bool kernelMode){
+        if(!kernelMode){
+            if(SP < userStackLow){
+                userStackLow = SP;
+            }
+        }
+        else if(SP < systemStackLow){
+            systemStackLow = SP;
+        }
+    }
+
+    /*
+     * Function: report
+     * ----------------
+     * Writes the CSV files and the heatmap.
+     */
+    void report(){
+        //Count the partial last window too
+        if(accesses > windowEnd - window){
+            workingWords.push_back(windowWords);
+            workingPages.push_back(windowPages);
+        }
+
+        ofstream csv(prefix + ".csv");
+        csv << "address,page,reads,writes\n";
+        for(int i = 0; i < size; i++){
+            csv << i << ',' << i / PAGE_SIZE << ',' << reads[i] << ',' << writes[i] << '\n';
+        }
+
+        ofstream ws(prefix + "-ws.csv");
+        ws << "window,words,pages\n";
+        for(size_t i = 0; i < workingWords.size(); i++){
+            ws << i << ',' << workingWords[i] << ',' << workingPages[i] << '\n';
+        }
+
+        writeHeatmap(prefix + "-heatmap.txt");
+    }
+
+private:
+
+    /*
+     * Function: touch
+     * ---------------
+     * Adds an access to the working set of the current window.
+     */
+    void touch(int address){
+        if(++accesses > windowEnd){
+            closeWindow();
+        }
+        if(lastWindow[address] != currentWindow){
+            lastWindow[address] = currentWindow;
+            windowWords++;
+            int page = address / PAGE_SIZE;
+            if(lastPageWindow[page] != currentWindow){
+                lastPageWindow[page] = currentWindow;
+                windowPages++;
+            }
+        }
+    }
+
+    /*
+     * Function: closeWindow
+     * ---------------------
+     * Saves the working set of the finished window and starts the next one.
+     */
+    void closeWindow(){
+        workingWords.push_back(windowWords);
+        workingPages.push_back(windowPages);
+        windowWords = 0;
+        windowPages = 0;
+        currentWindow++;
+        windowEnd += window;
+    }
+
+    /*
+     * Function: writeHeatmap
+     * ----------------------
+     * Writes the summary and the heatmap: one row per 50 addresses, one character per address
+     * on a logarithmic scale from ' ' (never accessed) to '@' (the most accessed address).
+     * Parameters:
+     * - fileName: the file to write
+     */
+    void writeHeatmap(const string& fileName) const {
+        static const char SHADES[] = " .:-=+*#%@";
+        static const int SHADE_COUNT = sizeof(SHADES) - 1;
+        static const int ROW = 50;
+
+        ofstream out(fileName);
+
+        uint64_t totalReads = 0, totalWrites = 0, most = 0;
+        int touched = 0;
+        for(int i = 0; i < size; i++){
+            totalReads += reads[i];
+            totalWrites += writes[i];
+            uint64_t count = reads[i] + writes[i];
+            most = count > most ? count : most;
+            touched += count > 0;
+        }
+        out << "Memory accesses: " << totalReads << " reads, " << totalWrites << " writes, "
+            << touched << " of " << size << " addresses touched\n";
+
+        out << "User stack high-water mark: " << USER_STACK - userStackLow << " words (lowest SP "
+            << userStackLow << ")\n";
+        out << "System stack high-water mark: " << SYSTEM_STACK - systemStackLow << " words (lowest SP "
+            << systemStackLow << ")\n";
+
+        //Working set summary
+        vector<int> words = workingWords, pages = workingPages;
+        if(words.empty()){
+            words.push_back(0);
+            pages.push_back(0);
+        }
+        long long sumWords = 0, sumPages = 0;
+        int maxWords = 0, maxPages = 0;
+        for(size_t i = 0; i < words.size(); i++){
+            sumWords += words[i];
+            sumPages += pages[i];
+            maxWords = words[i] > maxWords ? words[i] : maxWords;
+            maxPages = pages[i] > maxPages ? pages[i] : maxPages;
+        }
+        out << "Working set per " << window << " accesses (" << words.size() << " windows): average "
+            << sumWords / (double)words.size() << " words / " << sumPages / (double)pages.size()
+            << " pages, maximum " << maxWords << " words / " << maxPages << " pages\n\n";
+
+        //Per page counts
+        out << "Page  Addresses     Reads        Writes\n";
+        for(int page = 0; page * PAGE_SIZE < size; page++){
+            uint64_t pageReads = 0, pageWrites = 0;
+            for(int i = page * PAGE_SIZE; i < (page + 1) * PAGE_SIZE && i < size; i++){
+                pageReads += reads[i];
+                pageWrites += writes[i];
+            }
+            if(pageReads + pageWrites == 0){
+                continue;
+            }
+            char line[96];
+            snprintf(line, sizeof(line), "%4d  %4d-%-4d  %12llu  %12llu\n", page, page * PAGE_SIZE,
+                     (page + 1) * PAGE_SIZE - 1, (unsigned long long)pageReads, (unsigned long long)pageWrites);
+            out << line;
+        }
+
+        //Heatmap
+        out << "\nHeatmap (" << ROW << " addresses per row, scale '" << SHADES << "' up to " << most
+            << " accesses)\n";
+        double logMost = most > 1 ? log((double)most) : 1.0;
+        for(int row = 0; row < size; row += ROW){
+            char label[16];
+            snprintf(label, sizeof(label), "%4d |", row);
+            out << label;
+            for(int i = row; i < row + ROW && i < size; i++){
+                uint64_t count = reads[i] + writes[i];
+                int shade = 0;
+                if(count > 0){
+                    shade = 1 + (int)((SHADE_COUNT - 2) * log((double)count) / logMost);
+                }
+                out << SHADES[shade];
+            }
+            out << "|\n";
+        }
+    }
+};
+
+#endif
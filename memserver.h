@@ -0,0 +1,516 @@
+/*
+    Program: Computer Simulator
+    File:    memserver.h
+    Author:  Stanton Brown
+
+    Desription:
+    The memory side of the simulator as a server for any number of CPU clients.
+    Clients speak the pipe protocol of the CPU (see project1.cpp): a read address is answered
+    with the word, -1 address data writes, -6 and -8 address data are push writes in user and
+    kernel mode, -5 ends the client, and -7 asks for a copy of every word (used for --dump-state). A client is either a pair of
+    pipes to a forked CPU or a connection on a Unix socket.
+
+    All clients are multiplexed with epoll. Every wakeup reads as much as the client has sent,
+    executes all the complete requests in it and answers them with a single write, so a write
+    followed by a read costs one round trip. Each client gets its own copy of the program
+    (a private protection domain), or with sharedMemory all clients use one memory, which
+    models a shared-memory multiprocessor instead of distributed memories.
+    Client descriptors are non-blocking: replies a client is not reading stay queued and are
+    sent when epoll reports it writable, and its requests are not read until then, so one
+    stalled client never holds up the others.
+    The server counts the requests and batches of every client and reports them when it leaves.
+*/
+
+#ifndef MEMSERVER_H
+#define MEMSERVER_H
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "memory.h"
+
+using namespace std;
+
+
+/*
+ * MemoryServer: Serves memory requests of many CPUs from one process
+ * ------------------------------------------------------------------
+ */
+class MemoryServer {
+
+public:
+    //Signals of the pipe protocol, anything else is a read address
+    static const int WRITE = -1;
+    static const int EXIT = -5;
+    static const int PUSH = -6;
+    static const int SNAPSHOT = -7;
+    static const int SYSTEM_PUSH = -8;
+
+    //Profile shared by every domain, NULL unless profiling
+    MemoryProfile* profile;
+
+    //Errors in a request end the server, as in the original two-process simulator.
+    //Otherwise only the client that made the request is dropped.
+    bool exitOnError;
+
+    //Report the statistics of every client that leaves
+    bool statistics;
+
+private:
+    static const int BUFFER_WORDS = 1024;
+    static const int MAX_EVENTS = 64;
+
+    /*
+     * Client: One connected CPU
+     */
+    struct Client {
+        int id;
+        int in;
+        int out;
+        Memory* memory;
+
+        //Requests received but not complete yet
+        int buffer[BUFFER_WORDS];
+        int buffered;   //bytes
+
+        //Replies of the current batch, and how many bytes of them the client has taken
+        vector<int> replies;
+        size_t replied;
+
+        //Sent -5, leaves once its replies are out
+        bool exiting;
+
+        //Statistics
+        long long reads;
+        long long writes;
+        long long pushes;
+        long long batches;
+    };
+
+    Memory image;
+    bool sharedMemory;
+    int epoll;
+    int listener;
+    string socketPath;
+    vector<Client*> clients;
+    int accepted;
+
+public:
+
+    /*
+     * Constructor: MemoryServer
+     * -------------------------
+     * Parameters:
+     * - program: the memory every client starts with
+     * - shared: whether all clients use one memory instead of a copy each
+     */
+    MemoryServer(const Memory& program, bool shared) : profile(NULL), exitOnError(false), statistics(false),
+    image(program), sharedMemory(shared), listener(-1), accepted(0) {
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        if(epoll == -1){
+            cerr << "ERROR: epoll_create1 failed: " << strerror(errno) << endl;
+            exit(1);
+        }
+    }
+
+    ~MemoryServer(){
+        while(!clients.empty()){
+            drop(clients.back(), false);
+        }
+        if(listener != -1){
+            close(listener);
+            unlink(socketPath.c_str());
+        }
+        close(epoll);
+    }
+
+    /*
+     * Function: addClient
+     * -------------------
+     * Serves a CPU connected through a pair of file descriptors.
+     * Parameters:
+     * - in: where its requests arrive
+     * - out: where its replies go (the same descriptor for a socket)
+     */
+    void addClient(int in, int out){
+        Client* client = new Client();
+        client->id = ++accepted;
+        client->in = in;
+        client->out = out;
+        client->buffered = 0;
+        client->replied = 0;
+        client->exiting = false;
+        client->reads = client->writes = client->pushes = client->batches = 0;
+        if(sharedMemory){
+            client->memory = &image;
+        }
+        else{
+            client->memory = new Memory(image);
+        }
+        client->memory->profile = profile;
+
+        fcntl(in, F_SETFL, fcntl(in, F_GETFL) | O_NONBLOCK);
+        fcntl(out, F_SETFL, fcntl(out, F_GETFL) | O_NONBLOCK);
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        if(epoll_ctl(epoll, EPOLL_CTL_ADD, in, &event) == -1){
+            cerr << "ERROR: epoll_ctl failed: " << strerror(errno) << endl;
+            exit(1);
+        }
+        clients.push_back(client);
+    }
+
+    /*
+     * Function: listen
+     * ----------------
+     * Accepts CPUs connecting to a Unix socket. A stale socket at the path is replaced.
+     * Parameters:
+     * - path: the socket path
+     * Returns:
+     * false (after reporting it) if the socket could not be set up.
+     */
+    bool listen(const char* path){
+        sockaddr_un address;
+        if(!socketAddress(path, address)){
+            return false;
+        }
+        struct stat info;
+        if(stat(path, &info) == 0 && S_ISSOCK(info.st_mode)){
+            unlink(path);
+        }
+
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(listener == -1 || bind(listener, (sockaddr*)&address, sizeof(address)) == -1 ||
+           ::listen(listener, SOMAXCONN) == -1){
+            cerr << "ERROR: unable to listen on " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        socketPath = path;
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+        return true;
+    }
+
+    /*
+     * Function: connect
+     * -----------------
+     * Connects a CPU to a server listening on a Unix socket.
+     * Parameters:
+     * - path: the socket path
+     * Returns:
+     * The connected socket, or -1 (after reporting it) on failure.
+     */
+    static int connect(const char* path){
+        sockaddr_un address;
+        if(!socketAddress(path, address)){
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd == -1 || ::connect(fd, (sockaddr*)&address, sizeof(address)) == -1){
+            cerr << "ERROR: unable to connect to " << path << ": " << strerror(errno) << endl;
+            return -1;
+        }
+        return fd;
+    }
+
+    /*
+     * Function: run
+     * -------------
+     * Serves requests until every client has left and, when listening, clientLimit
+     * clients have been accepted (0 keeps listening forever).
+     * Parameters:
+     * - clientLimit: number of socket clients to serve
+     */
+    void run(long long clientLimit){
+        epoll_event events[MAX_EVENTS];
+        while(!clients.empty() || (listener != -1 && (clientLimit == 0 || accepted < clientLimit))){
+            int ready = epoll_wait(epoll, events, MAX_EVENTS, -1);
+            if(ready == -1){
+                if(errno == EINTR){
+                    continue;
+                }
+                cerr << "ERROR: epoll_wait failed: " << strerror(errno) << endl;
+                exit(1);
+            }
+            for(int i = 0; i < ready; i++){
+                Client* client = (Client*)events[i].data.ptr;
+                if(client == NULL){
+                    accept(clientLimit);
+                }
+                else if(find(client)){
+                    //A client with replies queued is only watched for writing
+                    if(client->replies.empty()){
+                        serve(client);
+                    }
+                    else{
+                        resume(client);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+
+    static bool socketAddress(const char* path, sockaddr_un& address){
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if(strlen(path) >= sizeof(address.sun_path)){
+            cerr << "ERROR: socket path is too long: " << path << endl;
+            return false;
+        }
+        strcpy(address.sun_path, path);
+        return true;
+    }
+
+    //A client dropped earlier in the same epoll_wait may still have an event
+    bool find(Client* client) const {
+        for(size_t i = 0; i < clients.size(); i++){
+            if(clients[i] == client){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Function: accept
+     * ----------------
+     * Adds a CPU waiting on the socket, and stops listening once the limit is reached.
+     */
+    void accept(long long clientLimit){
+        int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if(fd == -1){
+            return;
+        }
+        addClient(fd, fd);
+        if(clientLimit != 0 && accepted >= clientLimit){
+            epoll_ctl(epoll, EPOLL_CTL_DEL, listener, NULL);
+            close(listener);
+            unlink(socketPath.c_str());
+            listener = -1;
+        }
+    }
+
+    /*
+     * Function: serve
+     * ---------------
+     * Reads what a client has sent, executes every complete request and sends the replies
+     * in one write. A partial request stays buffered until the rest arrives, and replies the
+     * client does not take yet are left for resume().
+     * Parameters:
+     * - client: the client whose descriptor is readable
+     */
+    void serve(Client* client){
+        char* bytes = (char*)client->buffer;
+        ssize_t received = read(client->in, bytes + client->buffered, sizeof(client->buffer) - client->buffered);
+        if(received <= 0){
+            if(received == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)){
+                return;
+            }
+            //The CPU exited on an error without signaling
+            drop(client, true);
+            return;
+        }
+        client->buffered += received;
+        client->batches++;
+
+        Memory& memory = *client->memory;
+        const int* words = client->buffer;
+        int count = client->buffered / sizeof(int);
+        int at = 0;
+        while(at < count && !client->exiting){
+            int request = words[at];
+            if(request == WRITE || request == PUSH || request == SYSTEM_PUSH){
+                if(at + 3 > count){
+                    break;
+                }
+                int address = words[at + 1];
+                if(!valid(client, address)){
+                    return;
+                }
+                memory.write(address, words[at + 2]);
+                if(request != WRITE){
+                    memory.noteStackPointer(address, request == SYSTEM_PUSH);
+                    client->pushes++;
+                }
+                client->writes++;
+                at += 3;
+            }
+            else if(request == EXIT){
+                client->exiting = true;
+                at++;
+            }
+            else if(request == SNAPSHOT){
+                client->replies.insert(client->replies.end(), memory.words(), memory.words() + Memory::MEMORY_SIZE);
+                at++;
+            }
+            else{
+                if(!valid(client, request)){
+                    return;
+                }
+                client->replies.push_back(memory.read(request));
+                client->reads++;
+                at++;
+            }
+        }
+
+        //Keep the incomplete request for the next read
+        int consumed = at * sizeof(int);
+        client->buffered -= consumed;
+        memmove(bytes, bytes + consumed, client->buffered);
+
+        if(!client->replies.empty()){
+            if(!sendReplies(client)){
+                drop(client, true);
+                return;
+            }
+            if(!client->replies.empty()){
+                watch(client, true);
+                return;
+            }
+        }
+        if(client->exiting){
+            drop(client, true);
+        }
+    }
+
+    /*
+     * Function: resume
+     * ----------------
+     * Sends more of the queued replies of a client that has become writable, and reads its
+     * requests again once they are all out.
+     * Parameters:
+     * - client: the client with replies queued
+     */
+    void resume(Client* client){
+        if(!sendReplies(client)){
+            drop(client, true);
+            return;
+        }
+        if(client->replies.empty()){
+            if(client->exiting){
+                drop(client, true);
+                return;
+            }
+            watch(client, false);
+        }
+    }
+
+    /*
+     * Function: valid
+     * ---------------
+     * Checks the address of a request. An invalid address ends the server when exitOnError
+     * is set (through Memory, which reports it), otherwise it is reported and the client dropped.
+     * Returns:
+     * false if the client was dropped.
+     */
+    bool valid(Client* client, int address){
+        if(address >= 0 && address < Memory::MEMORY_SIZE){
+            return true;
+        }
+        if(exitOnError){
+            client->memory->read(address);
+        }
+        cerr << "client " << client->id << ": ERROR: Invalid memory address accessed: " << address << endl;
+        drop(client, true);
+        return false;
+    }
+
+    /*
+     * Function: sendReplies
+     * ---------------------
+     * Writes as much of a client's queued replies as its descriptor takes without blocking.
+     * The queue is emptied once everything is sent.
+     * Returns:
+     * false if the client can no longer be written to.
+     */
+    static bool sendReplies(Client* client){
+        const char* bytes = (const char*)client->replies.data();
+        size_t size = client->replies.size() * sizeof(int);
+        while(client->replied < size){
+            ssize_t sent = write(client->out, bytes + client->replied, size - client->replied);
+            if(sent == -1){
+                if(errno == EINTR){
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            client->replied += sent;
+        }
+        client->replies.clear();
+        client->replied = 0;
+        return true;
+    }
+
+    /*
+     * Function: watch
+     * ---------------
+     * Switches a client between waiting for requests and waiting to send queued replies.
+     * Parameters:
+     * - client: the client
+     * - writing: wait until its output descriptor is writable instead of for requests
+     */
+    void watch(Client* client, bool writing){
+        epoll_event event;
+        event.data.ptr = client;
+        if(client->in == client->out){
+            event.events = writing ? EPOLLOUT : EPOLLIN;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, client->in, &event);
+            return;
+        }
+        event.events = EPOLLIN;
+        epoll_ctl(epoll, writing ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, client->in, &event);
+        event.events = EPOLLOUT;
+        epoll_ctl(epoll, writing ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, client->out, &event);
+    }
+
+    /*
+     * Function: drop
+     * --------------
+     * Closes a client's descriptors and frees its memory.
+     * Parameters:
+     * - client: the client that left
+     * - report: print its statistics (when statistics is set)
+     */
+    void drop(Client* client, bool report){
+        if(report && statistics){
+            long long requests = client->reads + client->writes;
+            cerr << "client " << client->id << ": " << client->reads << " reads, " << client->writes
+                 << " writes (" << client->pushes << " pushes) in " << client->batches << " batches, "
+                 << (client->batches > 0 ? (double)requests / client->batches : 0.0) << " requests per batch" << endl;
+        }
+
+        epoll_ctl(epoll, EPOLL_CTL_DEL, client->in, NULL);
+        close(client->in);
+        if(client->out != client->in){
+            epoll_ctl(epoll, EPOLL_CTL_DEL, client->out, NULL);
+            close(client->out);
+        }
+        if(client->memory != &image){
+            delete client->memory;
+        }
+        for(size_t i = 0; i < clients.size(); i++){
+            if(clients[i] == client){
+                clients.erase(clients.begin() + i);
+                break;
+            }
+        }
+        delete client;
+    }
+};
+
+#endif
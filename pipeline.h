@@ -0,0 +1,296 @@
+/*
+    Program: Computer Simulator
+    File:    pipeline.h
+    Author:  Stanton Brown
+
+    Desription:
+    Timing model of a classic 5-stage in-order pipeline (fetch, decode, execute, memory,
+    writeback) layered over the instructions an engine executes. The engine still does all the
+    work; the model only sees the PC and instruction word of every executed instruction and
+    computes when it would enter each stage.
+
+    - Fetch takes one cycle per word, so instructions with an operand spend two cycles in fetch.
+    - Registers (AC, X, Y, SP) are ready for a dependent instruction's execute stage one cycle
+      after the producer's execute stage, or after its memory stage for values loaded from
+      memory. Without forwarding they are ready only after writeback.
+    - The memory stage takes latency cycles per data access (Int and IRet move six words).
+    - Fetch continues sequentially. A jump that is taken refetches after its execute stage
+      (20-23), Ret after its memory stage, and Int, IRet and interrupts after writeback.
+    - A stage is busy until its instruction moves on, so a stall holds every earlier stage.
+
+    Everything comes from the instruction set table (isa.h) and a handful of numbers kept for
+    the previous instruction, so the model costs a few dozen operations per instruction.
+    Each cycle between two instructions' writebacks beyond the first is a stall, charged to
+    the PC of the later instruction and to the hazards that delayed it, in pipeline order.
+
+    At exit the model is written as:
+    - PREFIX-pipeline.txt:  instructions, cycles, CPI and stall cycles by cause
+    - PREFIX-pipeline.csv:  address,executions,data,memory,control,fetch for every executed address
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "isa.h"
+
+using namespace std;
+
+
+/*
+ * PipelineTiming: What the model needs of one instruction word
+ */
+struct PipelineTiming {
+    //Stages after which a control transfer refetches
+    enum Resolve {RESOLVE_EXECUTE, RESOLVE_MEMORY, RESOLVE_WRITEBACK};
+
+    bool valid;
+    int words;
+    int accesses;
+    unsigned char sources;
+    unsigned char results;
+    unsigned char loaded;   //results that come from memory
+    int resolve;            //stage after which a jump's target is fetched
+};
+
+struct PipelineTimingTable {
+    PipelineTiming at[MAX_OPCODE + 1];
+};
+
+constexpr PipelineTimingTable makePipelineTiming(){
+    PipelineTimingTable table = {};
+    for(int i = 0; i < OPCODE_COUNT; i++){
+        const Opcode& op = OPCODES[i];
+        PipelineTiming& timing = table.at[op.code];
+        timing.valid = true;
+        timing.words = 1 + op.operands;
+        timing.accesses = op.accesses;
+        timing.sources = op.sources;
+        timing.results = op.results;
+        //Stack instructions compute SP in execute, everything else they write comes from memory;
+        //IRet restores SP from memory too
+        timing.loaded = op.accesses > 0 ? (op.code == 30 ? op.results : op.results & ~REG_SP) : 0;
+        timing.resolve = op.code == 24 ? PipelineTiming::RESOLVE_MEMORY :
+                         (op.branch && op.operands > 0 ? PipelineTiming::RESOLVE_EXECUTE : PipelineTiming::RESOLVE_WRITEBACK);
+    }
+    return table;
+}
+
+inline constexpr PipelineTimingTable PIPELINE_TIMING = makePipelineTiming();
+
+
+/*
+ * PipelineModel: Stage timing of the executed instructions
+ * --------------------------------------------------------
+ * Time is measured in pipeline cycles, starting with the first fetch at cycle 0.
+ */
+class PipelineModel {
+
+public:
+    //Causes of stall cycles
+    enum Stall {
+        DATA_STALL,     //waiting for a register
+        MEMORY_STALL,   //waiting for the memory stage
+        CONTROL_STALL,  //refetching after a jump, call, return or interrupt
+        FETCH_STALL,    //fetching an operand word
+        STALL_KINDS
+    };
+
+    //Cycles per data access in the memory stage
+    int latency;
+
+    //Whether results are forwarded to the execute stage
+    bool forwarding;
+
+private:
+    static const int REGISTERS = 4;
+
+    string prefix;
+
+    //The previous instruction: its stage entry cycles, where execution continues without a jump,
+    //and when the fetch of a jump target can start
+    long long decode, execute, memory, writeback;
+    int expected;
+    long long redirect;
+    bool started;
+
+    //Cycle at which each register is ready for the execute stage
+    long long ready[REGISTERS];
+
+    /*
+     * Counters: Executions and stall cycles of one address
+     */
+    struct Counters {
+        uint64_t executions;
+        uint64_t stalls[STALL_KINDS];
+    };
+
+    long long instructions;
+    vector<Counters> perAddress;
+
+public:
+
+    /*
+     * Constructor: PipelineModel
+     * --------------------------
+     * Parameters:
+     * - size: number of addresses
+     * - prefix: report file prefix
+     */
+    PipelineModel(int size, const string& prefix) : latency(1), forwarding(true), prefix(prefix),
+    decode(0), execute(0), memory(0), writeback(0), expected(0), redirect(0), started(false),
+    instructions(0), perAddress(size, Counters()) {
+        for(int r = 0; r < REGISTERS; r++){
+            ready[r] = 0;
+        }
+    }
+
+    /*
+     * Function: instruction
+     * ---------------------
+     * Moves the next executed instruction through the pipeline.
+     * Parameters:
+     * - pc: its address
+     * - code: its instruction word
+     */
+    void instruction(int pc, int code){
+        if((unsigned)code > (unsigned)MAX_OPCODE || !PIPELINE_TIMING.at[code].valid ||
+           (unsigned)pc >= (unsigned)perAddress.size()){
+            return;
+        }
+        const PipelineTiming& timing = PIPELINE_TIMING.at[code];
+
+        //Fetch once the previous instruction has moved to decode, or at a jump target once it is known
+        long long f = decode;
+        long long control = 0;
+        if(pc != expected && redirect > f){
+            control = redirect - f;
+            f = redirect;
+        }
+
+        //Decode once every word is fetched and the previous instruction has moved on
+        long long d = f + timing.words;
+        long long held = 0;
+        if(execute > d){
+            held += execute - d;
+            d = execute;
+        }
+
+        //Execute once the previous instruction has moved on and the sources are ready
+        long long e = d + 1;
+        if(memory > e){
+            held += memory - e;
+            e = memory;
+        }
+        //Register loops are branch-free, the instruction mix would mispredict every test
+        long long operands = e;
+        for(int r = 0; r < REGISTERS; r++){
+            long long need = ready[r] & -(long long)((timing.sources >> r) & 1);
+            operands = need > operands ? need : operands;
+        }
+        long long data = operands - e;
+        e = operands;
+
+        //Memory once the previous instruction has written back, then writeback
+        long long m = e + 1;
+        if(writeback > m){
+            held += writeback - m;
+            m = writeback;
+        }
+        int memoryCycles = timing.accesses > 0 ? timing.accesses * latency : 1;
+        long long w = m + memoryCycles;
+
+        //Results
+        long long computed = forwarding ? e + 1 : w + 1;
+        long long loaded = forwarding ? w : w + 1;
+        for(int r = 0; r < REGISTERS; r++){
+            long long fromMemory = -(long long)((timing.loaded >> r) & 1);
+            long long written = -(long long)((timing.results >> r) & 1);
+            long long value = (loaded & fromMemory) | (computed & ~fromMemory);
+            ready[r] = (value & written) | (ready[r] & ~written);
+        }
+
+        //Charge the writeback gap to the delays in pipeline order
+        Counters& counters = perAddress[pc];
+        long long gap = started ? w - writeback - 1 : 0;
+        charge(counters.stalls[CONTROL_STALL], control, gap);
+        charge(counters.stalls[FETCH_STALL], timing.words - 1, gap);
+        charge(counters.stalls[DATA_STALL], data, gap);
+        charge(counters.stalls[MEMORY_STALL], held + memoryCycles - 1, gap);
+
+        counters.executions++;
+        instructions++;
+        decode = d;
+        execute = e;
+        memory = m;
+        writeback = w;
+        expected = pc + timing.words;
+        redirect = timing.resolve == PipelineTiming::RESOLVE_EXECUTE ? e + 1 :
+                   (timing.resolve == PipelineTiming::RESOLVE_MEMORY ? w : w + 1);
+        started = true;
+    }
+
+    /*
+     * Function: cycles
+     * ----------------
+     * Returns:
+     * Cycles from the first fetch to the last writeback.
+     */
+    long long cycles() const {
+        return started ? writeback + 1 : 0;
+    }
+
+    /*
+     * Function: report
+     * ----------------
+     * Writes the summary and the per-address stall breakdown.
+     */
+    void report() const {
+        static const char* NAMES[STALL_KINDS] = {"data", "memory", "control", "fetch"};
+
+        uint64_t total[STALL_KINDS] = {0, 0, 0, 0};
+        for(size_t i = 0; i < perAddress.size(); i++){
+            for(int k = 0; k < STALL_KINDS; k++){
+                total[k] += perAddress[i].stalls[k];
+            }
+        }
+
+        ofstream summary(prefix + "-pipeline.txt");
+        summary << "instructions " << instructions << '\n';
+        summary << "cycles " << cycles() << '\n';
+        summary << "CPI " << (instructions > 0 ? (double)cycles() / instructions : 0.0) << '\n';
+        summary << "memory latency " << latency << '\n';
+        summary << "forwarding " << (forwarding ? "on" : "off") << '\n';
+        for(int k = 0; k < STALL_KINDS; k++){
+            summary << NAMES[k] << " stalls " << total[k] << '\n';
+        }
+
+        ofstream csv(prefix + "-pipeline.csv");
+        csv << "address,executions,data,memory,control,fetch\n";
+        for(size_t i = 0; i < perAddress.size(); i++){
+            if(perAddress[i].executions == 0){
+                continue;
+            }
+            csv << i << ',' << perAddress[i].executions;
+            for(int k = 0; k < STALL_KINDS; k++){
+                csv << ',' << perAddress[i].stalls[k];
+            }
+            csv << '\n';
+        }
+    }
+
+private:
+
+    //Charges up to gap cycles of a delay to a counter
+    static void charge(uint64_t& counter, long long delay, long long& gap){
+        long long charged = delay < gap ? delay : gap;
+        counter += charged;
+        gap -= charged;
+    }
+};
+
+#endif
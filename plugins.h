@@ -0,0 +1,464 @@
+/*
+    Program: Computer Simulator
+    File:    plugins.h
+    Author:  Stanton Brown
+
+    Desription:
+    Branch predictor and data prefetcher plug-ins for the predecoded engine.
+    The engine reports every conditional jump (21, 22), Call (23) and Ret (24), and every
+    data read through readMemory. Any number of plug-ins watch the same run side by side.
+    Each one predicts from what it has seen so far and is then told what really happened,
+    so it never changes the run.
+
+    Branch predictors:
+    - static:  backward conditional jumps are taken, forward ones are not
+    - bimodal: a 2-bit saturating counter per jump, indexed by PC
+    - gshare:  2-bit counters indexed by PC xor the global history of the last jumps
+    - ras:     a return address stack, pushed by Call and predicting the target of Ret
+
+    Prefetchers, working on lines of LINE_WORDS words held in a small prefetch buffer:
+    - next-line: a read of line L prefetches L+1
+    - stride:    a read that repeats its instruction's last stride prefetches one stride ahead
+
+    A predictor's coverage is the fraction of jumps, calls and returns it made a prediction for,
+    and its accuracy the fraction of those predictions that were right. A prefetcher's coverage
+    is the fraction of reads found in its buffer, and its accuracy the fraction of prefetches
+    that were used.
+
+    The hooks in the engine are only compiled when the simulator is built with
+    -DCSIM_PLUGINS; an ordinary build has no trace of them.
+*/
+
+#ifndef PLUGINS_H
+#define PLUGINS_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdio>
+
+using namespace std;
+
+
+/*
+ * BranchPredictor: Base of the branch predictor plug-ins
+ * ------------------------------------------------------
+ * Subclasses override the predictions they make; the base counts them.
+ */
+class BranchPredictor {
+
+public:
+    long long branches;     //conditional jumps, calls and returns seen
+    long long predicted;
+    long long correct;
+
+    BranchPredictor() : branches(0), predicted(0), correct(0) {}
+    virtual ~BranchPredictor() {}
+
+    virtual const char* name() const = 0;
+
+    /*
+     * Function: conditional
+     * ---------------------
+     * A conditional jump at pc to target was taken or not.
+     */
+    void conditional(int pc, int target, bool taken){
+        branches++;
+        int prediction = predictTaken(pc, target);
+        if(prediction >= 0){
+            predicted++;
+            correct += prediction == (int)taken;
+        }
+        trainTaken(pc, taken);
+    }
+
+    /*
+     * Function: call
+     * --------------
+     * A Call at pc pushed returnAddress.
+     */
+    void call(int pc, int returnAddress){
+        branches++;
+        called(pc, returnAddress);
+    }
+
+    /*
+     * Function: ret
+     * -------------
+     * A Ret at pc popped target.
+     */
+    void ret(int pc, int target){
+        branches++;
+        int prediction = predictReturn(pc);
+        if(prediction >= 0){
+            predicted++;
+            correct += prediction == target;
+        }
+    }
+
+protected:
+    //Predictions: 1 taken, 0 not taken, or a return address; -1 for no prediction
+    virtual int predictTaken(int, int){
+        return -1;
+    }
+    virtual void trainTaken(int, bool){}
+    virtual void called(int, int){}
+    virtual int predictReturn(int){
+        return -1;
+    }
+};
+
+/*
+ * StaticPredictor: Backward taken, forward not taken
+ */
+class StaticPredictor : public BranchPredictor {
+public:
+    const char* name() const override {
+        return "static";
+    }
+protected:
+    int predictTaken(int pc, int target) override {
+        return target <= pc;
+    }
+};
+
+/*
+ * BimodalPredictor: 2-bit counters indexed by PC
+ */
+class BimodalPredictor : public BranchPredictor {
+    static const int ENTRIES = 256;
+    unsigned char counters[ENTRIES];
+public:
+    BimodalPredictor(){
+        for(int i = 0; i < ENTRIES; i++){
+            counters[i] = 1;    //weakly not taken
+        }
+    }
+    const char* name() const override {
+        return "bimodal";
+    }
+protected:
+    int predictTaken(int pc, int) override {
+        return counters[pc % ENTRIES] >= 2;
+    }
+    void trainTaken(int pc, bool taken) override {
+        unsigned char& counter = counters[pc % ENTRIES];
+        if(taken && counter < 3){
+            counter++;
+        }
+        else if(!taken && counter > 0){
+            counter--;
+        }
+    }
+};
+
+/*
+ * GsharePredictor: 2-bit counters indexed by PC xor global history
+ */
+class GsharePredictor : public BranchPredictor {
+    static const int HISTORY_BITS = 8;
+    static const int ENTRIES = 1 << HISTORY_BITS;
+    unsigned char counters[ENTRIES];
+    unsigned history;
+public:
+    GsharePredictor() : history(0) {
+        for(int i = 0; i < ENTRIES; i++){
+            counters[i] = 1;
+        }
+    }
+    const char* name() const override {
+        return "gshare";
+    }
+protected:
+    int predictTaken(int pc, int) override {
+        return counters[index(pc)] >= 2;
+    }
+    void trainTaken(int pc, bool taken) override {
+        unsigned char& counter = counters[index(pc)];
+        if(taken && counter < 3){
+            counter++;
+        }
+        else if(!taken && counter > 0){
+            counter--;
+        }
+        history = ((history << 1) | taken) & (ENTRIES - 1);
+    }
+private:
+    int index(int pc) const {
+        return (pc ^ history) & (ENTRIES - 1);
+    }
+};
+
+/*
+ * ReturnStackPredictor: Return address stack
+ * ------------------------------------------
+ * A full stack drops its oldest entry, as hardware stacks do.
+ */
+class ReturnStackPredictor : public BranchPredictor {
+    static const int DEPTH = 16;
+    vector<int> stack;
+public:
+    const char* name() const override {
+        return "ras";
+    }
+protected:
+    void called(int, int returnAddress) override {
+        if((int)stack.size() == DEPTH){
+            stack.erase(stack.begin());
+        }
+        stack.push_back(returnAddress);
+    }
+    int predictReturn(int) override {
+        if(stack.empty()){
+            return -1;
+        }
+        int target = stack.back();
+        stack.pop_back();
+        return target;
+    }
+};
+
+
+/*
+ * Prefetcher: Base of the data prefetcher plug-ins
+ * ------------------------------------------------
+ * Prefetched lines stay in a FIFO buffer until newer prefetches push them out.
+ */
+class Prefetcher {
+
+public:
+    static const int LINE_WORDS = 4;
+    static const int BUFFER_LINES = 16;
+
+    long long reads;
+    long long covered;      //reads found in the buffer
+    long long issued;       //prefetches
+    long long useful;       //prefetches used by at least one read
+
+private:
+    int buffer[BUFFER_LINES];
+    bool used[BUFFER_LINES];
+    int next;
+
+public:
+    Prefetcher() : reads(0), covered(0), issued(0), useful(0), next(0) {
+        for(int i = 0; i < BUFFER_LINES; i++){
+            buffer[i] = -1;
+            used[i] = false;
+        }
+    }
+    virtual ~Prefetcher() {}
+
+    virtual const char* name() const = 0;
+
+    /*
+     * Function: read
+     * --------------
+     * A data read by the instruction at pc.
+     */
+    void read(int pc, int address){
+        reads++;
+        int line = address / LINE_WORDS;
+        for(int i = 0; i < BUFFER_LINES; i++){
+            if(buffer[i] == line){
+                covered++;
+                useful += !used[i];
+                used[i] = true;
+                break;
+            }
+        }
+        observe(pc, address);
+    }
+
+protected:
+    virtual void observe(int pc, int address) = 0;
+
+    //Issues a prefetch of the line holding address, unless it is already buffered
+    void prefetch(int address){
+        if(address < 0){
+            return;
+        }
+        int line = address / LINE_WORDS;
+        for(int i = 0; i < BUFFER_LINES; i++){
+            if(buffer[i] == line){
+                return;
+            }
+        }
+        issued++;
+        buffer[next] = line;
+        used[next] = false;
+        next = (next + 1) % BUFFER_LINES;
+    }
+};
+
+/*
+ * NextLinePrefetcher: Prefetches the line after every line read
+ */
+class NextLinePrefetcher : public Prefetcher {
+public:
+    const char* name() const override {
+        return "next-line";
+    }
+protected:
+    void observe(int, int address) override {
+        prefetch((address / LINE_WORDS + 1) * LINE_WORDS);
+    }
+};
+
+/*
+ * StridePrefetcher: Prefetches one stride ahead once an instruction repeats its stride
+ */
+class StridePrefetcher : public Prefetcher {
+    static const int ENTRIES = 64;
+    struct Entry {
+        int pc;
+        int last;
+        int stride;
+    };
+    Entry table[ENTRIES];
+public:
+    StridePrefetcher(){
+        for(int i = 0; i < ENTRIES; i++){
+            table[i] = Entry{-1, 0, 0};
+        }
+    }
+    const char* name() const override {
+        return "stride";
+    }
+protected:
+    void observe(int pc, int address) override {
+        Entry& entry = table[pc % ENTRIES];
+        if(entry.pc != pc){
+            entry = Entry{pc, address, 0};
+            return;
+        }
+        int stride = address - entry.last;
+        if(stride != 0 && stride == entry.stride){
+            prefetch(address + stride);
+        }
+        entry.stride = stride;
+        entry.last = address;
+    }
+};
+
+
+/*
+ * Plugins: The plug-ins watching one run
+ * --------------------------------------
+ */
+class Plugins {
+
+public:
+    vector<BranchPredictor*> predictors;
+    vector<Prefetcher*> prefetchers;
+
+    ~Plugins(){
+        for(size_t i = 0; i < predictors.size(); i++){
+            delete predictors[i];
+        }
+        for(size_t i = 0; i < prefetchers.size(); i++){
+            delete prefetchers[i];
+        }
+    }
+
+    /*
+     * Function: add
+     * -------------
+     * Adds the plug-ins named in a comma separated list.
+     * Parameters:
+     * - list: plug-in names, e.g. "bimodal,gshare" or "stride"
+     * - branch: whether the list names branch predictors or prefetchers
+     * Returns:
+     * false if a name is unknown.
+     */
+    bool add(const string& list, bool branch){
+        stringstream names(list);
+        string name;
+        while(getline(names, name, ',')){
+            if(branch){
+                BranchPredictor* predictor = makePredictor(name);
+                if(predictor == NULL){
+                    return false;
+                }
+                predictors.push_back(predictor);
+            }
+            else{
+                Prefetcher* prefetcher = makePrefetcher(name);
+                if(prefetcher == NULL){
+                    return false;
+                }
+                prefetchers.push_back(prefetcher);
+            }
+        }
+        return true;
+    }
+
+    void conditional(int pc, int target, bool taken){
+        for(size_t i = 0; i < predictors.size(); i++){
+            predictors[i]->conditional(pc, target, taken);
+        }
+    }
+
+    void call(int pc, int returnAddress){
+        for(size_t i = 0; i < predictors.size(); i++){
+            predictors[i]->call(pc, returnAddress);
+        }
+    }
+
+    void ret(int pc, int target){
+        for(size_t i = 0; i < predictors.size(); i++){
+            predictors[i]->ret(pc, target);
+        }
+    }
+
+    void read(int pc, int address){
+        for(size_t i = 0; i < prefetchers.size(); i++){
+            prefetchers[i]->read(pc, address);
+        }
+    }
+
+    /*
+     * Function: report
+     * ----------------
+     * Prints the coverage and accuracy of every plug-in to standard error.
+     */
+    void report() const {
+        for(size_t i = 0; i < predictors.size(); i++){
+            const BranchPredictor& p = *predictors[i];
+            cerr << "predictor " << p.name() << ": " << p.branches << " branches, " << p.predicted
+                 << " predicted (coverage " << percent(p.predicted, p.branches) << "), " << p.correct
+                 << " correct (accuracy " << percent(p.correct, p.predicted) << ")" << endl;
+        }
+        for(size_t i = 0; i < prefetchers.size(); i++){
+            const Prefetcher& p = *prefetchers[i];
+            cerr << "prefetcher " << p.name() << ": " << p.reads << " reads, " << p.covered
+                 << " prefetched (coverage " << percent(p.covered, p.reads) << "), " << p.issued
+                 << " prefetches, " << p.useful << " used (accuracy " << percent(p.useful, p.issued) << ")" << endl;
+        }
+    }
+
+private:
+
+    static BranchPredictor* makePredictor(const string& name){
+        if(name == "static") return new StaticPredictor();
+        if(name == "bimodal") return new BimodalPredictor();
+        if(name == "gshare") return new GsharePredictor();
+        if(name == "ras") return new ReturnStackPredictor();
+        return NULL;
+    }
+
+    static Prefetcher* makePrefetcher(const string& name){
+        if(name == "next-line") return new NextLinePrefetcher();
+        if(name == "stride") return new StridePrefetcher();
+        return NULL;
+    }
+
+    static string percent(long long part, long long whole){
+        char text[32];
+        snprintf(text, sizeof(text), "%.1f%%", whole > 0 ? 100.0 * part / whole : 0.0);
+        return text;
+    }
+};
+
+#endif
@@ -9,7 +9,7 @@
     The program reads a file containing a program to be executed by the CPU.
     CPU and memory processes communicate through pipes, executing instructions and interacting based on the program.
     
-    - Memory Class: Represents computer memory, initializes from file, and provides read/write functionalities.
+    - Memory Class (memory.h): Represents computer memory, initializes from file, and provides read/write functionalities.
     - CPU Class: Represents the Central Processing Unit, executes instructions, handles interrupts, and manages registers.
     - Main Function: Sets up pipes, forks processes, and manages continuous execution of CPU and memory until exit.
     
@@ -36,147 +36,55 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <stdexcept>
+#include <cstring>
+#include <csignal>
+#include <utility>
+
+#include "memory.h"
+#include "isa.h"
+#include "debugger.h"
+#include "aot.h"
+#include "lockstep.h"
+#include "memserver.h"
+#include "cosim.h"
+#include "branch.h"
+#include "pipeline.h"
+#include "plugins.h"
+#include "analysis.h"
+#include "syscalls.h"
+#include "stream.h"
+#include "machine.h"
 
 using namespace std;
 
 
+//Exit status used when a run is stopped by the cycle limit
+static const int CYCLE_LIMIT_EXIT = 3;
+
 /*
- * Memory: Represents the computer's memory
- * ----------------------------------------
- * This class represents the memory of the computer.
- * It includes functionalities to read and write data into memory.
- * The memory size is fixed at 2000 and is initialized from an input file.
+ * Function: dumpRegisters
+ * -----------------------
+ * Writes the register state of a CPU to a state file, replacing its contents.
+ * Memory::dump appends the memory words afterwards.
+ * Parameters:
+ * - fileName: the state file to write.
+ * - PC, SP, IR, AC, X, Y, timer, kernelMode: the CPU state.
  */
-class Memory{
-
-private:
-    //Specifies the size of the memory
-    static const int MEMORY_SIZE = 2000;
-
-    //Used to store user program and system memory
-    int memory[MEMORY_SIZE];
-
-public:
-
-    /*
-     * Constructor: Memory
-     * ----------------
-     * Initializes the Memory by calling on the readInputFile function
-     * Parameters:
-     * - inputFile: the file that represents the program to be executed
-     */
-    Memory(const char* inputFile){
-        readInputFile(inputFile);
-
-    }
-
-    /*
-     * Function: readInputFile 
-     * -------------------
-     * Initializes the memory with data from the input file.
-     * Reads the input file and populates the memory accordingly.
-     * Parameters:
-     * - fileName: the name of the input file containing initial memory data.
-     */
-    void readInputFile(const char* fileName){
-        ifstream inputFile(fileName);
-        if(!inputFile.is_open()){
-            cerr << "ERROR: unable to open the input file" << endl;
-            exit(1);
-        }
-
-        string line;
-        int memoryIndex = 0;
-
-        //Loop through the entire file line by line
-        while (getline(inputFile, line)) {
-            istringstream iss(line);
-            //Check if we are loading to a new address
-            if (iss.peek() == '.'){
-                int newIndex;
-                iss.ignore();
-
-                //read in the new index ignoring space
-                while(iss >> newIndex){
-                    if (iss.peek() == ' ') {
-                        iss.ignore();
-                    }
-                    else {
-                        break; 
-                    }
-                }
-
-                //set new memory index and continue
-                memoryIndex = newIndex;
-                continue;
-            }
-
-            //Read instruction into memory while ignoring space 
-            while (iss >> memory[memoryIndex]) { 
-                ++memoryIndex;
-                if (iss.peek() == ' ') {
-                    iss.ignore(); 
-                }
-                else {
-                    break;
-                }
-            }
-        }
-
-        inputFile.close(); 
-
-        // // Memory check
-        // for(int i = 0; i <= 260; i++){
-        //     //cout << "Value at address "<< i << ": " << memory[i] << endl;
-        // }
-
-    }
-
-    /*
-     * Function: read 
-     * -------------
-     * Reads data from memory at the specified address.
-     * Parameters:
-     * - address: the memory address to read from.
-     * Returns:
-     * The value stored at the specified memory address.
-     */
-    int read(int address) const {
-        if (address < 0 || address >= MEMORY_SIZE) {
-            cerr << "ERROR: Invalid memory address accessed: " << address << endl;
-            cerr << "Exiting..." << endl;
-            exit(EXIT_FAILURE);
-        }
-
-        return memory[address];
-    }
-
-    /*
-     * Function: write 
-     * --------------
-     * Writes data to memory at the specified address.
-     * Parameters:
-     * - address: the memory address to write to.
-     * - data: the data to be written to memory.
-     */
-    void write(int address, int data) {
-        if (address < 0 || address >= MEMORY_SIZE) {
-            cerr << "ERROR: Invalid memory address accessed: " << address << endl;
-            cerr << "Exiting..." << endl;
-            exit(EXIT_FAILURE);
-        }
-
-        memory[address] = data;
-    }
-
-};
+static void dumpRegisters(const char* fileName, int PC, int SP, int IR, int AC, int X, int Y,
+                          int timer, bool kernelMode){
+    ofstream out(fileName, ios::trunc);
+    out << "PC " << PC << '\n' << "SP " << SP << '\n' << "IR " << IR << '\n'
+        << "AC " << AC << '\n' << "X " << X << '\n' << "Y " << Y << '\n'
+        << "timer " << timer << '\n' << "mode " << (kernelMode ? "kernel" : "user") << '\n';
+}
 
 
 /*
  * CPU: Represents the Central Processing Unit
  * -------------------------------------------
  * This class represents the Central Processing Unit (CPU) of the computer.
- * It executes instructions and interacts with memory through communication pipes.
+ * It executes instructions and interacts with memory through communication pipes,
+ * or directly with a Memory in the same process when one is given (direct engine).
  * The CPU includes various registers and supports interrupt handling.
  */
 class CPU {
@@ -207,6 +115,36 @@ public:
     int operand;    //used for program operations
     int signal;     //used to signal to memory (write, exit)
 
+    //Memory accessed directly instead of through the pipes, NULL for the pipe engine
+    Memory* memory;
+
+    //Executed instruction count, and the count at which the run is stopped (0 for no limit)
+    long long cycles;
+    long long cycleLimit;
+
+    //File receiving the final CPU state when the program ends, NULL for none
+    const char* dumpFile;
+
+    //Debugger stopping execution at breakpoints, NULL when not debugging (direct engine only)
+    Debugger* debugger;
+
+    //Marks pushes so the memory process can track stack depth (pipe engine with --mem-profile)
+    bool profileStack;
+
+    //Who may access each address, and the stack fault handler address (-1 for none)
+    AccessMap access;
+    int faultVector;
+
+    //Fault being handled, passed to the fault handler in AC and X
+    int faultCode;
+    int faultAddress;
+
+    //Translated program running the user code, NULL when interpreting (aot engine only)
+    AotProgram* aot;
+
+    //Stream read by instruction 31
+    InputStream input;
+
     /*
      * Constructor: CPU 
      * ----------------
@@ -217,7 +155,21 @@ public:
      * - tCon: time constraint for interrupt handling
      */
     CPU(int pfds_1, int pfds_2, int tCon) : pfds_cpu(pfds_1), pfds_mem(pfds_2), timeConstraint(tCon),
-    interuptEnabled(true), kernelMode(false), PC(0), SP(1000), AC(0), X(0), Y(0), timer(0) {}
+    interuptEnabled(true), kernelMode(false), PC(0), SP(1000), AC(0), X(0), Y(0), timer(0),
+    memory(NULL), cycles(0), cycleLimit(0), dumpFile(NULL), debugger(NULL), profileStack(false),
+    faultVector(-1), faultCode(0), faultAddress(0), aot(NULL) {}
+
+    /*
+     * Constructor: CPU 
+     * ----------------
+     * Initializes a CPU that accesses memory directly, without a memory process.
+     * Parameters:
+     * - mem: the memory to execute from
+     * - tCon: time constraint for interrupt handling
+     */
+    CPU(Memory* mem, int tCon) : CPU(-1, -1, tCon) {
+        memory = mem;
+    }
 
     /*
      * Function: executeInstruction
@@ -228,6 +180,17 @@ public:
      */
     void executeInstruction() {
 
+        //Give the debugger a chance to stop before the instruction runs
+        if(debugger != NULL){
+            debugger->instruction();
+        }
+
+        //Stop runaway programs once the cycle limit is reached
+        if(++cycles == cycleLimit){
+            cerr << "ERROR: Cycle limit reached" << endl;
+            finish(CYCLE_LIMIT_EXIT);
+        }
+
         //Check if a timer interupt has occured
         timerInterupt();
 
@@ -589,18 +552,22 @@ public:
 
                 break;
 
+            case 31:
+                //Reads the next int (port 1) or byte (port 2) of the input stream into AC,
+                //or the end-of-stream flag (port 3)
+
+                //Fetch the port for this instruction
+                fetchOperand();
+
+                if(!input.read(operand, AC)){
+                    cerr << "Invalid operand for instruction 31.." << endl;
+                }
+                break;
+
             case 50:
                 // End execution
-                // Writes signal -5 to memory to indicate exit
                 // //cout << "CPU EXITING..." << endl;
-                signal = -5;
-                write(pfds_cpu, &signal, sizeof(signal));
-
-                //close pipes
-                close(pfds_cpu);
-                close(pfds_mem);
-                exit(0);
-                
+                finish(0);
                 break;
 
             default:
@@ -658,6 +625,81 @@ public:
     }
     
 
+    /*
+     * Function: finish
+     * ----------------
+     * Ends execution: saves the final state if requested, then
+     * writes signal -5 to memory to indicate exit and closes the pipes.
+     * The memory words of the state come from the memory process (signal -7).
+     * Parameters:
+     * - status: exit status of the program.
+     */
+    void finish(int status){
+        if(dumpFile != NULL){
+            dumpRegisters(dumpFile, PC, SP, IR, AC, X, Y, timer, kernelMode);
+        }
+
+        if(memory != NULL){
+            //Direct engine, memory lives in this process
+            if(dumpFile != NULL){
+                memory->dump(dumpFile);
+            }
+            exit(status);
+        }
+
+        if(dumpFile != NULL){
+            signal = -7;
+            write(pfds_cpu, &signal, sizeof(signal));
+            int words[Memory::MEMORY_SIZE];
+            for(int i = 0; i < Memory::MEMORY_SIZE; i++){
+                receive(words[i]);
+            }
+            Memory::dumpWords(dumpFile, words);
+        }
+
+        signal = -5;
+        write(pfds_cpu, &signal, sizeof(signal));
+
+        //close pipes
+        close(pfds_cpu);
+        close(pfds_mem);
+        exit(status);
+    }
+
+    /*
+     * Function: request
+     * -----------------
+     * Asks the memory process for the word at an address.
+     * Negative numbers are signals in the pipe protocol (see memserver.h), so a negative
+     * address is reported here, the same way Memory reports it, instead of being sent.
+     * Parameters:
+     * - address: the address to read.
+     */
+    void request(int address){
+        if(address < 0){
+            cerr << "ERROR: Invalid memory address accessed: " << address << endl;
+            cerr << "Exiting..." << endl;
+            exit(EXIT_FAILURE);
+        }
+        write(pfds_cpu, &address, sizeof(address));
+    }
+
+    /*
+     * Function: receive
+     * -----------------
+     * Reads one reply from the memory process.
+     * The memory process exits on an invalid address, in which case the CPU
+     * flushes the output it has produced and exits as well.
+     * Parameters:
+     * - value: receives the reply.
+     */
+    void receive(int& value){
+        if(read(pfds_mem, &value, sizeof(value)) != sizeof(value)){
+            cout.flush();
+            _exit(1);
+        }
+    }
+
     /*
      * Function: popStack
      * -------------------
@@ -670,16 +712,21 @@ public:
         //cout << "Pop stack at index: " << SP << endl;
 
         //Ensure proper permission
-        checkPermission(SP);
+        checkPermission(SP, AccessMap::USER_STACK);
 
         //used to read in what was on the stack 
         int data;
 
-        //Requesting value at top of stack
-        write(pfds_cpu, &SP, sizeof(SP));
+        if(memory != NULL){
+            data = memory->read(SP);
+        }
+        else{
+            //Requesting value at top of stack
+            request(SP);
 
-        //Reading that value
-        read(pfds_mem, &data, sizeof(data));
+            //Reading that value
+            receive(data);
+        }
 
         //increment stack
         SP++;
@@ -703,17 +750,26 @@ public:
         SP--;
 
         //Ensure proper permission
-        checkPermission(SP);
+        checkPermission(SP, AccessMap::USER_STACK);
 
         //cout << "Push stack at index = " << SP << endl;
 
-        //signal to the memory cpu is about to write 
-        signal = -1;
-        write(pfds_cpu, &signal, sizeof(signal));
+        if(memory != NULL){
+            if(debugger != NULL){
+                debugger->written(SP, data);
+            }
+            memory->write(SP, data);
+            memory->noteStackPointer(SP, kernelMode);
+            if(aot != NULL){
+                aot->written(SP);
+            }
+            return;
+        }
 
-        //Write data to memory at given address
-        write(pfds_cpu, &SP, sizeof(SP));
-        write(pfds_cpu, &data, sizeof(data));
+        //signal to the memory cpu is about to write (-6 for a user mode push and -8 for a kernel
+        //mode push when profiling the stacks), followed by the address and data, in one message
+        int message[3] = {profileStack ? (kernelMode ? -8 : -6) : -1, SP, data};
+        write(pfds_cpu, message, sizeof(message));
     }
 
     /*
@@ -728,15 +784,22 @@ public:
     void writeMemory(int address, int data){
 
         //Ensure proper permission
-        checkPermission(address);
+        checkPermission(address, AccessMap::USER_DATA);
 
-        //Notify memory we are preparing to write 
-        signal = -1;
-        write(pfds_cpu, &signal, sizeof(signal));
+        if(memory != NULL){
+            if(debugger != NULL){
+                debugger->written(address, data);
+            }
+            memory->write(address, data);
+            if(aot != NULL){
+                aot->written(address);
+            }
+            return;
+        }
 
-        //Write data to memory at given address
-        write(pfds_cpu, &address, sizeof(address));
-        write(pfds_cpu, &data, sizeof(data));
+        //Notify memory we are preparing to write, followed by the address and data
+        int message[3] = {-1, address, data};
+        write(pfds_cpu, message, sizeof(message));
     }
 
     /*
@@ -750,14 +813,19 @@ public:
     void readMemory(int address){
 
         //Ensure proper permission
-        checkPermission(address);
+        checkPermission(address, AccessMap::USER_DATA);
+
+        if(memory != NULL){
+            operand = memory->read(address);
+            return;
+        }
         
         //Fetch memory at address
         // //cout <<"Reading from address: " <<address<<endl;
-        write(pfds_cpu, &address, sizeof(address));
+        request(address);
     
         //Read the returned memory
-        read(pfds_mem, &operand, sizeof(operand));
+        receive(operand);
         // //cout <<"Read: " << operand<<endl;
     }
 
@@ -770,12 +838,17 @@ public:
      */
     void fetchInstruction(){
 
+        if(memory != NULL){
+            IR = memory->read(PC);
+            return;
+        }
+
         //Fetch next program instruction
-        write(pfds_cpu, &PC, sizeof(PC));
+        request(PC);
         //cout << endl << "CPU fetch at index: " << PC << endl;
 
         //Read the program instruction from memory
-        read(pfds_mem, &IR, sizeof(IR));
+        receive(IR);
         //cout << "CPU executing instruction: " << IR << endl;
     }
 
@@ -787,8 +860,12 @@ public:
      */
     void fetchOperand(){
             PC++;
-            write(pfds_cpu, &PC, sizeof(PC));
-            read(pfds_mem, &operand, sizeof(operand));
+            if(memory != NULL){
+                operand = memory->read(PC);
+                return;
+            }
+            request(PC);
+            receive(operand);
             // //cout << "CPU READ OPERAND: " << operand << endl;
             
     }
@@ -800,12 +877,12 @@ public:
      * Saves the current CPU context on the system stack, enters kernel mode,
      * and calls the appropriate interrupt handler (timer or system call).
      * Parameters:
-     * - code: The code indicating the type of interrupt (0 for timer, 1 for sys call).
+     * - code: The code indicating the type of interrupt (0 for timer, 1 for sys call, 2 for stack fault).
      */
     void interruptHandler(int code){
 
         //Ensure proper permission
-        checkPermission(PC);
+        checkPermission(PC, AccessMap::USER_DATA);
 
         //avoid nested exectution of interupts 
         interuptEnabled = false;
@@ -866,6 +943,21 @@ public:
 
             }
         }
+        else if(code == 2){
+            //stack fault, the handler gets the fault in AC and the address in X
+            AC = faultCode;
+            X = faultAddress;
+            PC = faultVector;
+
+            //Loop instruction cycles until the handler returns
+            while(kernelMode){
+                fetchInstruction();
+                executeInstruction();
+                if(kernelMode){
+                    PC++;
+                }
+            }
+        }
         else{
             cerr << "ERROR: Invalid interupt signal" << endl;
             //cout << "Exiting..." << endl;
@@ -877,16 +969,54 @@ public:
     /*
      * Function: checkPermission
      * --------------------------
-     * Check if the user program is attempting to access system memory
+     * Check if the program may access an address: user programs may not access system memory,
+     * and limited stacks may not leave their region or touch their guard region.
      * Parameters:
      * - address: the address the program is attempting to access
+     * - kind: AccessMap::USER_DATA for loads and stores, AccessMap::USER_STACK for pushes and pops
      */
-    void checkPermission(int address){
-        if(address >= 1000 && !kernelMode){
-            cerr << "ERROR: User can not access system memory" << endl;
-            cerr << "Exiting..." << endl;
-            _exit(1);
+    void checkPermission(int address, unsigned char kind){
+        if(!access.allows(address, kind, kernelMode)){
+            accessFault(address, kind);
+        }
+    }
+
+    /*
+     * Function: accessFault
+     * ---------------------
+     * Handles an access refused by the access map.
+     * A stack fault in user mode raises the fault interrupt when a handler is installed;
+     * faults cannot be resumed, so the program ends once the handler returns.
+     * Parameters:
+     * - address: the address accessed
+     * - kind: the kind of access
+     */
+    void accessFault(int address, unsigned char kind){
+        AccessMap::Fault fault = access.classify(address, kind, kernelMode);
+        if(fault == AccessMap::NO_FAULT){
+            return;     //the memory access reports the invalid address
         }
+
+        if(fault != AccessMap::PERMISSION_FAULT && faultVector >= 0 && !kernelMode){
+            faultCode = fault;
+            faultAddress = address;
+
+            //Save user SP and PC on the system stack like any other interrupt
+            kernelMode = true;
+            operand = SP;
+            SP = 2000;
+            pushStack(operand);
+            pushStack(PC);
+            interruptHandler(2);
+        }
+
+        cerr << "ERROR: " << AccessMap::describe(fault);
+        if(fault != AccessMap::PERMISSION_FAULT){
+            cerr << " at address " << address;
+        }
+        cerr << endl;
+        cerr << "Exiting..." << endl;
+        exit(1);
     }
 
     /*
@@ -895,170 +1025,1653 @@ public:
      * Prints the values of all registers for debugging purposes.
      */
     void printRegisters(){
-        //cout << "PC: " << PC << endl;
-        //cout << "SP: " << SP << endl;
-        //cout << "IR: " << IR << endl;
-        //cout << "AC: " << AC << endl;
-        //cout << "X: " << X << endl;
-        //cout << "Y: " << Y << endl << endl;
+        cerr << "PC: " << PC << endl;
+        cerr << "SP: " << SP << endl;
+        cerr << "IR: " << IR << endl;
+        cerr << "AC: " << AC << endl;
+        cerr << "X: " << X << endl;
+        cerr << "Y: " << Y << endl << endl;
+    }
+
+    /*
+     * Function: attachDebugger
+     * ------------------------
+     * Lets a debugger stop this CPU and inspect its registers and memory.
+     * Parameters:
+     * - dbg: the debugger
+     */
+    void attachDebugger(Debugger* dbg){
+        debugger = dbg;
+        debugger->attach(memory, Debugger::Registers{&PC, &SP, &IR, &AC, &X, &Y, &timer, &kernelMode, &cycles});
+    }
+
+    /*
+     * Function: runTranslated
+     * -----------------------
+     * Runs the translated program from PC while in user mode. Returns at the next instruction
+     * the interpreter has to execute, with the registers updated. Stops using the translation
+     * for good once the program has modified its own code.
+     */
+    void runTranslated(){
+        if(!aot->valid()){
+            aot = NULL;
+            return;
+        }
+        if(kernelMode){
+            return;
+        }
+
+        AotState& state = aot->state;
+        state.PC = PC;
+        state.SP = SP;
+        state.AC = AC;
+        state.X = X;
+        state.Y = Y;
+        state.timer = timer;
+        state.timeConstraint = timeConstraint;
+        state.interruptEnabled = interuptEnabled;
+        state.cycles = cycles;
+        state.cycleLimit = cycleLimit;
+        state.input = &input;
+
+        aot->run();
+
+        PC = state.PC;
+        SP = state.SP;
+        AC = state.AC;
+        X = state.X;
+        Y = state.Y;
+        timer = state.timer;
+        cycles = state.cycles;
     }
 };
 
 
 
 /*
- * Main Function
- * -------------
- * The main function that sets up communication pipes, forks the process,
- * and manages the cpu and memory process.
- * Parameters:
- * - argc: the number of command-line arguments.
- * - argv: an array of command-line arguments.
-*/
-int main(int argc, char *argv[]) {
+ * EngineFeature: Parts of the predecoded engine that a variant compiles in
+ * ------------------------------------------------------------------------
+ * Every combination is its own PredecodedCPU instantiation, so a feature that is left out
+ * costs nothing at run time instead of a test per instruction. The debugger, the memory
+ * profile and the pipeline model share one feature, each hook testing whether its part is
+ * attached: runs using none of them pay nothing, and there are 8 variants to compile, not 32.
+ */
+enum EngineFeature {
+    TIMER_FEATURE = 1,      //timer interrupts
+    CHECK_FEATURE = 2,      //access map checks: user/system memory, stack limits and guards
+    HOOK_FEATURE = 4        //debugger, memory profile of instruction and operand fetches, pipeline model
+};
+static const unsigned ALL_FEATURES = 7;
 
-    // Used to store the command line argument 
-    int timerInput;
 
-    //used for fork
-    pid_t pid;
+/*
+ * PredecodedCPU: CPU executing from a predecoded copy of memory
+ * --------------------------------------------------------------
+ * Alternative execution engine with the same semantics as CPU.
+ * Every address is decoded once into its opcode and the word following it (the operand),
+ * so fetching an instruction and its operand is a single array access.
+ * Writes update the decoded copy, which keeps self-modifying programs correct.
+ * Jumps continue the dispatch loop instead of recursing into executeInstruction.
+ * Dispatch expands to an execute<CODE> for every instruction word, and the instruction set
+ * table (isa.h) decides each one's operand fetch, jump and addressing mode.
+ * FEATURES is a set of EngineFeature bits.
+ */
+template<unsigned FEATURES>
+class PredecodedCPU {
+public:
+    //Registers
+    int PC; //Program Counter
+    int SP; //Stack Pointer
+    int IR; //Instruction Register
+    int AC; //Accumulator
+    int X;  //Additional
+    int Y;  //Additional
 
-    //Check for proper usage 
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " <file name> <timer>" << endl;
-        _exit(1);
-    }
+    //mode
+    bool kernelMode;
 
-    //Ensure argumetn is an integer
-    try {
-        stringstream container(argv[2]);
-        int x;
-        container >> timerInput;
-        // cout << "Value of x: " << timerInput;
-        } 
-        catch (const invalid_argument& e) {
+    //Timer for interrupts, a branch variant may change the constraint
+    int timer;
+    int timeConstraint;
 
-            // Failed to convert
-            cerr << "ERROR: Second argument must be an integer" << endl;
-            cerr << "Exiting..." << endl;
-            _exit(1);
-        }
+    //enable/disable interupts 
+    bool interuptEnabled;
 
+    //Executed instruction count, and the count at which the run is stopped (0 for no limit)
+    long long cycles;
+    long long cycleLimit;
 
-    //pipe to write from cpu to memory
-    int pfds_cpu[2];    //CPU -> Mem
+    //File receiving the final CPU state when the program ends, NULL for none
+    const char* dumpFile;
 
-    //pipe to write from memory to cpu
-    int pfds_mem[2];    //Mem -> CPU
+    //Debugger stopping execution at breakpoints, used with HOOK_FEATURE
+    Debugger* debugger;
 
-    //Seed to ensure we arent producing the same random number with instruction
-    //Must be called here because if called within the instruction it produces the same integer
-    srand(time(NULL));
+    //Who may access each address, and the stack fault handler address (-1 for none)
+    AccessMap access;
+    int faultVector;
 
-    //Check if pipes failed
-    if(pipe(pfds_cpu) == -1){
-        cerr << "ERROR: The cpu pipe failed" << endl;
-        exit(1);
-    }
-    if(pipe(pfds_mem) == -1){
-        cerr << "ERROR: The memory pipe failed" << endl;
+    //Branch point reached when cycles hits cycleLimit, NULL for none
+    BranchPoint* branchPoint;
 
-        //close the open pipes
-        close(pfds_cpu[0]);
-        close(pfds_cpu[1]);
-        exit(1);
-    }
+    //Timing model fed every executed instruction, used with HOOK_FEATURE
+    PipelineModel* pipeline;
 
-    //spawn the child process (CPU)
-    pid = fork();
+    //Services answering system calls without running the handler, NULL to always run it
+    SyscallTable* syscalls = NULL;
 
-    //Check if Fork failed
-    if(pid == -1){
-       cerr << "ERROR: The fork failed" << endl;
-       exit(1);
-    }
-    else if(pid == 0){
-        //Child process (CPU)
-        CPU cpu(pfds_cpu[1], pfds_mem[0], timerInput);
+    //Stream read by instruction 31
+    InputStream input;
 
-        //Close unused pipe ends
-        close(pfds_cpu[0]);
-        close(pfds_mem[1]);
+#ifdef CSIM_PLUGINS
+    //Branch predictors and prefetchers watching the run, NULL for none
+    Plugins* plugins = NULL;
 
-        //Instruction cycle loop until program ends
-        while(true){
-            
-            //Fetch next program instruction
-            cpu.fetchInstruction();
+    //Address of the instruction being executed, for the plug-ins
+    int instructionPC = 0;
+#endif
 
-            //Execute program instruction
-            cpu.executeInstruction();
-            //cout << "Timer: " << cpu.timer << endl;
+private:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    static constexpr bool TIMER = (FEATURES & TIMER_FEATURE) != 0;
+    static constexpr bool CHECKS = (FEATURES & CHECK_FEATURE) != 0;
+    static constexpr bool HOOKS = (FEATURES & HOOK_FEATURE) != 0;
+
+    /*
+     * Decoded: The word at an address and the word following it
+     */
+    struct Decoded {
+        int opcode;
+        int operand;
+    };
+
+    Memory& memory;
+    Decoded code[MEMORY_SIZE];
+
+    //The syscall table while it records a simulated system call, NULL otherwise
+    SyscallTable* trace = NULL;
+
+public:
+
+    /*
+     * Constructor: PredecodedCPU 
+     * --------------------------
+     * Decodes the loaded memory and initializes the registers.
+     * Parameters:
+     * - mem: the memory to execute from
+     * - tCon: time constraint for interrupt handling
+     */
+    PredecodedCPU(Memory& mem, int tCon) : PC(0), SP(1000), IR(0), AC(0), X(0), Y(0),
+    kernelMode(false), timer(0), timeConstraint(tCon), interuptEnabled(true),
+    cycles(0), cycleLimit(0), dumpFile(NULL), debugger(NULL), faultVector(-1), branchPoint(NULL), pipeline(NULL), memory(mem) {
+        for(int i = 0; i < MEMORY_SIZE; i++){
+            code[i].opcode = memory.read(i);
+            code[i].operand = i + 1 < MEMORY_SIZE ? memory.read(i + 1) : 0;
+        }
+    }
+
+    /*
+     * Function: attachDebugger
+     * ------------------------
+     * Lets a debugger stop this CPU and inspect its registers and memory.
+     * Parameters:
+     * - dbg: the debugger
+     */
+    void attachDebugger(Debugger* dbg){
+        debugger = dbg;
+        debugger->attach(&memory, Debugger::Registers{&PC, &SP, &IR, &AC, &X, &Y, &timer, &kernelMode, &cycles});
+    }
+
+    /*
+     * Function: patch
+     * ---------------
+     * Replaces a memory word, as a branch variant does at its branch point.
+     * Parameters:
+     * - address: the word to replace
+     * - data: its new value
+     */
+    void patch(int address, int data){
+        store(address, data);
+    }
+
+    /*
+     * Function: run
+     * -------------
+     * Instruction cycle loop until the program ends.
+     */
+    void run(){
+        while(true){
+            fetchInstruction();
+            executeInstruction();
+            PC++;
+        }
+    }
+
+private:
+
+    /*
+     * Function: dispatch
+     * ------------------
+     * Executes IR with the handler of its instruction word. The comparisons are expanded
+     * from the list of words, which the compiler turns into a jump table with every handler
+     * inlined.
+     * Returns:
+     * true if execution continues at the target of a jump or call.
+     */
+    template<int... CODES>
+    bool dispatch(integer_sequence<int, CODES...>){
+        bool jumped = false;
+        if(!((IR == CODES && (jumped = execute<CODES>(), true)) || ...)){
+            invalidInstruction();
+        }
+        return jumped;
+    }
+
+    /*
+     * Function: executeInstruction
+     * ----------------------------
+     * Executes the instruction in IR, and the instructions reached through taken jumps and calls.
+     * Like CPU::executeInstruction, the caller increments PC afterwards.
+     */
+    void executeInstruction(){
+        do{
+            //Give the debugger a chance to stop before the instruction runs
+            if constexpr(HOOKS){
+                if(debugger != NULL){
+                    debugger->instruction();
+                }
+            }
+
+            //Stop runaway programs once the cycle limit is reached, or fork at the branch point
+            if(++cycles == cycleLimit){
+                if(branchPoint != NULL && cycles == branchPoint->cycle){
+                    branchPoint->branch(*this);
+                }
+                else{
+                    cerr << "ERROR: Cycle limit reached" << endl;
+                    finish(CYCLE_LIMIT_EXIT);
+                }
+            }
+
+            //Check if a timer interupt has occured
+            if constexpr(TIMER){
+                timerInterupt();
+            }
+
+            if constexpr(HOOKS){
+                if(pipeline != NULL){
+                    pipeline->instruction(PC, IR);
+                }
+            }
+#ifdef CSIM_PLUGINS
+            instructionPC = PC;
+#endif
+        } while(dispatch(make_integer_sequence<int, MAX_OPCODE + 1>()));
+    }
+
+    /*
+     * Function: execute
+     * -----------------
+     * Executes instruction word CODE. Its operand is fetched, and a jump or call taken,
+     * as the instruction set table describes it.
+     * Returns:
+     * true if execution continues at the target of a jump or call.
+     */
+    template<int CODE>
+    bool execute(){
+        constexpr const Opcode* op = findOpcode(CODE);
+        if constexpr(op == nullptr){
+            invalidInstruction();
+            return false;
+        }
+        else{
+            //A recorded system call is keyed on the registers its handler reads before writing them
+            if constexpr(((op->sources | op->results) & (REG_AC | REG_X | REG_Y)) != 0){
+                if(trace != NULL){
+                    trace->registers(op->sources, op->results);
+                }
+            }
+
+            //A conditional jump that is not taken skips its operand
+            if constexpr(CODE == 21 || CODE == 22){
+                bool taken = (AC == 0) == (CODE == 21);
+#ifdef CSIM_PLUGINS
+                if(plugins != NULL){
+                    plugins->conditional(PC, code[PC].operand, taken);
+                }
+#endif
+                if(!taken){
+                    PC++;
+                    return false;
+                }
+            }
+
+            int operand = 0;
+            if constexpr(op->operands > 0){
+                operand = fetchOperand();
+            }
+
+            if constexpr(op->branch && op->operands > 0){
+                //Jump or call, then execute the target without returning to the caller
+                if constexpr(CODE == 23){
+                    pushStack(PC);
+#ifdef CSIM_PLUGINS
+                    if(plugins != NULL){
+                        plugins->call(instructionPC, PC);
+                    }
+#endif
+                }
+                PC = operand;
+                fetchInstruction();
+                return true;
+            }
+            else if constexpr(dataLoad(*op)){
+                //Loads, the table gives the addressing mode
+                AC = readMemory(effectiveAddress<op->mode>(operand));
+            }
+            else if constexpr(dataStore(*op)){
+                writeMemory(effectiveAddress<op->mode>(operand), AC);
+            }
+            else if constexpr(registerTransfer(*op)){
+                transfer<CODE>(AC, X, Y, SP);
+            }
+            else if constexpr(CODE == 1){
+                AC = operand;
+            }
+            else if constexpr(CODE == 8){
+                if(trace != NULL){
+                    trace->abandon();
+                    trace = NULL;
+                }
+                AC = rand() % 100 + 1;
+            }
+            else if constexpr(CODE == 9){
+                if(trace != NULL){
+                    trace->put(operand, AC);
+                }
+                output(operand, AC);
+            }
+            else if constexpr(CODE == 31){
+                if(trace != NULL){
+                    trace->abandon();
+                    trace = NULL;
+                }
+                if(!input.read(operand, AC)){
+                    cerr << "Invalid operand for instruction 31.." << endl;
+                }
+            }
+            else if constexpr(CODE == 24){
+                PC = popStack();
+#ifdef CSIM_PLUGINS
+                if(plugins != NULL){
+                    plugins->ret(instructionPC, PC);
+                }
+#endif
+            }
+            else if constexpr(CODE == 27) pushStack(AC);
+            else if constexpr(CODE == 28) AC = popStack();
+            else if constexpr(CODE == 29){
+                //System call, save user SP and PC on the system stack
+                kernelMode = true;
+                int userSP = SP;
+                SP = 2000;
+                pushStack(userSP);
+                pushStack(PC);
+                interruptHandler(1);
+            }
+            else if constexpr(CODE == 30){
+                if(trace != NULL){
+                    trace->finish(SP, cycles);
+                    trace = NULL;
+                }
+                returnFromInterrupt();
+            }
+            else if constexpr(CODE == 50){
+                finish(0);
+            }
+            return false;
+        }
+    }
+
+    /*
+     * Function: output
+     * ----------------
+     * Put: writes value as an integer (port 1) or a character (port 2).
+     */
+    static void output(int port, int value){
+        if(port == 1){
+            cout << value;
+        }
+        else if(port == 2){
+            cout << char(value);
+        }
+        else{
+            cerr << "Invalid operand for instruction 9.." << endl;
+        }
+    }
+
+    /*
+     * Function: returnFromInterrupt
+     * -----------------------------
+     * IRet: restores the user program context from the system stack.
+     */
+    void returnFromInterrupt(){
+        Y = popStack();
+        X = popStack();
+        AC = popStack();
+        IR = popStack();
+        PC = popStack();
+        SP = popStack();
+        kernelMode = false;
+        interuptEnabled = true;
+    }
+
+    /*
+     * Function: effectiveAddress
+     * --------------------------
+     * Returns:
+     * The address of the data of an instruction with addressing mode MODE.
+     */
+    template<AddressingMode MODE>
+    int effectiveAddress(int operand){
+        if constexpr(MODE == INDIRECT){
+            return readMemory(operand);
+        }
+        else if constexpr(MODE == INDEXED_X){
+            return operand + X;
+        }
+        else if constexpr(MODE == INDEXED_Y){
+            return operand + Y;
+        }
+        else if constexpr(MODE == STACK_INDEXED){
+            return SP + X;
+        }
+        else{
+            return operand;
+        }
+    }
+
+    void invalidInstruction(){
+        cerr << "ERROR: Invalid instruction: " << IR << endl;
+        exit(1);
+    }
+
+    /*
+     * Function: timerInterupt
+     * -----------------------
+     * Enters the timer interrupt handler once the timer constraint is exceeded,
+     * otherwise increments the timer.
+     */
+    void timerInterupt(){
+        if(interuptEnabled && timer >= timeConstraint){
+            kernelMode = true;
+            int userSP = SP;
+            SP = 2000;
+            pushStack(userSP);
+            pushStack(PC);
+            interruptHandler(0);
+        }
+        else{
+            timer++;
+        }
+    }
+
+    /*
+     * Function: interruptHandler
+     * --------------------------
+     * Saves the rest of the context and runs the handler at 1000 (timer, code 0),
+     * 1500 (system call, code 1) or faultVector (stack fault, code 2) until it returns with IRet.
+     * Parameters:
+     * - code: The code indicating the type of interrupt.
+     * - fault, address: the stack fault, passed to its handler in AC and X.
+     */
+    void interruptHandler(int code, int fault = 0, int address = 0){
+        interuptEnabled = false;
+
+        pushStack(IR);
+        pushStack(AC);
+        pushStack(X);
+        pushStack(Y);
+
+        if(code == 0){
+            timer = 0;
+            PC = 1000;
+        }
+        else if(code == 1){
+            PC = 1500;
+            if(syscalls != NULL && systemCall()){
+                return;
+            }
+        }
+        else{
+            AC = fault;
+            X = address;
+            PC = faultVector;
+        }
+
+        while(kernelMode){
+            fetchInstruction();
+            executeInstruction();
+            if(kernelMode){
+                PC++;
+            }
+        }
+    }
+
+    /*
+     * Function: systemCall
+     * --------------------
+     * Answers the system call just entered with a service of the syscall table when one matches:
+     * its writes, output, cycles and timer ticks are applied and the CPU returns with IRet.
+     * Otherwise the handler is simulated, and recorded so that the next such call can be answered.
+     * A system call made by the handler ends the recording of the call it is handling.
+     * Returns:
+     * true if the call was answered and the CPU is back in user mode.
+     */
+    bool systemCall(){
+        if(trace != NULL){
+            trace->abandon();
+            trace = NULL;
+            return false;
+        }
+
+        const SyscallTable::Service* service = syscalls->find(AC, X, Y, memory.words());
+        if(service == NULL){
+            if(syscalls->record(AC, X, Y, cycles)){
+                trace = syscalls;
+            }
+            return false;
+        }
+
+        //The cycle limit or branch point falls inside the handler, which has to run
+        if(cycleLimit != 0 && cycles + service->instructions >= cycleLimit){
+            return false;
+        }
+
+        for(size_t i = 0; i < service->writes.size(); i++){
+            store(service->writes[i].address, service->writes[i].value);
+        }
+        for(size_t i = 0; i < service->output.size(); i++){
+            output(service->output[i].port, service->output[i].value);
+        }
+        cycles += service->instructions;
+        if constexpr(TIMER){
+            timer += service->instructions;
+        }
+        SP = service->returnSP;
+        returnFromInterrupt();
+        return true;
+    }
+
+    /*
+     * Function: finish
+     * ----------------
+     * Ends execution, saving the final state if requested.
+     * Parameters:
+     * - status: exit status of the program.
+     */
+    void finish(int status){
+        if(dumpFile != NULL){
+            dumpRegisters(dumpFile, PC, SP, IR, AC, X, Y, timer, kernelMode);
+            memory.dump(dumpFile);
+        }
+        exit(status);
+    }
+
+    /*
+     * Function: fetchInstruction
+     * --------------------------
+     * Loads the decoded opcode at PC into IR.
+     */
+    void fetchInstruction(){
+        if((unsigned)PC >= (unsigned)MEMORY_SIZE){
+            memory.read(PC);    //reports the invalid address and exits
+        }
+        if constexpr(HOOKS){
+            if(memory.profile != NULL){
+                memory.profile->read(PC);
+            }
+        }
+        IR = code[PC].opcode;
+    }
+
+    /*
+     * Function: fetchOperand
+     * ----------------------
+     * Advances PC to the operand of the current instruction.
+     * Returns:
+     * The operand.
+     */
+    int fetchOperand(){
+        if((unsigned)PC < (unsigned)(MEMORY_SIZE - 1)){
+            if constexpr(HOOKS){
+                if(memory.profile != NULL){
+                    memory.profile->read(PC + 1);
+                }
+            }
+            return code[PC++].operand;
+        }
+        PC++;
+        return memory.read(PC);
+    }
+
+    /*
+     * Function: readMemory
+     * --------------------
+     * Reads a data word after checking permissions.
+     * Parameters:
+     * - address: The memory address to read from.
+     * Returns:
+     * The word at address.
+     */
+    int readMemory(int address){
+        checkPermission(address, AccessMap::USER_DATA);
+#ifdef CSIM_PLUGINS
+        if(plugins != NULL){
+            plugins->read(instructionPC, address);
+        }
+#endif
+        int data = memory.read(address);
+        if(trace != NULL){
+            trace->read(address, data);
+        }
+        return data;
+    }
+
+    /*
+     * Function: writeMemory
+     * ---------------------
+     * Writes a data word after checking permissions and updates the decoded copy.
+     * Parameters:
+     * - address: The memory address to write to.
+     * - data: The data to write.
+     */
+    void writeMemory(int address, int data){
+        checkPermission(address, AccessMap::USER_DATA);
+        store(address, data);
+    }
+
+    /*
+     * Function: store
+     * ---------------
+     * Writes memory and the two decoded entries that contain the word:
+     * the opcode at address and the operand of the instruction before it.
+     * Parameters:
+     * - address: The memory address to write to.
+     * - data: The data to write.
+     */
+    void store(int address, int data){
+        if constexpr(HOOKS){
+            if(debugger != NULL){
+                debugger->written(address, data);
+            }
+        }
+        memory.write(address, data);
+        if(trace != NULL){
+            trace->write(address, data);
+        }
+        code[address].opcode = data;
+        if(address > 0){
+            code[address - 1].operand = data;
+        }
+    }
+
+    /*
+     * Function: pushStack
+     * -------------------
+     * Decrements SP and writes data at the new top of stack.
+     * Parameters:
+     * - data: The value to push onto the stack.
+     */
+    void pushStack(int data){
+        SP--;
+        checkPermission(SP, AccessMap::USER_STACK);
+        store(SP, data);
+        memory.noteStackPointer(SP, kernelMode);
+    }
+
+    /*
+     * Function: popStack
+     * ------------------
+     * Reads the top of stack and increments SP.
+     * Returns:
+     * The popped value.
+     */
+    int popStack(){
+        checkPermission(SP, AccessMap::USER_STACK);
+        int data = memory.read(SP);
+        if(trace != NULL){
+            trace->read(SP, data);
+        }
+        SP++;
+        return data;
+    }
+
+    /*
+     * Function: checkPermission
+     * -------------------------
+     * Checks an access against the access map, see CPU::checkPermission.
+     * Variants without CHECK_FEATURE only keep the bounds check of Memory.
+     * Parameters:
+     * - address: the address the program is attempting to access
+     * - kind: AccessMap::USER_DATA or AccessMap::USER_STACK
+     */
+    void checkPermission(int address, unsigned char kind){
+        if(CHECKS && !access.allows(address, kind, kernelMode)){
+            accessFault(address, kind);
+        }
+    }
+
+    /*
+     * Function: accessFault
+     * ---------------------
+     * Reports a refused access, running the fault handler first for a user stack fault.
+     * Parameters:
+     * - address: the address accessed
+     * - kind: the kind of access
+     */
+    void accessFault(int address, unsigned char kind){
+        AccessMap::Fault fault = access.classify(address, kind, kernelMode);
+        if(fault == AccessMap::NO_FAULT){
+            return;
+        }
+
+        if(fault != AccessMap::PERMISSION_FAULT && faultVector >= 0 && !kernelMode){
+            kernelMode = true;
+            int userSP = SP;
+            SP = 2000;
+            pushStack(userSP);
+            pushStack(PC);
+            interruptHandler(2, fault, address);
+        }
+
+        cerr << "ERROR: " << AccessMap::describe(fault);
+        if(fault != AccessMap::PERMISSION_FAULT){
+            cerr << " at address " << address;
+        }
+        cerr << endl;
+        cerr << "Exiting..." << endl;
+        exit(1);
+    }
+};
+
+
+
+//Profile of the Memory owned by this process, written by writeProfile at exit
+static MemoryProfile* activeProfile = NULL;
 
-            //Increment Program Counter
-            cpu.PC++;
+//Pipeline model of the predecoded engine, written by writePipeline at exit
+static PipelineModel* activePipeline = NULL;
+
+//Branch predictors and prefetchers of the predecoded engine, reported by writePlugins at exit
+static Plugins* activePlugins = NULL;
+
+//System call services of the predecoded engine, NULL unless system calls are emulated
+static SyscallTable* activeSyscalls = NULL;
+
+//File read by instruction 31, mapped once and read by every CPU of the run; empty without --input
+static InputFile activeInput;
+
+/*
+ * Function: writeProfile
+ * ----------------------
+ * Writes the memory profile report, registered with atexit so that runs ending
+ * on an error are profiled too.
+ */
+static void writeProfile(){
+    if(activeProfile != NULL){
+        activeProfile->report();
+    }
+}
+
+/*
+ * Function: writePipeline
+ * -----------------------
+ * Writes the pipeline model report at exit, like writeProfile.
+ */
+static void writePipeline(){
+    if(activePipeline != NULL){
+        activePipeline->report();
+    }
+}
+
+/*
+ * Function: writePlugins
+ * ----------------------
+ * Reports the coverage and accuracy of the plug-ins at exit, like writeProfile.
+ */
+static void writePlugins(){
+    if(activePlugins != NULL){
+        activePlugins->report();
+    }
+}
+
+/*
+ * Function: runPredecoded
+ * -----------------------
+ * Runs the PredecodedCPU variant compiled with exactly the requested features,
+ * searching down from variant F.
+ * Parameters:
+ * - features: the EngineFeature bits of the run
+ * - memory: the loaded program
+ * - timer, cycleLimit, dumpFile, access, faultVector: the CPU settings
+ * - debugger: the debugger to attach with HOOK_FEATURE
+ * - branchPoint: where the run forks into its variants, NULL for none
+ */
+template<unsigned F>
+static void runPredecoded(unsigned features, Memory& memory, int timer, long long cycleLimit, const char* dumpFile,
+                          const AccessMap& access, int faultVector, Debugger* debugger, BranchPoint* branchPoint){
+    if constexpr(F > 0){
+        if(features != F){
+            runPredecoded<F - 1>(features, memory, timer, cycleLimit, dumpFile, access, faultVector, debugger, branchPoint);
+            return;
+        }
+    }
+    PredecodedCPU<F> cpu(memory, timer);
+    memory.profile = activeProfile;     //after decoding, which reads every word
+    cpu.cycleLimit = cycleLimit;
+    cpu.dumpFile = dumpFile;
+    cpu.access = access;
+    cpu.faultVector = faultVector;
+    cpu.pipeline = activePipeline;
+    cpu.syscalls = activeSyscalls;
+    cpu.input = InputStream(&activeInput);
+#ifdef CSIM_PLUGINS
+    cpu.plugins = activePlugins;
+#endif
+    if(debugger != NULL){
+        cpu.attachDebugger(debugger);
+    }
+    if(branchPoint != NULL){
+        cpu.branchPoint = branchPoint;
+        cpu.cycleLimit = branchPoint->cycle;
+        branchPoint->cycleLimit = cycleLimit;
+        branchPoint->dumpFile = dumpFile;
+        branchPoint->captureOutput();
+    }
+    cpu.run();
+}
+
+
+/*
+ * Function: check
+ * ---------------
+ * Reports a command line constraint that does not hold.
+ * Parameters:
+ * - valid: whether the constraint holds
+ * - message: what is wrong, printed after "ERROR: "
+ * Returns:
+ * valid, so the checks can be chained.
+ */
+static bool check(bool valid, const string& message){
+    if(!valid){
+        cerr << "ERROR: " << message << endl;
+    }
+    return valid;
+}
+
+
+/*
+ * Function: parseList
+ * -------------------
+ * Reads a sweep list such as "5,10,20-25" into its values.
+ * Parameters:
+ * - text: comma separated numbers and inclusive ranges
+ * - values: receives the values
+ * Returns:
+ * false if the list is malformed or empty.
+ */
+static bool parseList(const char* text, vector<long long>& values){
+    stringstream list(text);
+    string item;
+    while(getline(list, item, ',')){
+        char* end;
+        long long first = strtoll(item.c_str(), &end, 10);
+        long long last = first;
+        if(end == item.c_str()){
+            return false;
+        }
+        if(*end == '-'){
+            const char* start = end + 1;
+            last = strtoll(start, &end, 10);
+            if(end == start || last < first || last - first > 1000000){
+                return false;
+            }
+        }
+        if(*end != '\0'){
+            return false;
+        }
+        for(long long value = first; value <= last; value++){
+            values.push_back(value);
+        }
+    }
+    return !values.empty();
+}
+
+
+/*
+ * Function: parsePatch
+ * --------------------
+ * Reads the memory patch of a branch variant, such as "700:5,701:-1".
+ * Parameters:
+ * - text: comma separated address:value pairs
+ * - words: receives the patched words
+ * Returns:
+ * false if the patch is malformed, empty or outside memory.
+ */
+static bool parsePatch(const char* text, vector<BranchPoint::Patch>& words){
+    stringstream list(text);
+    string item;
+    while(getline(list, item, ',')){
+        char* end;
+        long address = strtol(item.c_str(), &end, 10);
+        if(end == item.c_str() || *end != ':' || address < 0 || address >= Memory::MEMORY_SIZE){
+            return false;
+        }
+        const char* start = end + 1;
+        long value = strtol(start, &end, 10);
+        if(end == start || *end != '\0'){
+            return false;
+        }
+        words.push_back(BranchPoint::Patch{(int)address, (int)value});
+    }
+    return !words.empty();
+}
+
+
+/*
+ * Main Function
+ * -------------
+ * The main function that sets up communication pipes, forks the process,
+ * and manages the cpu and memory process.
+ * Options given before the file name select another execution engine
+ * and control runs made by the regression tester:
+ * - --engine=pipe|direct|predecoded|aot|lockstep|coroutine|machine: how the program is executed (pipe by
+ *   default); coroutine (cosim.h) needs a C++20 build, machine runs it through the library API of machine.h
+ * - --seed=N: seed for Get instead of the current time
+ * - --max-cycles=N: stop with exit status 3 after N instructions
+ * - --dump-state=FILE: write registers and memory to FILE when the program ends
+ * - --debug: run under the interactive debugger (debugger.h) with the predecoded or direct engine
+ * - --mem-profile=PREFIX: count memory accesses and write the reports of memprofile.h at exit
+ * - --ws-window=N: memory accesses per working-set window of the profile (1000 by default)
+ * - --user-stack=N, --system-stack=N: limit a stack to its top N words, pushing beyond is a stack fault
+ * - --stack-guard=N: words below each limited stack that no data access may touch (0 by default)
+ * - --fault-vector=ADDR: run a handler at ADDR in kernel mode on a user stack fault
+ * - --timers=LIST, --seeds=LIST: with the lockstep engine, run one instance per timer and seed
+ *   combination (lockstep.h); the positional timer and --seed are used when a list is not given.
+ *   With --branch-at they are the timers and seeds of the branch variants
+ * - --sweep-output=PREFIX: where the lockstep engine or the branch variants write each instance's
+ *   output (sweep by default)
+ * - --threads=N: threads the lockstep engine splits the instances across (one per processor by default)
+ * - --branch-at=N: run the predecoded engine to cycle N, then fork it into one variant per
+ *   combination of --timers, --seeds and --patch (branch.h)
+ * - --patch=ADDR:VALUE,...: words a branch variant replaces; each --patch is a separate variant
+ * - --memory-server=PATH: only run the memory, as a server (memserver.h) for CPUs connecting to the
+ *   Unix socket PATH; takes the file name but no timer
+ * - --clients=N: exit once N CPUs have connected to the server and left (0, the default, serves forever)
+ * - --shared-memory: all CPUs of the server use one memory instead of a copy of the program each
+ * - --connect=PATH: only run the CPU, using the memory server at PATH; takes the timer but no file name
+ * - --pipeline=PREFIX: with the predecoded engine, feed every executed instruction to the 5-stage
+ *   pipeline model of pipeline.h and write its CPI and stall reports at exit
+ * - --memory-latency=N: cycles per data access in the pipeline's memory stage (1 by default)
+ * - --no-forwarding: the pipeline waits for writeback instead of forwarding results
+ * - --predictor=LIST, --prefetcher=LIST: with the predecoded engine, watch the run with the branch
+ *   predictor and prefetcher plug-ins of plugins.h and report them at exit; needs a build with
+ *   -DCSIM_PLUGINS
+ * - --analyze=PREFIX: only analyze the program (analysis.h) and write PREFIX.dot and PREFIX.json;
+ *   takes the file name but no timer
+ * - --emulate-syscalls: with the predecoded engine, answer system calls with the services of syscalls.h
+ *   learned from the handler at 1500 when the handler's code provably never changes
+ * - --input=FILE: the data read by instruction 31 (stream.h), memory-mapped instead of loaded into memory
+ * - --no-timer, --no-checks: run a predecoded variant without timer interrupts, or without the
+ *   user/system and stack checks of the access map; these change what a program does
+ * Parameters:
+ * - argc: the number of command-line arguments.
+ * - argv: an array of command-line arguments.
+*/
+int main(int argc, char *argv[]) {
+
+    // Used to store the command line argument 
+    int timerInput;
+
+    //used for fork
+    pid_t pid;
+
+    //Options
+    string engine;
+    unsigned int seed = time(NULL);
+    long long cycleLimit = 0;
+    const char* dumpFile = NULL;
+    bool debug = false;
+    const char* profilePrefix = NULL;
+    long long profileWindow = 1000;
+    int userStack = 0;
+    int systemStack = 0;
+    int stackGuard = 0;
+    int faultVector = -1;
+    vector<long long> timerList, seedList;
+    bool usageValid = true;
+    string sweepOutput = "sweep";
+    int sweepThreads = 0;
+    const char* serverPath = NULL;
+    long long clientLimit = 0;
+    bool sharedMemory = false;
+    const char* connectPath = NULL;
+    long long branchAt = 0;
+    const char* pipelinePrefix = NULL;
+    int memoryLatency = 1;
+    bool forwarding = true;
+    const char* predictorList = NULL;
+    const char* prefetcherList = NULL;
+    const char* analyzePrefix = NULL;
+    bool emulateSyscalls = false;
+    const char* inputName = NULL;
+    vector<vector<BranchPoint::Patch>> patchLists;
+    unsigned features = TIMER_FEATURE | CHECK_FEATURE;
+
+    int arg = 1;
+    for(; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++){
+        if(strcmp(argv[arg], "--debug") == 0){
+            debug = true;
+            continue;
+        }
+        if(strcmp(argv[arg], "--shared-memory") == 0){
+            sharedMemory = true;
+            continue;
+        }
+        if(strcmp(argv[arg], "--no-timer") == 0){
+            features &= ~TIMER_FEATURE;
+            continue;
+        }
+        if(strcmp(argv[arg], "--no-checks") == 0){
+            features &= ~CHECK_FEATURE;
+            continue;
+        }
+        if(strcmp(argv[arg], "--no-forwarding") == 0){
+            forwarding = false;
+            continue;
+        }
+        if(strcmp(argv[arg], "--emulate-syscalls") == 0){
+            emulateSyscalls = true;
+            continue;
+        }
+
+        const char* value = strchr(argv[arg], '=');
+        string name(argv[arg], value != NULL ? value - argv[arg] : strlen(argv[arg]));
+        if(value == NULL){
+            break;
+        }
+        value++;
 
+        if(name == "--engine"){
+            engine = value;
+        }
+        else if(name == "--seed"){
+            seed = strtoul(value, NULL, 10);
+        }
+        else if(name == "--max-cycles"){
+            cycleLimit = strtoll(value, NULL, 10);
+        }
+        else if(name == "--dump-state"){
+            dumpFile = value;
+        }
+        else if(name == "--mem-profile"){
+            profilePrefix = value;
+        }
+        else if(name == "--ws-window"){
+            profileWindow = strtoll(value, NULL, 10);
+        }
+        else if(name == "--user-stack"){
+            userStack = atoi(value);
+        }
+        else if(name == "--system-stack"){
+            systemStack = atoi(value);
+        }
+        else if(name == "--stack-guard"){
+            stackGuard = atoi(value);
+        }
+        else if(name == "--fault-vector"){
+            faultVector = atoi(value);
+        }
+        else if(name == "--timers"){
+            usageValid = check(parseList(value, timerList), "--timers needs numbers and ranges such as 5,10,20-25") && usageValid;
+        }
+        else if(name == "--seeds"){
+            usageValid = check(parseList(value, seedList), "--seeds needs numbers and ranges such as 1,2,10-20") && usageValid;
+        }
+        else if(name == "--sweep-output"){
+            sweepOutput = value;
+        }
+        else if(name == "--threads"){
+            sweepThreads = atoi(value);
+        }
+        else if(name == "--memory-server"){
+            serverPath = value;
+        }
+        else if(name == "--clients"){
+            clientLimit = strtoll(value, NULL, 10);
+        }
+        else if(name == "--connect"){
+            connectPath = value;
+        }
+        else if(name == "--pipeline"){
+            pipelinePrefix = value;
+        }
+        else if(name == "--memory-latency"){
+            memoryLatency = atoi(value);
+        }
+        else if(name == "--predictor"){
+            predictorList = value;
         }
+        else if(name == "--prefetcher"){
+            prefetcherList = value;
+        }
+        else if(name == "--analyze"){
+            analyzePrefix = value;
+        }
+        else if(name == "--input"){
+            inputName = value;
+        }
+        else if(name == "--branch-at"){
+            branchAt = strtoll(value, NULL, 10);
+            usageValid = check(branchAt > 0, "--branch-at needs a cycle greater than 0") && usageValid;
+        }
+        else if(name == "--patch"){
+            patchLists.emplace_back();
+            usageValid = check(parsePatch(value, patchLists.back()),
+                               "--patch needs address:value pairs inside memory, such as 700:5,701:-1") && usageValid;
+        }
+        else{
+            break;
+        }
+    }
 
+    //The debugger needs the CPU and memory in one process
+    if(engine.empty()){
+        bool predecoded = debug || branchAt > 0 || pipelinePrefix != NULL || predictorList != NULL || prefetcherList != NULL ||
+                          emulateSyscalls;
+        engine = predecoded ? "predecoded" : "pipe";
+    }
+
+    //Stack limits and guard regions, checked along with the user/system permissions
+    AccessMap access;
+    usageValid = check(userStack == 0 || access.limitStack(false, userStack, stackGuard),
+                       "--user-stack and its --stack-guard do not fit in the user stack region") && usageValid;
+    usageValid = check(systemStack == 0 || access.limitStack(true, systemStack, stackGuard),
+                       "--system-stack and its --stack-guard do not fit in the system stack region") && usageValid;
+    usageValid = check(faultVector < Memory::MEMORY_SIZE, "--fault-vector is outside memory") && usageValid;
+
+    //Check for proper usage 
+    bool lockstep = engine == "lockstep";
+    bool coroutine = engine == "coroutine";
+    bool library = engine == "machine";
+#ifndef COSIM_AVAILABLE
+    if(coroutine){
+        cerr << "ERROR: The coroutine engine needs a C++20 build (g++ -std=c++20)" << endl;
+        _exit(1);
+    }
+#endif
+#ifndef CSIM_PLUGINS
+    if(predictorList != NULL || prefetcherList != NULL){
+        cerr << "ERROR: The plug-ins need a build with -DCSIM_PLUGINS" << endl;
+        _exit(1);
+    }
+#endif
+    bool plugins = predictorList != NULL || prefetcherList != NULL;
+    bool split = serverPath != NULL || connectPath != NULL;
+    bool analyze = analyzePrefix != NULL;
+    bool predecoded = engine == "predecoded";
+
+    //Arguments
+    if(arg < argc && strncmp(argv[arg], "--", 2) == 0){
+        usageValid = check(false, string("unknown option ") + argv[arg]);
+    }
+    else if(serverPath != NULL || analyze){
+        usageValid = check(argc - arg == 1, "expected only a file name") && usageValid;
+    }
+    else if(connectPath != NULL){
+        usageValid = check(argc - arg == 1, "expected only a timer value") && usageValid;
     }
     else{
-        //Parent process (Memory)
+        usageValid = check(argc - arg == 2, "expected a file name and a timer value") && usageValid;
+    }
 
-        //Do not need to read from this end of this pipe
-        close(pfds_mem[0]);
-        close(pfds_cpu[1]);
+    //Engines
+    usageValid = check(engine == "pipe" || engine == "direct" || predecoded || engine == "aot" || lockstep || coroutine || library,
+                       "unknown engine '" + engine + "'") && usageValid;
+    usageValid = check(!debug || engine == "direct" || predecoded, "--debug needs the predecoded or direct engine") && usageValid;
+    usageValid = check((features & (TIMER_FEATURE | CHECK_FEATURE)) == (TIMER_FEATURE | CHECK_FEATURE) || predecoded,
+                       "--no-timer and --no-checks need the predecoded engine") && usageValid;
+
+    //Split processes and static analysis
+    usageValid = check(serverPath == NULL || connectPath == NULL, "--memory-server and --connect cannot be combined") && usageValid;
+    usageValid = check(!split || engine == "pipe", "--memory-server and --connect need the pipe engine") && usageValid;
+    usageValid = check(clientLimit >= 0, "--clients cannot be negative") && usageValid;
+    usageValid = check(!sharedMemory || serverPath != NULL, "--shared-memory needs --memory-server") && usageValid;
+    usageValid = check(!analyze || !split, "--analyze cannot be combined with --memory-server or --connect") && usageValid;
+    usageValid = check(!analyze || engine == "pipe", "--analyze runs no engine, it takes no --engine") && usageValid;
+    usageValid = check(!analyze || profilePrefix == NULL, "--analyze cannot be combined with --mem-profile") && usageValid;
+    usageValid = check(inputName == NULL || !analyze, "--input cannot be combined with --analyze") && usageValid;
+    usageValid = check(inputName == NULL || serverPath == NULL, "--input cannot be combined with --memory-server") && usageValid;
+
+    //Memory profile
+    usageValid = check(profileWindow >= 1, "--ws-window must be at least 1") && usageValid;
+    usageValid = check(profilePrefix == NULL || !(lockstep || library),
+                       "--mem-profile is not available with the lockstep and machine engines") && usageValid;
+
+    //Sweeps and what-if branching
+    usageValid = check(lockstep || branchAt > 0 || (timerList.empty() && seedList.empty()),
+                       "--timers and --seeds need --engine=lockstep or --branch-at") && usageValid;
+    usageValid = check(patchLists.empty() || branchAt > 0, "--patch needs --branch-at") && usageValid;
+    usageValid = check(sweepThreads >= 0, "--threads must not be negative") && usageValid;
+    usageValid = check(sweepThreads == 0 || lockstep, "--threads needs --engine=lockstep") && usageValid;
+    if(branchAt > 0){
+        usageValid = check(predecoded, "--branch-at needs the predecoded engine") && usageValid;
+        usageValid = check(!debug, "--branch-at cannot be combined with --debug") && usageValid;
+        usageValid = check(profilePrefix == NULL, "--branch-at cannot be combined with --mem-profile") && usageValid;
+        usageValid = check(cycleLimit == 0 || cycleLimit > branchAt, "--max-cycles must be greater than --branch-at") && usageValid;
+    }
 
-        //Used to store when user is writing data to some address
-        int address;
-        int data;
-        
-        //Used to read and write to CPU
-        int instruction;
-        int buf;
+    //Pipeline model and plug-ins
+    usageValid = check(pipelinePrefix == NULL || predecoded, "--pipeline needs the predecoded engine") && usageValid;
+    usageValid = check(pipelinePrefix == NULL || branchAt == 0, "--pipeline cannot be combined with --branch-at") && usageValid;
+    usageValid = check(memoryLatency >= 1, "--memory-latency must be at least 1") && usageValid;
+    usageValid = check(pipelinePrefix != NULL || (memoryLatency == 1 && forwarding),
+                       "--memory-latency and --no-forwarding need --pipeline") && usageValid;
+    usageValid = check(!plugins || predecoded, "--predictor and --prefetcher need the predecoded engine") && usageValid;
+    usageValid = check(!plugins || branchAt == 0, "--predictor and --prefetcher cannot be combined with --branch-at") && usageValid;
+    usageValid = check(predictorList == NULL || Plugins().add(predictorList, true),
+                       string("unknown branch predictor in --predictor=") + (predictorList != NULL ? predictorList : "")) && usageValid;
+    usageValid = check(prefetcherList == NULL || Plugins().add(prefetcherList, false),
+                       string("unknown prefetcher in --prefetcher=") + (prefetcherList != NULL ? prefetcherList : "")) && usageValid;
+
+    //System call emulation
+    if(emulateSyscalls){
+        usageValid = check(predecoded, "--emulate-syscalls needs the predecoded engine") && usageValid;
+        usageValid = check(!debug, "--emulate-syscalls cannot be combined with --debug") && usageValid;
+        usageValid = check(profilePrefix == NULL, "--emulate-syscalls cannot be combined with --mem-profile") && usageValid;
+        usageValid = check(pipelinePrefix == NULL, "--emulate-syscalls cannot be combined with --pipeline") && usageValid;
+        usageValid = check(!plugins, "--emulate-syscalls cannot be combined with --predictor or --prefetcher") && usageValid;
+    }
 
+    if(!usageValid){
+        cerr << "Usage: " << argv[0] << " [--engine=pipe|direct|predecoded|aot|lockstep|coroutine|machine] [--seed=N] [--max-cycles=N]"
+             << " [--dump-state=FILE] [--debug] [--mem-profile=PREFIX] [--ws-window=N]"
+             << " [--user-stack=N] [--system-stack=N] [--stack-guard=N] [--fault-vector=ADDR]"
+             << " [--timers=LIST] [--seeds=LIST] [--sweep-output=PREFIX] [--threads=N] [--no-timer] [--no-checks]"
+             << " [--branch-at=N] [--patch=ADDR:VALUE,...] [--pipeline=PREFIX] [--memory-latency=N] [--no-forwarding]"
+             << " [--predictor=LIST] [--prefetcher=LIST] [--emulate-syscalls] [--input=FILE]"
+             << " <file name> <timer>" << endl;
+        cerr << "       " << argv[0] << " --memory-server=PATH [--clients=N] [--shared-memory]"
+             << " [--mem-profile=PREFIX] [--ws-window=N] <file name>" << endl;
+        cerr << "       " << argv[0] << " --connect=PATH [options] <timer>" << endl;
+        cerr << "       " << argv[0] << " --analyze=PREFIX [--user-stack=N] [--system-stack=N] [--stack-guard=N]"
+             << " [--fault-vector=ADDR] <file name>" << endl;
+        _exit(1);
+    }
+    const char* fileName = argv[arg];
 
-        //Initiate memory with the input program
-        Memory memory(argv[1]);
+    //The input stream is mapped once; forked processes and branch variants share the mapping
+    if(inputName != NULL && !activeInput.open(inputName)){
+        _exit(1);
+    }
 
-        //Enter loop until cpu exits
-        while(true){
+    //The memory alone, serving CPUs that connect to its socket
+    if(serverPath != NULL){
+        Memory memory(fileName);
+        MemoryServer server(memory, sharedMemory);
+        server.statistics = true;
+        if(profilePrefix != NULL){
+            activeProfile = new MemoryProfile(Memory::MEMORY_SIZE, profileWindow, profilePrefix);
+            server.profile = activeProfile;
+            atexit(writeProfile);
+        }
+        signal(SIGPIPE, SIG_IGN);
+        if(!server.listen(serverPath)){
+            exit(1);
+        }
+        server.run(clientLimit);
+        exit(0);
+    }
+
+    //Static analysis only, nothing runs
+    if(analyze){
+        Memory memory(fileName);
+        ProgramAnalysis analysis(memory.words(), access, faultVector);
+        string prefix = analyzePrefix;
+        if(!analysis.writeDot(prefix + ".dot") || !analysis.writeJson(prefix + ".json")){
+            cerr << "ERROR: unable to write the analysis to " << prefix << ".dot and " << prefix << ".json" << endl;
+            exit(1);
+        }
+        exit(0);
+    }
+
+    //Ensure argumetn is an integer
+    try {
+        stringstream container(argv[argc - 1]);
+        int x;
+        container >> timerInput;
+        // cout << "Value of x: " << timerInput;
+        } 
+        catch (const invalid_argument& e) {
+
+            // Failed to convert
+            cerr << "ERROR: Second argument must be an integer" << endl;
+            cerr << "Exiting..." << endl;
+            _exit(1);
+        }
+
+
+    //pipe to write from cpu to memory
+    int pfds_cpu[2];    //CPU -> Mem
+
+    //pipe to write from memory to cpu
+    int pfds_mem[2];    //Mem -> CPU
+
+    //Seed to ensure we arent producing the same random number with instruction
+    //Must be called here because if called within the instruction it produces the same integer
+    srand(seed);
+
+    //Parameter sweeps run every instance in this process, then report
+    if(lockstep){
+        if(timerList.empty()){
+            timerList.push_back(timerInput);
+        }
+        if(seedList.empty()){
+            seedList.push_back(seed);
+        }
+        vector<int> timers;
+        vector<unsigned int> seeds;
+        for(size_t t = 0; t < timerList.size(); t++){
+            for(size_t s = 0; s < seedList.size(); s++){
+                timers.push_back(timerList[t]);
+                seeds.push_back(seedList[s]);
+            }
+        }
 
-            //Recieve request from cpu
-            read(pfds_cpu[0], &buf, sizeof(buf));
-            // //cout << "MEMORY Read: " << buf << endl;
+        Memory memory(fileName);
+        LockstepSweep machines(memory, timers, seeds, sweepThreads > 0 ? sweepThreads : sysconf(_SC_NPROCESSORS_ONLN));
+        machines.cycleLimit = cycleLimit;
+        machines.access = access;
+        machines.faultVector = faultVector;
+        machines.input = &activeInput;
+        machines.run();
+        machines.report(sweepOutput);
+        if(dumpFile != NULL){
+            machines.dump(dumpFile);
+        }
+        exit(0);
+    }
 
-            //CPU attempting to write to memory
-            if(buf == -1){
+    //The library API, run as a host embedding the simulator would
+    if(library){
+        Machine machine(timerInput, seed);
+        machine.access = access;
+        machine.faultVector = faultVector;
+        machine.input = &activeInput;
+        string error;
+        if(!machine.load(fileName, error)){
+            cerr << error << endl;
+            exit(1);
+        }
 
-                //Read the address cpu wants to write to
-                read(pfds_cpu[0], &address, sizeof(address));
-                // //cout << "MEMORY Read adress: " << address << endl;
+        Machine::Result result = machine.run(cycleLimit);
+        cout << machine.output << flush;
+        cerr << machine.errors;
 
-                //Read the data cpu wants to write
-                read(pfds_cpu[0], &data, sizeof(data));
-                // //cout << "MEMORY Read Data: " << data << endl;
+        int status = 0;
+        if(result.status == Machine::FAULTED){
+            cerr << "ERROR: " << result.fault.message() << endl;
+            if(result.fault.kind != Machine::INVALID_INSTRUCTION){
+                cerr << "Exiting..." << endl;
+            }
+            exit(1);
+        }
+        if(result.status == Machine::STOPPED){
+            cerr << "ERROR: Cycle limit reached" << endl;
+            status = CYCLE_LIMIT_EXIT;
+        }
+        if(dumpFile != NULL){
+            dumpRegisters(dumpFile, machine.PC, machine.SP, machine.IR, machine.AC, machine.X, machine.Y,
+                          machine.timer, machine.kernelMode);
+            Memory::dumpWords(dumpFile, machine.words());
+        }
+        exit(status);
+    }
 
-                //write the data to the address
-                memory.write(address, data);
+#ifdef COSIM_AVAILABLE
+    //The CPU and the memory as coroutines exchanging the pipe messages in this process
+    if(coroutine){
+        Memory memory(fileName);
+        if(profilePrefix != NULL){
+            activeProfile = new MemoryProfile(Memory::MEMORY_SIZE, profileWindow, profilePrefix);
+            memory.profile = activeProfile;
+            atexit(writeProfile);
+        }
+        CoSimulation simulation(memory, timerInput);
+        simulation.cpu.cycleLimit = cycleLimit;
+        simulation.cpu.dumpFile = dumpFile;
+        simulation.cpu.profileStack = profilePrefix != NULL;
+        simulation.cpu.access = access;
+        simulation.cpu.faultVector = faultVector;
+        simulation.cpu.input = InputStream(&activeInput);
+        exit(simulation.run());
+    }
+#endif
+
+    //What-if variants of the run, forked at the branch point
+    BranchPoint* branchPoint = NULL;
+    if(branchAt > 0){
+        branchPoint = new BranchPoint(branchAt);
+        branchPoint->outputPrefix = sweepOutput;
+        branchPoint->patches = patchLists;
+        size_t timers = max<size_t>(timerList.size(), 1);
+        size_t seeds = max<size_t>(seedList.size(), 1);
+        size_t patches = max<size_t>(patchLists.size(), 1);
+        for(size_t t = 0; t < timers; t++){
+            for(size_t s = 0; s < seeds; s++){
+                for(size_t p = 0; p < patches; p++){
+                    BranchPoint::Variant variant;
+                    variant.timer = timerList.empty() ? -1 : timerList[t];
+                    variant.seed = seedList.empty() ? -1 : seedList[s];
+                    variant.patch = patchLists.empty() ? -1 : p;
+                    branchPoint->variants.push_back(variant);
+                }
+            }
+        }
+    }
 
+    //Engines without a memory process run entirely in this process.
+    //Reverse execution in the debugger restarts them from the program file with the same seed.
+    Debugger debugger;
+    if(engine != "pipe" && profilePrefix != NULL){
+        atexit(writeProfile);
+    }
+    if(pipelinePrefix != NULL){
+        atexit(writePipeline);
+    }
+    if(plugins){
+        atexit(writePlugins);
+    }
+    while(engine != "pipe"){
+        try{
+            Memory memory(fileName);
+
+            //A replay starts a fresh profile, so the report covers exactly one run
+            if(profilePrefix != NULL){
+                delete activeProfile;
+                activeProfile = new MemoryProfile(Memory::MEMORY_SIZE, profileWindow, profilePrefix);
             }
-            else if(buf == -5){
-                //CPU Exiting 
-                waitpid(-1, NULL, 0);
-                // //cout << "MEMORY Exiting..." << endl;
-                close(pfds_mem[1]);
-                close(pfds_cpu[0]);
-                exit(0);
+            if(pipelinePrefix != NULL){
+                delete activePipeline;
+                activePipeline = new PipelineModel(Memory::MEMORY_SIZE, pipelinePrefix);
+                activePipeline->latency = memoryLatency;
+                activePipeline->forwarding = forwarding;
             }
-            else{
-                //Read from memory
-                instruction = memory.read(buf);
-                // //cout << "Instruction in memory: " << instruction << endl;
+            if(plugins){
+                delete activePlugins;
+                activePlugins = new Plugins();
+                if(predictorList != NULL){
+                    activePlugins->add(predictorList, true);
+                }
+                if(prefetcherList != NULL){
+                    activePlugins->add(prefetcherList, false);
+                }
+            }
+
+            if(engine == "direct" || engine == "aot"){
+                CPU cpu(&memory, timerInput);
+                memory.profile = activeProfile;
+                cpu.cycleLimit = cycleLimit;
+                cpu.dumpFile = dumpFile;
+                cpu.access = access;
+                cpu.faultVector = faultVector;
+                cpu.input = InputStream(&activeInput);
+                if(debug){
+                    cpu.attachDebugger(&debugger);
+                }
+
+                //The aot engine is the direct engine running translated user code where it can.
+                //Profiled runs are interpreted, translated code does not count accesses.
+                AotProgram aot;
+                if(engine == "aot" && activeProfile == NULL && aot.load(memory, access, faultVector)){
+                    cpu.aot = &aot;
+                }
 
-                //Return program instruction to cpu
-                write(pfds_mem[1], &instruction, sizeof(instruction));
-                // //cout << "MEMORY WRITE: " << instruction << endl;
+                //Instruction cycle loop until program ends
+                while(true){
+                    if(cpu.aot != NULL){
+                        cpu.runTranslated();
+                    }
+                    cpu.fetchInstruction();
+                    cpu.executeInstruction();
+                    cpu.PC++;
+                }
+            }
+            else{
+                //Services repeat the handler's effects, which holds only while its code stays the same
+                if(emulateSyscalls && activeSyscalls == NULL){
+                    ProgramAnalysis analysis(memory.words(), access, faultVector);
+                    if(!analysis.codeWritten(ProgramAnalysis::KERNEL)){
+                        activeSyscalls = new SyscallTable();
+                    }
+                    else{
+                        cerr << "WARNING: The system call handler may be modified, system calls are simulated" << endl;
+                        emulateSyscalls = false;
+                    }
+                }
+                bool hooks = debug || activeProfile != NULL || activePipeline != NULL;
+                unsigned variant = features | (hooks ? HOOK_FEATURE : 0);
+                runPredecoded<ALL_FEATURES>(variant, memory, timerInput, cycleLimit, dumpFile, access, faultVector,
+                                            debug ? &debugger : NULL, branchPoint);
             }
-        }   
+        }
+        catch(const Debugger::Restart&){
+            srand(seed);
+            debugger.restarted();
+        }
+    }
+
+    if(connectPath != NULL){
+        //The CPU alone, its memory is a server reached through one socket
+        int server = MemoryServer::connect(connectPath);
+        if(server == -1){
+            exit(1);
+        }
+        pfds_cpu[1] = pfds_mem[0] = server;
+        pfds_cpu[0] = pfds_mem[1] = -1;
+        pid = 0;
+    }
+    else{
+        //Check if pipes failed
+        if(pipe(pfds_cpu) == -1){
+            cerr << "ERROR: The cpu pipe failed" << endl;
+            exit(1);
+        }
+        if(pipe(pfds_mem) == -1){
+            cerr << "ERROR: The memory pipe failed" << endl;
+
+            //close the open pipes
+            close(pfds_cpu[0]);
+            close(pfds_cpu[1]);
+            exit(1);
+        }
+
+        //spawn the child process (CPU)
+        pid = fork();
+    }
+
+    //Check if Fork failed
+    if(pid == -1){
+       cerr << "ERROR: The fork failed" << endl;
+       exit(1);
+    }
+    else if(pid == 0){
+        //Child process (CPU)
+        CPU cpu(pfds_cpu[1], pfds_mem[0], timerInput);
+        cpu.cycleLimit = cycleLimit;
+        cpu.dumpFile = dumpFile;
+        cpu.profileStack = profilePrefix != NULL;
+        cpu.access = access;
+        cpu.faultVector = faultVector;
+        cpu.input = InputStream(&activeInput);
+
+        //If the memory process exits on an invalid address, the CPU notices at its next read and
+        //flushes its output; writes in between must not kill it with SIGPIPE first
+        signal(SIGPIPE, SIG_IGN);
+
+        //Close unused pipe ends
+        if(connectPath == NULL){
+            close(pfds_cpu[0]);
+            close(pfds_mem[1]);
+        }
+
+        //Instruction cycle loop until program ends
+        while(true){
+            
+            //Fetch next program instruction
+            cpu.fetchInstruction();
+
+            //Execute program instruction
+            cpu.executeInstruction();
+            //cout << "Timer: " << cpu.timer << endl;
+
+            //Increment Program Counter
+            cpu.PC++;
+
+        }
+
+    }
+    else{
+        //Parent process (Memory)
+
+        //Do not need to read from this end of this pipe
+        close(pfds_mem[0]);
+        close(pfds_cpu[1]);
+
+        //Used to pass on the exit status of the cpu
+        int status;
+
+        //Initiate memory with the input program
+        Memory memory(fileName);
+
+        //Serve the CPU as the only client of a memory server, an invalid address ends the
+        //memory process as before
+        MemoryServer server(memory, false);
+        server.exitOnError = true;
+
+        //The memory process owns the profile; the CPU process only marks its pushes
+        if(profilePrefix != NULL){
+            activeProfile = new MemoryProfile(Memory::MEMORY_SIZE, profileWindow, profilePrefix);
+            server.profile = activeProfile;
+            atexit(writeProfile);
+        }
+        server.addClient(pfds_cpu[0], pfds_mem[1]);
+
+        //Serve until the CPU exits, with or without signaling, and exit with its status
+        server.run(0);
+        waitpid(pid, &status, 0);
+        exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
     }
-}
\ No newline at end of file
+}
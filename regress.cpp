@@ -0,0 +1,1012 @@
+/*
+    Program: Computer Simulator
+    File:    regress.cpp
+    Author:  Stanton Brown
+
+    Desription:
+    Differential regression tester for the simulator's execution engines.
+    Every program is run under each engine (pipe, direct, predecoded, the library API of machine.h,
+    aot with -a, coroutine with -k and the predecoded engine emulating system calls with -e) with the same
+    timer, Get seed and input stream for Read.
+    The runs must agree on standard output byte for byte, on the exit status, and on the
+    register and memory state written by --dump-state when the program ends.
+    The program is also run in this process through a MachinePool shared by two threads, whose
+    machines are run, some only part way and after a host write, released and reused. Every
+    complete run of a reused machine must match a freshly loaded Machine.
+
+    Programs come from a corpus directory (every .txt and .img file in it) and from a random
+    program generator built from the instruction set table (isa.h).
+    A program on which the engines disagree is shrunk by deleting instructions (remapping the
+    jump and data addresses behind them) while the disagreement persists, and the minimal
+    program is written to the failure directory.
+
+    Programs are spread over one worker thread per core, each spawning the simulator processes
+    for its program. Runs are bounded by --max-cycles so generated infinite loops still finish.
+
+    Usage:
+    ./regress [-a] [-k] [-e] [-j jobs] [-g count] [-s seed] [-t timer] [-c cycles] [-x simulator] [-o failure_dir] [corpus_dir]
+
+    - -a:            also compare the aot engine, which compiles every program it runs.
+    - -k:            also compare the coroutine engine, which needs a C++20 build of the simulator.
+    - -e:            also compare the predecoded engine with --emulate-syscalls (syscalls in reports).
+
+    - -j:            number of worker threads, all cores by default.
+    - -g:            number of random programs to generate, 0 by default.
+    - -s:            seed for the generator, for Get and for the input stream.
+    - -t:            timer value for corpus programs, 30 by default (random programs pick their own).
+    - -c:            cycle limit for every run, 20000 by default.
+    - -x:            simulator binary, ./project1 by default.
+    - -o:            directory receiving shrunk failing programs, regress-failures by default.
+    - corpus_dir:    directory of programs to run.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "image.h"
+#include "isa.h"
+#include "machine.h"
+
+using namespace std;
+
+extern char** environ;
+
+
+//Size of the simulated memory
+static const int MEMORY_SIZE = 2000;
+
+//Engines compared against each other, the first is the reference
+static const char* ENGINES[] = {"pipe", "direct", "predecoded", "aot", "coroutine", "syscalls", "machine"};
+static const int ENGINE_COUNT = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
+//Engines compared; aot is only included with -a, coroutine with -k and syscalls with -e
+static bool engineEnabled[ENGINE_COUNT] = {true, true, true, false, false, false, true};
+
+//Wall clock limit for one simulator run, in milliseconds
+static const int RUN_TIMEOUT = 10000;
+
+//Upper bound on shrinking attempts for one failing program
+static const int MAX_SHRINK_RUNS = 400;
+
+//Threads sharing a MachinePool in the reuse check, and the machines each one acquires
+static const int REUSE_THREADS = 2;
+static const int REUSE_ROUNDS = 4;
+
+
+/*
+ * Program: A memory image under test
+ * ----------------------------------
+ * The words of memory, which of them the program defines, and the timer value to run it with.
+ */
+struct Program {
+    string name;
+    string path;            //original file, empty for generated programs
+    vector<int> words;
+    vector<unsigned char> used;
+    int timer;
+
+    Program() : words(MEMORY_SIZE, 0), used(MEMORY_SIZE, 0), timer(30) {}
+
+    /*
+     * Function: set
+     * -------------
+     * Defines the word at an address.
+     */
+    void set(int address, int value){
+        words[address] = value;
+        used[address] = 1;
+    }
+
+    /*
+     * Function: size
+     * --------------
+     * Number of defined words, used to report how much a program was shrunk.
+     */
+    int size() const {
+        int count = 0;
+        for(unsigned char u : used){
+            count += u;
+        }
+        return count;
+    }
+};
+
+/*
+ * Function: loadProgram
+ * ---------------------
+ * Reads a text program or binary image the same way Memory does.
+ * Parameters:
+ * - path: the program file
+ * - program: receives the memory image
+ * Returns:
+ * false if the file could not be read.
+ */
+static bool loadProgram(const string& path, Program& program){
+    ifstream in(path, ios::binary);
+    if(!in.is_open()){
+        return false;
+    }
+
+    ImageHeader header;
+    if(in.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+       memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0){
+        if(header.words > (uint32_t)MEMORY_SIZE){
+            return false;
+        }
+        in.read(reinterpret_cast<char*>(program.words.data()), header.words * sizeof(int));
+        for(uint32_t i = 0; i < header.words; i++){
+            program.used[i] = program.words[i] != 0;
+        }
+        return true;
+    }
+
+    in.clear();
+    in.seekg(0);
+    string line;
+    int index = 0;
+    while(getline(in, line)){
+        istringstream iss(line);
+        if(iss.peek() == '.'){
+            iss.ignore();
+            iss >> index;
+            continue;
+        }
+        int value;
+        while(iss >> value){
+            if(index < 0 || index >= MEMORY_SIZE){
+                return false;
+            }
+            program.set(index++, value);
+            if(iss.peek() == ' '){
+                iss.ignore();
+            }
+            else{
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Function: writeProgram
+ * ----------------------
+ * Writes a program in the text format, annotating instructions with their mnemonic.
+ * Parameters:
+ * - program: the program
+ * - path: the file to write
+ * - annotate: add mnemonic comments (used for reported failures)
+ */
+static void writeProgram(const Program& program, const string& path, bool annotate){
+    ofstream out(path, ios::trunc);
+    if(annotate){
+        out << "// " << program.name << ", run with timer " << program.timer << '\n';
+    }
+
+    int next = 0;
+    bool operandNext = false;
+    for(int i = 0; i < MEMORY_SIZE; i++){
+        if(!program.used[i]){
+            continue;
+        }
+        if(i != next){
+            out << '.' << i << '\n';
+            operandNext = false;
+        }
+        out << program.words[i];
+
+        //Mark instruction words; operands follow their instruction
+        if(annotate){
+            if(operandNext){
+                operandNext = false;
+            }
+            else if(const Opcode* op = findOpcode(program.words[i])){
+                out << "   // " << op->name;
+                operandNext = op->operands > 0;
+            }
+        }
+        out << '\n';
+        next = i + 1;
+    }
+}
+
+/*
+ * Function: writeInput
+ * --------------------
+ * Writes the input stream for Read: numbers, words and separators, short enough that
+ * programs reading in a loop reach its end.
+ * Parameters:
+ * - path: the file to write
+ * - seed: seed of its contents
+ * Returns:
+ * false if the file could not be written.
+ */
+static bool writeInput(const string& path, unsigned int seed){
+    static const char* WORDS[] = {"x", "id", "n/a", "-", "--7", "1e3"};
+    static const char* SEPARATORS[] = {",", ", ", " ", "\n", "\r\n", ";"};
+    mt19937 random(seed);
+    ofstream out(path, ios::trunc);
+    for(int i = 0; i < 300; i++){
+        if(random() % 5 == 0){
+            out << WORDS[random() % 6];
+        }
+        else{
+            out << (int)(random() % 200000) - 1000;
+        }
+        out << SEPARATORS[random() % 6];
+    }
+    return bool(out);
+}
+
+
+/*
+ * RunResult: What one engine produced for a program
+ */
+struct RunResult {
+    string output;      //standard output
+    string errors;      //standard error, reported but not compared
+    string state;       //--dump-state contents, empty if the program did not end
+    int status;         //exit status, 128+signal when killed, -1 on timeout
+};
+
+/*
+ * Function: runEngine
+ * -------------------
+ * Runs the simulator on a program file with one engine and collects its results.
+ * Output is read through pipes until every process of the run has closed them, so
+ * the CPU process of the pipe engine is included even if the memory process exits first.
+ * Parameters:
+ * - simulator: path to the simulator binary
+ * - engine: engine name, syscalls for the predecoded engine emulating system calls
+ * - programFile: the program to run
+ * - inputFile: the stream read by instruction 31
+ * - stateFile: scratch file for the final state
+ * - timer: timer value
+ * - seed: Get seed
+ * - cycles: cycle limit
+ * Returns:
+ * The run's output, state and exit status.
+ */
+static RunResult runEngine(const string& simulator, const char* engine, const string& programFile,
+                           const string& inputFile, const string& stateFile, int timer, unsigned int seed,
+                           long long cycles){
+    RunResult result;
+    result.status = -1;
+    unlink(stateFile.c_str());
+
+    bool syscalls = strcmp(engine, "syscalls") == 0;
+    string engineArg = string("--engine=") + (syscalls ? "predecoded" : engine);
+    string seedArg = "--seed=" + to_string(seed);
+    string cyclesArg = "--max-cycles=" + to_string(cycles);
+    string stateArg = "--dump-state=" + stateFile;
+    string inputArg = "--input=" + inputFile;
+    string timerArg = to_string(timer);
+    vector<char*> argv = {(char*)simulator.c_str(), (char*)engineArg.c_str(), (char*)seedArg.c_str(),
+                          (char*)cyclesArg.c_str(), (char*)stateArg.c_str(), (char*)inputArg.c_str()};
+    if(syscalls){
+        argv.push_back((char*)"--emulate-syscalls");
+    }
+    argv.push_back((char*)programFile.c_str());
+    argv.push_back((char*)timerArg.c_str());
+    argv.push_back(NULL);
+
+    //Close-on-exec pipes so runs spawned by other workers never hold our write ends
+    int out[2], err[2];
+    if(pipe2(out, O_CLOEXEC) == -1 || pipe2(err, O_CLOEXEC) == -1){
+        result.errors = "pipe failed";
+        return result;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+
+    //Own process group, so a timed out run can be killed with all its processes
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    pid_t pid;
+    int spawned = posix_spawn(&pid, simulator.c_str(), &actions, &attributes, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    close(out[1]);
+    close(err[1]);
+    if(spawned != 0){
+        close(out[0]);
+        close(err[0]);
+        result.errors = "unable to run " + simulator;
+        return result;
+    }
+
+    //Collect output until both pipes reach end of file
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(RUN_TIMEOUT);
+    struct pollfd fds[2] = {{out[0], POLLIN, 0}, {err[0], POLLIN, 0}};
+    string* targets[2] = {&result.output, &result.errors};
+    int open = 2;
+    bool timedOut = false;
+    char buffer[4096];
+    while(open > 0){
+        int remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if(remaining <= 0){
+            timedOut = true;
+            break;
+        }
+        if(poll(fds, 2, remaining) <= 0){
+            continue;
+        }
+        for(int i = 0; i < 2; i++){
+            if(fds[i].fd < 0 || fds[i].revents == 0){
+                continue;
+            }
+            ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+            if(n > 0){
+                targets[i]->append(buffer, n);
+            }
+            else{
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open--;
+            }
+        }
+    }
+
+    if(timedOut){
+        kill(-pid, SIGKILL);
+        for(int i = 0; i < 2; i++){
+            if(fds[i].fd >= 0){
+                close(fds[i].fd);
+            }
+        }
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    if(!timedOut){
+        result.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+
+    ifstream state(stateFile);
+    if(state.is_open()){
+        stringstream contents;
+        contents << state.rdbuf();
+        result.state = contents.str();
+    }
+    return result;
+}
+
+
+/*
+ * Tester: Runs programs under every engine and compares the results
+ * -----------------------------------------------------------------
+ * Shared by the worker threads; each worker owns a scratch file prefix.
+ */
+class Tester {
+
+public:
+    string simulator;
+    string scratch;         //temporary directory for program and state files
+    string inputFile;       //input stream of every run
+    string failureDir;
+    long long cycles;
+    unsigned int seed;
+
+    //The input stream mapped for the machines of the reuse check
+    InputFile input;
+
+    //Totals, updated by the workers
+    atomic<int> passed;
+    atomic<int> failed;
+
+    Tester() : cycles(20000), seed(1), passed(0), failed(0) {}
+
+    /*
+     * Function: compare
+     * -----------------
+     * Runs a program file under every engine.
+     * Parameters:
+     * - programFile: the program to run
+     * - timer: timer value
+     * - worker: scratch file prefix of the calling worker
+     * - report: receives a description of the first disagreement
+     * Returns:
+     * true if all engines agree.
+     */
+    bool compare(const string& programFile, int timer, const string& worker, string& report){
+        RunResult results[ENGINE_COUNT];
+        for(int i = 0; i < ENGINE_COUNT; i++){
+            if(!engineEnabled[i]){
+                continue;
+            }
+            results[i] = runEngine(simulator, ENGINES[i], programFile, inputFile,
+                                   worker + "." + ENGINES[i] + ".state", timer, seed, cycles);
+        }
+
+        const RunResult& reference = results[0];
+        for(int i = 1; i < ENGINE_COUNT; i++){
+            if(!engineEnabled[i]){
+                continue;
+            }
+            const RunResult& other = results[i];
+            string what;
+            if(other.status != reference.status){
+                what = "exit status " + to_string(reference.status) + " vs " + to_string(other.status);
+            }
+            else if(other.output != reference.output){
+                size_t at = 0;
+                while(at < reference.output.size() && at < other.output.size() &&
+                      reference.output[at] == other.output[at]){
+                    at++;
+                }
+                what = "stdout differs at byte " + to_string(at) + " (" + to_string(reference.output.size()) +
+                       " vs " + to_string(other.output.size()) + " bytes)";
+            }
+            else if(other.state != reference.state){
+                what = "final state differs: " + firstDifference(reference.state, other.state);
+            }
+            else{
+                continue;
+            }
+            report = string(ENGINES[0]) + " vs " + ENGINES[i] + ": " + what;
+            if(!other.errors.empty() || !reference.errors.empty()){
+                report += "\n    stderr " + string(ENGINES[0]) + ": " + firstLine(reference.errors) +
+                          "\n    stderr " + ENGINES[i] + ": " + firstLine(other.errors);
+            }
+            return false;
+        }
+        return reuse(programFile, timer, report);
+    }
+
+    /*
+     * Function: reuse
+     * ---------------
+     * Runs a program through a MachinePool shared by REUSE_THREADS threads. Every other machine
+     * a thread acquires gets a host write and is run only part way before it is released, so the
+     * next acquire() gets a machine reset from a dirty state. Every complete run must match a
+     * freshly loaded Machine in its status, output, registers and memory.
+     * Parameters:
+     * - programFile: the program to run
+     * - timer: timer value
+     * - report: receives a description of the first difference
+     * Returns:
+     * true if every reused machine matched the fresh one.
+     */
+    bool reuse(const string& programFile, int timer, string& report){
+        Machine fresh(timer, seed);
+        fresh.input = &input;
+        string error;
+        if(!fresh.load(programFile.c_str(), error)){
+            report = "machine reuse: " + error;
+            return false;
+        }
+        Machine::Result expected = fresh.run(cycles);
+
+        Machine prototype(timer, seed);
+        prototype.input = &input;
+        prototype.load(programFile.c_str(), error);
+        MachinePool pool(prototype);
+
+        vector<string> differences(REUSE_THREADS);
+        vector<thread> threads;
+        for(int t = 0; t < REUSE_THREADS; t++){
+            threads.emplace_back([&, t]() {
+                for(int round = 0; round < REUSE_ROUNDS && differences[t].empty(); round++){
+                    Machine* machine = pool.acquire();
+                    if(round % 2 == 0){
+                        machine->write(MEMORY_SIZE - 1 - t, round + 1);
+                        machine->run(cycles / 2 + 1);
+                    }
+                    else{
+                        Machine::Result result = machine->run(cycles);
+                        differences[t] = machineDifference(fresh, expected, *machine, result);
+                    }
+                    pool.release(machine);
+                }
+            });
+        }
+        for(thread& worker : threads){
+            worker.join();
+        }
+
+        for(const string& difference : differences){
+            if(!difference.empty()){
+                report = "machine reuse: reused machine differs from a fresh load: " + difference;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Function: test
+     * --------------
+     * Tests one program and shrinks it if the engines disagree.
+     * Parameters:
+     * - program: the program under test
+     * - worker: scratch file prefix of the calling worker
+     * Returns:
+     * The line to report for the program.
+     */
+    string test(Program& program, const string& worker){
+        string programFile = program.path;
+        if(programFile.empty()){
+            programFile = worker + ".txt";
+            writeProgram(program, programFile, false);
+        }
+
+        string report;
+        if(compare(programFile, program.timer, worker, report)){
+            passed++;
+            return program.name + ": ok";
+        }
+        failed++;
+
+        //Keep deleting instructions while the engines still disagree
+        int before = program.size();
+        Program minimal = shrink(program, worker);
+        string failureFile = failureDir + "/" + sanitize(program.name) + ".txt";
+        mkdir(failureDir.c_str(), 0755);
+        writeProgram(minimal, failureFile, true);
+
+        //Report the disagreement of the minimal program
+        writeProgram(minimal, worker + ".txt", false);
+        compare(worker + ".txt", minimal.timer, worker, report);
+
+        return program.name + " (timer " + to_string(program.timer) + "): MISMATCH " + report +
+               "\n    shrunk from " + to_string(before) + " to " + to_string(minimal.size()) +
+               " words: " + failureFile;
+    }
+
+private:
+
+    /*
+     * Function: machineDifference
+     * ---------------------------
+     * Compares two runs of one program through the library API.
+     * Returns:
+     * The first difference, empty if the runs match.
+     */
+    static string machineDifference(const Machine& a, const Machine::Result& resultA,
+                                    const Machine& b, const Machine::Result& resultB){
+        if(resultA.status != resultB.status || resultA.cycles != resultB.cycles){
+            return "status " + to_string(resultA.status) + " after " + to_string(resultA.cycles) + " cycles vs " +
+                   to_string(resultB.status) + " after " + to_string(resultB.cycles);
+        }
+        if(resultA.fault.message() != resultB.fault.message()){
+            return "fault '" + resultA.fault.message() + "' vs '" + resultB.fault.message() + "'";
+        }
+        if(a.output != b.output || a.errors != b.errors){
+            return "output differs";
+        }
+        int registersA[] = {a.PC, a.SP, a.IR, a.AC, a.X, a.Y, a.timer, a.kernelMode};
+        int registersB[] = {b.PC, b.SP, b.IR, b.AC, b.X, b.Y, b.timer, b.kernelMode};
+        const char* names[] = {"PC", "SP", "IR", "AC", "X", "Y", "timer", "mode"};
+        for(int r = 0; r < 8; r++){
+            if(registersA[r] != registersB[r]){
+                return string(names[r]) + " " + to_string(registersA[r]) + " vs " + to_string(registersB[r]);
+            }
+        }
+        for(int address = 0; address < MEMORY_SIZE; address++){
+            if(a.words()[address] != b.words()[address]){
+                return "memory[" + to_string(address) + "] " + to_string(a.words()[address]) + " vs " +
+                       to_string(b.words()[address]);
+            }
+        }
+        return "";
+    }
+
+    static string firstLine(const string& text){
+        return text.substr(0, text.find('\n'));
+    }
+
+    static string firstDifference(const string& a, const string& b){
+        istringstream x(a), y(b);
+        string lineA, lineB;
+        while(true){
+            bool moreA = (bool)getline(x, lineA);
+            bool moreB = (bool)getline(y, lineB);
+            if(!moreA && !moreB){
+                return "";
+            }
+            if(!moreA || !moreB || lineA != lineB){
+                return "'" + (moreA ? lineA : string("<end>")) + "' vs '" + (moreB ? lineB : string("<end>")) + "'";
+            }
+        }
+    }
+
+    static string sanitize(string name){
+        for(char& c : name){
+            if(c == '/' || c == ' '){
+                c = '_';
+            }
+        }
+        return name;
+    }
+
+    /*
+     * Function: instructions
+     * ----------------------
+     * Decodes the instruction start addresses of a program, walking each contiguous
+     * section from its first word and skipping operand words.
+     * Parameters:
+     * - program: the program
+     * Returns:
+     * Start addresses of the instructions in address order.
+     */
+    static vector<int> instructions(const Program& program){
+        vector<int> starts;
+        int i = 0;
+        while(i < MEMORY_SIZE){
+            if(!program.used[i]){
+                i++;
+                continue;
+            }
+            starts.push_back(i);
+            const Opcode* op = findOpcode(program.words[i]);
+            i += (op != NULL && op->operands > 0) ? 2 : 1;
+        }
+        return starts;
+    }
+
+    /*
+     * Function: removeRange
+     * ---------------------
+     * Deletes the words [from, to) and moves the rest of their section up.
+     * Address operands pointing past the deleted words are moved along with them.
+     * Parameters:
+     * - program: the program to edit
+     * - from, to: the words to delete
+     */
+    static Program removeRange(const Program& program, int from, int to){
+        Program result = program;
+        int length = to - from;
+
+        //The section ends at the first undefined word
+        int end = to;
+        while(end < MEMORY_SIZE && program.used[end]){
+            end++;
+        }
+
+        for(int i = from; i < end - length; i++){
+            result.words[i] = program.words[i + length];
+            result.used[i] = program.used[i + length];
+        }
+        for(int i = end - length; i < end; i++){
+            result.words[i] = 0;
+            result.used[i] = 0;
+        }
+
+        //Remap addresses into the moved part of the section
+        for(int start : instructions(result)){
+            const Opcode* op = findOpcode(result.words[start]);
+            if(op == NULL || !addressOperand(*op) || start + 1 >= MEMORY_SIZE){
+                continue;
+            }
+            int& target = result.words[start + 1];
+            if(target >= to && target < end){
+                target -= length;
+            }
+        }
+        return result;
+    }
+
+    /*
+     * Function: shrink
+     * ----------------
+     * Delta debugging over instructions: removes runs of instructions, halving the run
+     * length whenever no run of the current length can be removed.
+     * Parameters:
+     * - program: the failing program
+     * - worker: scratch file prefix of the calling worker
+     * Returns:
+     * The smallest failing program found.
+     */
+    Program shrink(const Program& program, const string& worker){
+        Program current = program;
+        current.path.clear();
+        string file = worker + ".shrink.txt";
+        string report;
+        int runs = 0;
+
+        int chunk = max(1, (int)instructions(current).size() / 2);
+        while(chunk >= 1 && runs < MAX_SHRINK_RUNS){
+            bool removed = false;
+            vector<int> starts = instructions(current);
+            for(size_t first = 0; first < starts.size() && runs < MAX_SHRINK_RUNS; first += chunk){
+                size_t last = min(starts.size(), first + chunk);
+                int from = starts[first];
+                int to = last < starts.size() ? starts[last] : MEMORY_SIZE;
+
+                //A run stops at the end of its section
+                for(int i = from; i < to; i++){
+                    if(!current.used[i]){
+                        to = i;
+                        break;
+                    }
+                }
+
+                Program candidate = removeRange(current, from, to);
+                writeProgram(candidate, file, false);
+                runs++;
+                if(!compare(file, candidate.timer, worker, report)){
+                    current = candidate;
+                    removed = true;
+                    break;
+                }
+            }
+            if(!removed){
+                chunk /= 2;
+            }
+        }
+        unlink(file.c_str());
+        return current;
+    }
+};
+
+
+/*
+ * Generator: Random programs over the full opcode set
+ * ---------------------------------------------------
+ * Builds a user program at 0 followed by a data area, a timer handler at 1000
+ * and a system call handler at 1500. Jump targets are instruction starts of the same
+ * section; data addresses mostly fall in the data area and occasionally in system memory
+ * so permission faults are exercised too.
+ */
+class Generator {
+
+private:
+    //Words in each data area
+    static const int DATA_SIZE = 20;
+
+    mt19937 random;
+
+    int pick(int low, int high){
+        return uniform_int_distribution<int>(low, high)(random);
+    }
+
+    /*
+     * Function: section
+     * -----------------
+     * Generates one section of code.
+     * Parameters:
+     * - program: receives the words
+     * - start: first address of the section
+     * - count: number of instructions
+     * - dataStart: first address of the data area for address operands, -1 to place
+     *   DATA_SIZE random words right behind the code
+     * - last: opcode ending the section (End or IRet)
+     * - safe: restrict handlers to register and stack instructions most of the time
+     */
+    void section(Program& program, int start, int count, int dataStart, int last, bool safe){
+        //Lay out the opcodes first so jump targets are known
+        vector<const Opcode*> ops;
+        vector<int> starts;
+        int address = start;
+        for(int i = 0; i < count; i++){
+            const Opcode* op = &OPCODES[pick(0, OPCODE_COUNT - 2)];     //End only at the end
+            if(safe && pick(0, 9) != 0){
+                static const int SAFE[] = {1, 9, 10, 11, 14, 15, 16, 17, 25, 26};
+                op = findOpcode(SAFE[pick(0, sizeof(SAFE) / sizeof(SAFE[0]) - 1)]);
+            }
+            ops.push_back(op);
+            starts.push_back(address);
+            address += op->operands > 0 ? 2 : 1;
+        }
+        ops.push_back(findOpcode(last));
+        starts.push_back(address);
+
+        if(dataStart < 0){
+            dataStart = address + 1;
+            for(int i = 0; i < DATA_SIZE; i++){
+                program.set(dataStart + i, pick(-3, 100));
+            }
+        }
+        int dataEnd = dataStart + DATA_SIZE;
+
+        for(size_t i = 0; i < ops.size(); i++){
+            const Opcode* op = ops[i];
+            program.set(starts[i], op->code);
+            if(op->operands == 0){
+                continue;
+            }
+
+            int operand;
+            switch(op->code){
+                case 1:  operand = pick(-5, 130); break;
+                case 9:  operand = pick(0, 20) == 0 ? 3 : pick(1, 2); break;
+                case 31: operand = pick(0, 20) == 0 ? 4 : pick(1, 3); break;
+                case 20: case 21: case 22: case 23:
+                    operand = starts[pick(0, starts.size() - 1)];
+                    break;
+                default:
+                    operand = pick(0, 15) == 0 ? pick(0, 1999) : pick(dataStart, dataEnd - 1);
+                    break;
+            }
+            program.set(starts[i] + 1, operand);
+        }
+    }
+
+public:
+
+    Generator(unsigned int seed) : random(seed) {}
+
+    /*
+     * Function: generate
+     * ------------------
+     * Generates one random program.
+     * Parameters:
+     * - name: name used in reports
+     * Returns:
+     * The program, with a random timer value.
+     */
+    Program generate(const string& name){
+        Program program;
+        program.name = name;
+        program.timer = pick(2, 60);
+
+        //User code with a data area right behind it
+        section(program, 0, pick(4, 60), -1, 50, false);
+
+        //Handlers, with system addresses for their data
+        section(program, 1000, pick(0, 6), 1700, 30, true);
+        section(program, 1500, pick(0, 6), 1700, 30, true);
+        return program;
+    }
+};
+
+
+/*
+ * Main Function
+ * -------------
+ * Collects the corpus and generated programs and tests them on all worker threads.
+ * Parameters:
+ * - argc: the number of command-line arguments.
+ * - argv: an array of command-line arguments.
+*/
+int main(int argc, char *argv[]) {
+
+    Tester tester;
+    tester.simulator = "./project1";
+    tester.failureDir = "regress-failures";
+    int jobs = thread::hardware_concurrency();
+    int generate = 0;
+    int timer = 30;
+    const char* corpus = NULL;
+
+    int opt;
+    while((opt = getopt(argc, argv, "akej:g:s:t:c:x:o:")) != -1){
+        switch(opt){
+            case 'a': engineEnabled[3] = true; break;
+            case 'k': engineEnabled[4] = true; break;
+            case 'e': engineEnabled[5] = true; break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'g': generate = atoi(optarg); break;
+            case 's': tester.seed = strtoul(optarg, NULL, 10); break;
+            case 't': timer = atoi(optarg); break;
+            case 'c': tester.cycles = atoll(optarg); break;
+            case 'x': tester.simulator = optarg; break;
+            case 'o': tester.failureDir = optarg; break;
+            default:
+                cerr << "Usage: " << argv[0] << " [-a] [-k] [-e] [-j jobs] [-g count] [-s seed] [-t timer] [-c cycles]"
+                     << " [-x simulator] [-o failure_dir] [corpus_dir]" << endl;
+                return 1;
+        }
+    }
+    if(optind < argc){
+        corpus = argv[optind];
+    }
+    if(jobs < 1){
+        jobs = 1;
+    }
+
+    //Corpus programs
+    vector<Program> programs;
+    if(corpus != NULL){
+        DIR* dir = opendir(corpus);
+        if(dir == NULL){
+            cerr << "ERROR: unable to open the corpus directory" << endl;
+            return 1;
+        }
+        vector<string> names;
+        while(struct dirent* entry = readdir(dir)){
+            string name = entry->d_name;
+            if(name.size() > 4 && (name.compare(name.size() - 4, 4, ".txt") == 0 ||
+                                   name.compare(name.size() - 4, 4, ".img") == 0)){
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+        sort(names.begin(), names.end());
+
+        for(const string& name : names){
+            Program program;
+            program.name = name;
+            program.path = string(corpus) + "/" + name;
+            program.timer = timer;
+            if(!loadProgram(program.path, program)){
+                cerr << "ERROR: unable to read " << program.path << endl;
+                continue;
+            }
+            programs.push_back(program);
+        }
+    }
+
+    //Generated programs
+    Generator generator(tester.seed);
+    for(int i = 0; i < generate; i++){
+        programs.push_back(generator.generate("random-" + to_string(i)));
+    }
+
+    if(programs.empty()){
+        cerr << "ERROR: no programs to test" << endl;
+        return 1;
+    }
+
+    //Scratch directory for program and state files
+    char scratch[] = "/tmp/regress.XXXXXX";
+    if(mkdtemp(scratch) == NULL){
+        cerr << "ERROR: unable to create a scratch directory" << endl;
+        return 1;
+    }
+    tester.scratch = scratch;
+
+    //Input stream shared by every run, numbers mixed with text so both ports of Read get exercised
+    tester.inputFile = tester.scratch + "/input.txt";
+    if(!writeInput(tester.inputFile, tester.seed) || !tester.input.open(tester.inputFile.c_str())){
+        cerr << "ERROR: unable to write the input stream" << endl;
+        return 1;
+    }
+
+    //Workers take the next untested program until none are left
+    atomic<size_t> next(0);
+    mutex printing;
+    vector<thread> workers;
+    for(int w = 0; w < jobs; w++){
+        workers.emplace_back([&, w]() {
+            string worker = tester.scratch + "/w" + to_string(w);
+            size_t i;
+            while((i = next++) < programs.size()){
+                string line = tester.test(programs[i], worker);
+                lock_guard<mutex> lock(printing);
+                cout << line << endl;
+            }
+
+            //Remove this worker's scratch files
+            unlink((worker + ".txt").c_str());
+            for(const char* engine : ENGINES){
+                unlink((worker + "." + engine + ".state").c_str());
+            }
+        });
+    }
+    for(thread& worker : workers){
+        worker.join();
+    }
+    unlink(tester.inputFile.c_str());
+    rmdir(scratch);
+
+    cout << programs.size() << " programs, " << tester.passed << " passed, " << tester.failed << " mismatched" << endl;
+    return tester.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+// sample1.txt written with labels: prints A-Z, then 1-10, then a newline
+
+        Load 0
+        CopyToX
+letters:
+        LoadIdxX alphabet       // load from A-Z table
+        JumpIfEqual numbers
+        Put 2                   // output as char
+        IncX
+        Jump letters
+
+numbers:
+        Load 0
+        CopyToY
+next:
+        LoadIdxY digits         // load from 1-10 table
+        JumpIfEqual done
+        Put 1                   // output as int
+        Load 1                  // because no IncY instruction
+        AddY
+        CopyToY
+        Jump next
+
+done:
+        Load '\n'
+        Put 2
+        End
+
+alphabet:
+        .ascii "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+        .word 0
+digits:
+        .word 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0
+
+.org 1000
+        IRet                    // timer interrupt handler
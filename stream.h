@@ -0,0 +1,226 @@
+/*
+    Program: Computer Simulator
+    File:    stream.h
+    Author:  Stanton Brown
+
+    Desription:
+    Streaming input device read by instruction 31 (Read port), the input side of Put.
+    The input file given with --input is memory-mapped read-only, so a program can read a
+    dataset of any size without it ever being copied into the simulated memory. The kernel is
+    told the file is read sequentially, and each reader asks for the next PREFETCH bytes to be
+    paged in ahead of its position.
+
+    - port 1: the next integer written in the text, skipping anything that is not part of a
+      number (spaces, newlines, commas); Put 1 writes what Read 1 reads
+    - port 2: the next byte
+    - port 3: the end-of-stream flag, 1 once a read has found nothing left, otherwise 0
+
+    A read that finds nothing left sets AC to 0 and the end-of-stream flag. An integer outside
+    the range of int is read past and reported as an invalid operand, leaving AC unchanged.
+    Without an input file the stream is empty. Each CPU reads through its own InputStream, so
+    forked engine processes, branch variants and lockstep instances each see the whole file.
+*/
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+/*
+ * InputFile: The memory-mapped input file
+ * ---------------------------------------
+ */
+class InputFile {
+
+public:
+    const unsigned char* data;
+    size_t size;
+
+    InputFile() : data(NULL), size(0) {}
+
+    //The mapping is owned by one InputFile, so it is moved but never copied
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    InputFile(InputFile&& other) : data(other.data), size(other.size) {
+        other.data = NULL;
+        other.size = 0;
+    }
+
+    InputFile& operator=(InputFile&& other){
+        if(this != &other){
+            unmap();
+            data = other.data;
+            size = other.size;
+            other.data = NULL;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    ~InputFile(){
+        unmap();
+    }
+
+    /*
+     * Function: open
+     * --------------
+     * Maps a file for reading.
+     * Parameters:
+     * - fileName: the input file
+     * Returns:
+     * false (after an error message) if the file cannot be mapped.
+     */
+    bool open(const char* fileName){
+        int fd = ::open(fileName, O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if(fd == -1 || fstat(fd, &info) == -1){
+            cerr << "ERROR: unable to open the input stream " << fileName << ": " << strerror(errno) << endl;
+            if(fd != -1){
+                close(fd);
+            }
+            return false;
+        }
+
+        //An empty file has nothing to map
+        size = info.st_size;
+        if(size > 0){
+            void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped == MAP_FAILED){
+                cerr << "ERROR: unable to map the input stream " << fileName << ": " << strerror(errno) << endl;
+                close(fd);
+                size = 0;
+                return false;
+            }
+            data = (const unsigned char*)mapped;
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        return true;
+    }
+
+private:
+
+    void unmap(){
+        if(data != NULL){
+            munmap((void*)data, size);
+        }
+    }
+};
+
+
+/*
+ * InputStream: One reader's position in the input file
+ * ----------------------------------------------------
+ */
+class InputStream {
+
+public:
+    //Bytes paged in ahead of the position, a multiple of the page size
+    static const size_t PREFETCH = 1 << 20;
+
+private:
+    const InputFile* file;
+    size_t position;
+    size_t prefetched;
+    bool ended;
+
+public:
+
+    /*
+     * Constructor: InputStream
+     * ------------------------
+     * Parameters:
+     * - file: the mapped input file, NULL for an empty stream
+     */
+    InputStream(const InputFile* file = NULL) : file(file), position(0), prefetched(0), ended(false) {}
+
+    /*
+     * Function: read
+     * --------------
+     * Reads from a port, as instruction 31 does.
+     * Parameters:
+     * - port: 1 for an integer, 2 for a byte, 3 for the end-of-stream flag
+     * - value: receives the value, 0 at the end of the stream
+     * Returns:
+     * false for an invalid port or an integer outside the range of int, leaving value unchanged.
+     */
+    bool read(int port, int& value){
+        if(port == 3){
+            value = ended;
+            return true;
+        }
+        if(port != 1 && port != 2){
+            return false;
+        }
+
+        size_t size = file != NULL ? file->size : 0;
+        if(position >= prefetched && position < size){
+            prefetch();
+        }
+        if(port == 2){
+            if(position >= size){
+                ended = true;
+                value = 0;
+                return true;
+            }
+            value = file->data[position++];
+            return true;
+        }
+
+        //Skip to the next digit, or minus sign followed by a digit
+        const unsigned char* data = size > 0 ? file->data : NULL;
+        while(position < size && !isDigit(data[position]) &&
+              !(data[position] == '-' && position + 1 < size && isDigit(data[position + 1]))){
+            position++;
+        }
+        if(position >= size){
+            ended = true;
+            value = 0;
+            return true;
+        }
+
+        //The whole number is consumed; once it is out of range the rest of its digits are not added
+        bool negative = data[position] == '-';
+        position += negative;
+        long long number = 0;
+        long long limit = negative ? -(long long)INT_MIN : INT_MAX;
+        while(position < size && isDigit(data[position])){
+            if(number <= limit){
+                number = number * 10 + (data[position] - '0');
+            }
+            position++;
+        }
+        if(number > limit){
+            return false;
+        }
+        value = (int)(negative ? -number : number);
+        return true;
+    }
+
+private:
+
+    static bool isDigit(unsigned char c){
+        return c >= '0' && c <= '9';
+    }
+
+    //Asks for the next PREFETCH bytes from the position's page on to be paged in
+    void prefetch(){
+        size_t start = position & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
+        size_t length = start + PREFETCH < file->size ? PREFETCH : file->size - start;
+        madvise((void*)(file->data + start), length, MADV_WILLNEED);
+        prefetched = start + PREFETCH;
+    }
+};
+
+#endif
@@ -0,0 +1,268 @@
+/*
+    Program: Computer Simulator
+    File:    sweepbench.cpp
+    Author:  Stanton Brown
+
+    Desription:
+    Throughput benchmark for the lockstep engine (lockstep.h).
+    Runs a timer sweep once as a lockstep sweep and once as one predecoded run per instance,
+    with as many runs at a time as the sweep has threads (one per processor by default), and
+    prints the wall clock time and the instances per second of both. Each side is timed as the
+    best of several repetitions. Every instance must print exactly the output of its own
+    predecoded run.
+
+    sweep.txt is a sweep workload: nested loops that keep a sum in memory, with a timer handler
+    counting the interrupts and a system call printing the count. For example,
+    ./sweepbench sweep.txt 20-83 sweeps 64 timers that fire at different times, and
+    ./sweepbench sweep.txt 100000000-100000063 64 timers that never fire.
+
+    Usage:
+    ./sweepbench [-r repeats] [-j jobs] [-s seed] [-c cycles] [-x simulator] <program> <timers>
+
+    - -r:            repetitions of each side, 3 by default.
+    - -j:            predecoded runs at a time and threads of the sweep, one per processor by default.
+    - -s:            Get seed of every instance, 1 by default.
+    - -c:            cycle limit of every run, none by default.
+    - -x:            simulator binary, ./project1 by default.
+    - program:       the program to run.
+    - timers:        the timer of each instance, a list as taken by --timers such as 5,10,20-25.
+
+    The exit status is 1 if an instance's output differs from its predecoded run.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+extern char** environ;
+
+
+/*
+ * Function: parseList
+ * -------------------
+ * Reads a list such as "5,10,20-25" into its values, like the simulator's --timers.
+ * Returns:
+ * false if the list is malformed or empty.
+ */
+static bool parseList(const char* text, vector<long long>& values){
+    stringstream list(text);
+    string item;
+    while(getline(list, item, ',')){
+        char* end;
+        long long first = strtoll(item.c_str(), &end, 10);
+        long long last = first;
+        if(end == item.c_str()){
+            return false;
+        }
+        if(*end == '-'){
+            const char* start = end + 1;
+            last = strtoll(start, &end, 10);
+            if(end == start || last < first || last - first > 1000000){
+                return false;
+            }
+        }
+        if(*end != '\0'){
+            return false;
+        }
+        for(long long value = first; value <= last; value++){
+            values.push_back(value);
+        }
+    }
+    return !values.empty();
+}
+
+
+/*
+ * Function: startSimulator
+ * ------------------------
+ * Starts the simulator with its standard output and error written to files.
+ * Parameters:
+ * - arguments: the command line, the simulator first
+ * - outputFile: receives standard output
+ * - errorFile: receives standard error
+ * - pid: receives the process
+ * Returns:
+ * false if the simulator could not be started.
+ */
+static bool startSimulator(const vector<string>& arguments, const string& outputFile, const string& errorFile, pid_t& pid){
+    vector<char*> argv;
+    for(size_t i = 0; i < arguments.size(); i++){
+        argv.push_back((char*)arguments[i].c_str());
+    }
+    argv.push_back(NULL);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    posix_spawn_file_actions_addopen(&actions, 2, errorFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    int spawned = posix_spawn(&pid, argv[0], &actions, NULL, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return spawned == 0;
+}
+
+/*
+ * Function: waitSimulator
+ * -----------------------
+ * Waits for any started simulator to end.
+ */
+static void waitSimulator(){
+    int status;
+    while(waitpid(-1, &status, 0) == -1 && errno == EINTR){
+    }
+}
+
+static bool runSimulator(const vector<string>& arguments, const string& outputFile, const string& errorFile){
+    pid_t pid;
+    if(!startSimulator(arguments, outputFile, errorFile, pid)){
+        return false;
+    }
+    waitSimulator();
+    return true;
+}
+
+static string contents(const string& fileName){
+    ifstream in(fileName, ios::binary);
+    stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+static double seconds(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+/*
+ * Main Function
+ * -------------
+ * Times the sweep both ways and compares every instance's output.
+ * Parameters:
+ * - argc: the number of command-line arguments.
+ * - argv: an array of command-line arguments.
+*/
+int main(int argc, char *argv[]) {
+
+    string simulator = "./project1";
+    int repeats = 3;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    string seed = "1";
+    string cycles;
+
+    bool usageValid = true;
+    int opt;
+    while((opt = getopt(argc, argv, "r:j:s:c:x:")) != -1){
+        switch(opt){
+            case 'r': repeats = atoi(optarg); break;
+            case 'j': jobs = atoi(optarg); break;
+            case 's': seed = optarg; break;
+            case 'c': cycles = optarg; break;
+            case 'x': simulator = optarg; break;
+            default: usageValid = false; break;
+        }
+    }
+    vector<long long> timers;
+    if(!usageValid || optind + 2 != argc || repeats < 1 || jobs < 1 || !parseList(argv[optind + 1], timers)){
+        cerr << "Usage: " << argv[0] << " [-r repeats] [-j jobs] [-s seed] [-c cycles] [-x simulator] <program> <timers>" << endl;
+        return 1;
+    }
+    string program = argv[optind];
+    string timerList = argv[optind + 1];
+
+    char scratchName[] = "/tmp/sweepbench.XXXXXX";
+    if(mkdtemp(scratchName) == NULL){
+        cerr << "ERROR: unable to create a scratch directory" << endl;
+        return 1;
+    }
+    string scratch = scratchName;
+
+    vector<string> common = {simulator, "--seed=" + seed};
+    if(!cycles.empty()){
+        common.push_back("--max-cycles=" + cycles);
+    }
+
+    //One predecoded run per instance, jobs at a time
+    double separate = 0;
+    for(int r = 0; r < repeats; r++){
+        auto start = chrono::steady_clock::now();
+        int running = 0;
+        for(size_t k = 0; k < timers.size(); k++){
+            if(running == jobs){
+                waitSimulator();
+                running--;
+            }
+            vector<string> arguments = common;
+            arguments.push_back("--engine=predecoded");
+            arguments.push_back(program);
+            arguments.push_back(to_string(timers[k]));
+            string run = scratch + "/run." + to_string(k);
+            pid_t pid;
+            if(!startSimulator(arguments, run + ".out", run + ".err", pid)){
+                cerr << "ERROR: unable to run " << simulator << endl;
+                return 1;
+            }
+            running++;
+        }
+        for(; running > 0; running--){
+            waitSimulator();
+        }
+        double elapsed = seconds(start);
+        separate = r == 0 ? elapsed : min(separate, elapsed);
+    }
+
+    //All instances in one lockstep sweep
+    double lockstep = 0;
+    for(int r = 0; r < repeats; r++){
+        vector<string> arguments = common;
+        arguments.push_back("--engine=lockstep");
+        arguments.push_back("--timers=" + timerList);
+        arguments.push_back("--threads=" + to_string(jobs));
+        arguments.push_back("--sweep-output=" + scratch + "/sweep");
+        arguments.push_back(program);
+        arguments.push_back(to_string(timers[0]));
+        auto start = chrono::steady_clock::now();
+        if(!runSimulator(arguments, scratch + "/report", scratch + "/report.err")){
+            cerr << "ERROR: unable to run " << simulator << endl;
+            return 1;
+        }
+        double elapsed = seconds(start);
+        lockstep = r == 0 ? elapsed : min(lockstep, elapsed);
+    }
+
+    int mismatched = 0;
+    for(size_t k = 0; k < timers.size(); k++){
+        string run = scratch + "/run." + to_string(k);
+        string sweep = scratch + "/sweep." + to_string(k);
+        if(contents(run + ".out") != contents(sweep + ".out") || contents(run + ".err") != contents(sweep + ".err")){
+            cerr << "instance " << k << " (timer " << timers[k] << "): output differs from its predecoded run" << endl;
+            mismatched++;
+        }
+        unlink((run + ".out").c_str());
+        unlink((run + ".err").c_str());
+        unlink((sweep + ".out").c_str());
+        unlink((sweep + ".err").c_str());
+    }
+    unlink((scratch + "/report").c_str());
+    unlink((scratch + "/report.err").c_str());
+    rmdir(scratch.c_str());
+
+    size_t n = timers.size();
+    printf("%zu instances of %s, best of %d, %d at a time\n", n, program.c_str(), repeats, jobs);
+    printf("predecoded runs: %8.3f s %10.1f instances/s\n", separate, n / separate);
+    printf("lockstep sweep:  %8.3f s %10.1f instances/s  %.2fx\n", lockstep, n / lockstep, separate / lockstep);
+    return mismatched == 0 ? 0 : 1;
+}
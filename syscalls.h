@@ -0,0 +1,374 @@
+/*
+    Program: Computer Simulator
+    File:    syscalls.h
+    Author:  Stanton Brown
+
+    Desription:
+    Host-side emulation of system calls for the predecoded engine.
+    A program asks for a service with Int, passing its arguments in AC, X and Y. The table holds
+    host-side services learned from the program's own handler at 1500: the first time a call is
+    seen, the simulated handler runs as usual while the engine records what it did:
+
+    - which of AC, X and Y it read before writing them, and their values
+    - every word it read before writing it, with the value it saw
+    - the last value it wrote to every word
+    - its output, in order
+    - the stack pointer it returned with and the number of instructions it ran
+
+    A service is keyed only on the registers the handler read, so a loop counter left in a
+    register the handler never looks at does not make every call new. Later calls with the same
+    values in those registers and in the recorded words do exactly the same, so the engine
+    writes the words, prints the output, charges the cycles and timer ticks, and returns with
+    IRet without running a single handler instruction. Any other call runs the simulated
+    handler, which stays the reference. A call is not learned if the handler uses Get or Read,
+    makes a system call itself or runs too long, and the table stops learning once it is full
+    or MISS_LIMIT calls in a row found no service, as calls that never repeat only cost time.
+
+    The handler's code must not change while the program runs, which the static analysis
+    (analysis.h) proves before the table is used.
+*/
+
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "memory.h"
+#include "isa.h"
+
+using namespace std;
+
+
+/*
+ * SyscallTable: The system call services learned from the simulated handler
+ * -------------------------------------------------------------------------
+ */
+class SyscallTable {
+
+public:
+    static const int MEMORY_SIZE = Memory::MEMORY_SIZE;
+
+    //Calls recorded for one key; calls beyond that are simulated
+    static const int VARIANTS = 4;
+
+    //Limits of the table and of a learned call
+    static const size_t SERVICE_LIMIT = 65536;
+    static const int MISS_LIMIT = 1024;
+    static const long long INSTRUCTION_LIMIT = 1000000;
+    static const size_t OUTPUT_LIMIT = 4096;
+
+    struct Word {
+        int address;
+        int value;
+    };
+
+    struct Output {
+        int port;
+        int value;
+    };
+
+    /*
+     * Service: What the handler does for one call
+     */
+    struct Service {
+        vector<Word> reads;         //the call is the same while these words hold these values
+        vector<Word> writes;
+        vector<Output> output;
+        int returnSP;               //SP when the handler executes IRet
+        long long instructions;     //handler instructions, IRet included
+    };
+
+private:
+    //The registers a service can be keyed on
+    static const unsigned KEY_REGISTERS = REG_AC | REG_X | REG_Y;
+
+    /*
+     * Key: The registers the handler reads, and their values (0 for the others)
+     */
+    struct Key {
+        unsigned registers;
+        int AC, X, Y;
+        bool operator==(const Key& other) const {
+            return registers == other.registers && AC == other.AC && X == other.X && Y == other.Y;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.registers;
+            h = h * 1000003 ^ (uint32_t)k.AC;
+            h = h * 1000003 ^ (uint32_t)k.X;
+            return h * 1000003 ^ (uint32_t)k.Y;
+        }
+    };
+
+    /*
+     * Entry: The services of one key, how many calls were recorded for it and how many it answered
+     */
+    struct Entry {
+        int attempts;
+        long long hits;
+        vector<Service> services;
+    };
+
+    unordered_map<Key, Entry, KeyHash> table;
+    size_t services;
+
+    //Every combination of registers some key is made of, tried in turn by find()
+    vector<unsigned> keyRegisters;
+
+    //Calls simulated since the last one a service answered; learning stops at MISS_LIMIT
+    int misses;
+    bool learning;
+
+    //The call being recorded, the registers it read before writing them and those it wrote,
+    //and for every address whether it was read and where it was written
+    bool recording;
+    Key recordingKey;
+    unsigned readRegisters;
+    unsigned writtenRegisters;
+    long long startCycle;
+    Service current;
+    vector<bool> seen;
+    vector<int> writeIndex;
+
+public:
+
+    SyscallTable() : services(0), misses(0), learning(true), recording(false), recordingKey{0, 0, 0, 0},
+    readRegisters(0), writtenRegisters(0), startCycle(0), seen(MEMORY_SIZE, false), writeIndex(MEMORY_SIZE, -1) {}
+
+    /*
+     * Function: find
+     * --------------
+     * Looks for a service answering a call.
+     * Parameters:
+     * - AC, X, Y: the registers of the Int
+     * - words: memory, with the context of the call already saved
+     * Returns:
+     * The service, or NULL if the call has to be simulated.
+     */
+    const Service* find(int AC, int X, int Y, const int* words){
+        for(unsigned registers : keyRegisters){
+            auto entry = table.find(key(registers, AC, X, Y));
+            if(entry == table.end()){
+                continue;
+            }
+            const vector<Service>& candidates = entry->second.services;
+            for(size_t s = 0; s < candidates.size(); s++){
+                const vector<Word>& reads = candidates[s].reads;
+                size_t i = 0;
+                while(i < reads.size() && words[reads[i].address] == reads[i].value){
+                    i++;
+                }
+                if(i == reads.size()){
+                    misses = 0;
+                    entry->second.hits++;
+                    return &candidates[s];
+                }
+            }
+        }
+        misses++;
+        return NULL;
+    }
+
+    /*
+     * Function: record
+     * ----------------
+     * Starts recording a simulated call, unless a key it matches has had its share of
+     * attempts or the table has stopped learning.
+     * Parameters:
+     * - AC, X, Y: the registers of the Int
+     * - cycles: the CPU's cycle count at the Int
+     * Returns:
+     * true if the CPU should report the call's registers, accesses, output and IRet.
+     */
+    bool record(int AC, int X, int Y, long long cycles){
+        if(learning && (misses >= MISS_LIMIT || services >= SERVICE_LIMIT || table.size() >= SERVICE_LIMIT)){
+            stopLearning();
+        }
+        if(!learning){
+            return false;
+        }
+        for(unsigned registers : keyRegisters){
+            auto entry = table.find(key(registers, AC, X, Y));
+            if(entry != table.end() && entry->second.attempts >= VARIANTS){
+                return false;
+            }
+        }
+        recording = true;
+        recordingKey = Key{KEY_REGISTERS, AC, X, Y};
+        readRegisters = 0;
+        writtenRegisters = 0;
+        startCycle = cycles;
+        return true;
+    }
+
+    /*
+     * Function: registers
+     * -------------------
+     * The handler is executing an instruction that reads and writes these registers (Register bits).
+     */
+    void registers(unsigned sources, unsigned results){
+        readRegisters |= sources & ~writtenRegisters & KEY_REGISTERS;
+        writtenRegisters |= results;
+    }
+
+    /*
+     * Function: read
+     * --------------
+     * The handler read a word; only its first value matters, and only if the handler had not written it.
+     */
+    void read(int address, int value){
+        if(recording && !seen[address] && writeIndex[address] < 0){
+            seen[address] = true;
+            current.reads.push_back(Word{address, value});
+        }
+    }
+
+    /*
+     * Function: write
+     * ---------------
+     * The handler wrote a word.
+     */
+    void write(int address, int value){
+        if(!recording){
+            return;
+        }
+        if(writeIndex[address] < 0){
+            writeIndex[address] = current.writes.size();
+            current.writes.push_back(Word{address, value});
+        }
+        else{
+            current.writes[writeIndex[address]].value = value;
+        }
+    }
+
+    /*
+     * Function: put
+     * -------------
+     * The handler executed Put.
+     */
+    void put(int port, int value){
+        if(!recording){
+            return;
+        }
+        current.output.push_back(Output{port, value});
+        if(current.output.size() > OUTPUT_LIMIT){
+            abandon();
+        }
+    }
+
+    /*
+     * Function: abandon
+     * -----------------
+     * Stops recording a call that cannot be repeated. The attempt still counts against the
+     * key of the registers read so far, so such calls are not recorded over and over.
+     */
+    void abandon(){
+        if(recording){
+            attempt();
+        }
+        recording = false;
+        clear();
+    }
+
+    /*
+     * Function: finish
+     * ----------------
+     * The handler is executing IRet: the recorded call becomes a service of its key.
+     * Parameters:
+     * - SP: the stack pointer before IRet
+     * - cycles: the CPU's cycle count, IRet included
+     */
+    void finish(int SP, long long cycles){
+        if(recording && cycles - startCycle <= INSTRUCTION_LIMIT){
+            Entry* entry = attempt();
+            if(entry != NULL){
+                current.returnSP = SP;
+                current.instructions = cycles - startCycle;
+                entry->services.push_back(current);
+                services++;
+            }
+        }
+        recording = false;
+        clear();
+    }
+
+private:
+
+    //The key of a call on the given registers
+    static Key key(unsigned registers, int AC, int X, int Y){
+        return Key{registers, registers & REG_AC ? AC : 0, registers & REG_X ? X : 0, registers & REG_Y ? Y : 0};
+    }
+
+    /*
+     * Function: attempt
+     * -----------------
+     * Counts the call being recorded against the key of the registers it read.
+     * Returns:
+     * The key's entry, NULL if the key has had its share of attempts or the table is full.
+     */
+    Entry* attempt(){
+        Key k = key(readRegisters, recordingKey.AC, recordingKey.X, recordingKey.Y);
+        auto found = table.find(k);
+        if(found == table.end()){
+            if(table.size() >= SERVICE_LIMIT){
+                return NULL;
+            }
+            found = table.emplace(k, Entry{0, 0, vector<Service>()}).first;
+            bool known = false;
+            for(unsigned registers : keyRegisters){
+                known = known || registers == readRegisters;
+            }
+            if(!known){
+                keyRegisters.push_back(readRegisters);
+            }
+        }
+        Entry& entry = found->second;
+        if(entry.attempts >= VARIANTS){
+            return NULL;
+        }
+        entry.attempts++;
+        return &entry;
+    }
+
+    /*
+     * Function: stopLearning
+     * ----------------------
+     * Ends learning, and drops the keys that never answered a call so find() does not keep
+     * looking at them.
+     */
+    void stopLearning(){
+        learning = false;
+        keyRegisters.clear();
+        for(auto entry = table.begin(); entry != table.end();){
+            if(entry->second.hits == 0){
+                services -= entry->second.services.size();
+                entry = table.erase(entry);
+                continue;
+            }
+            bool known = false;
+            for(unsigned registers : keyRegisters){
+                known = known || registers == entry->first.registers;
+            }
+            if(!known){
+                keyRegisters.push_back(entry->first.registers);
+            }
+            ++entry;
+        }
+    }
+
+    //Forgets the call being recorded
+    void clear(){
+        for(size_t i = 0; i < current.reads.size(); i++){
+            seen[current.reads[i].address] = false;
+        }
+        for(size_t i = 0; i < current.writes.size(); i++){
+            writeIndex[current.writes[i].address] = -1;
+        }
+        current = Service();
+    }
+};
+
+#endif